@@ -9,6 +9,8 @@
 #cmakedefine HAVE_LIBEXECINFO
 #cmakedefine HAVE_CXXABI_H
 #cmakedefine HAVE_NICE
+#cmakedefine HAVE_EPOLL
+#cmakedefine HAVE_POSIX_SPAWN
 
 #cmakedefine ICINGA2_UNITY_BUILD
 
@@ -30,6 +30,7 @@
 #include "base/scriptvariable.hpp"
 #include "base/context.hpp"
 #include "base/console.hpp"
+#include "base/processhelper.hpp"
 #include "config.h"
 #include <boost/program_options.hpp>
 #include <boost/tuple/tuple.hpp>
@@ -593,6 +594,12 @@ VOID WINAPI ServiceMain(DWORD argc, LPSTR *argv)
 */
 int main(int argc, char **argv)
 {
+#ifndef _WIN32
+	/* process helpers are started by the daemon, see ProcessHelper::StartHelpers() */
+	if (argc > 2 && strcmp(argv[1], "--process-helper") == 0)
+		return ProcessHelper::HelperMain(Convert::ToLong(argv[2]));
+#endif /* _WIN32 */
+
 	/* must be called before using any other libbase functions */
 	Application::InitializeBase();
 
@@ -266,6 +266,11 @@ void Application::SetArgV(char **argv)
  */
 void Application::RunEventLoop(void)
 {
+	Value work_stealing = ScriptVariable::Get("EnableWorkStealing", &Empty);
+
+	if (!work_stealing.IsEmpty())
+		GetTP().SetWorkStealing(static_cast<bool>(work_stealing));
+
 	Timer::Initialize();
 
 	double lastLoop = Utility::GetTime();
@@ -0,0 +1,134 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "base/bufferedstream.hpp"
+#include "base/debug.hpp"
+#include <algorithm>
+
+using namespace icinga;
+
+BufferedStream::BufferedStream(const Stream::Ptr& innerStream, size_t bufferSize)
+	: m_InnerStream(innerStream), m_BufferSize(bufferSize), m_Offset(0), m_Size(0)
+{
+	m_Buffer = static_cast<char *>(malloc(m_BufferSize));
+
+	if (m_Buffer == NULL)
+		BOOST_THROW_EXCEPTION(std::bad_alloc());
+}
+
+BufferedStream::~BufferedStream(void)
+{
+	free(m_Buffer);
+}
+
+/**
+ * Makes sure that there is at least one byte in the read-ahead buffer.
+ *
+ * @returns The number of bytes which are buffered. 0 if the inner stream
+ *	    has reached EOF.
+ */
+size_t BufferedStream::Fill(void)
+{
+	if (m_Offset < m_Size)
+		return m_Size - m_Offset;
+
+	m_Offset = 0;
+	m_Size = m_InnerStream->ReadSome(m_Buffer, m_BufferSize);
+
+	return m_Size;
+}
+
+/**
+ * Discards data from the read-ahead buffer.
+ *
+ * @param count The number of bytes. Must not be larger than GetAvailable().
+ */
+void BufferedStream::Consume(size_t count)
+{
+	ASSERT(count <= m_Size - m_Offset);
+
+	m_Offset += count;
+}
+
+size_t BufferedStream::Read(void *buffer, size_t count)
+{
+	size_t left = count;
+
+	while (left > 0) {
+		size_t available = m_Size - m_Offset;
+
+		if (available > 0) {
+			size_t chunk = std::min(available, left);
+
+			if (buffer)
+				memcpy(static_cast<char *>(buffer) + (count - left), m_Buffer + m_Offset, chunk);
+
+			m_Offset += chunk;
+			left -= chunk;
+
+			continue;
+		}
+
+		/* Large reads bypass the buffer. */
+		if (buffer && left >= m_BufferSize) {
+			size_t rc = m_InnerStream->Read(static_cast<char *>(buffer) + (count - left), left);
+			left -= rc;
+			break;
+		}
+
+		if (Fill() == 0)
+			break;
+	}
+
+	return count - left;
+}
+
+size_t BufferedStream::ReadSome(void *buffer, size_t count)
+{
+	size_t available = Fill();
+	size_t chunk = std::min(available, count);
+
+	if (buffer)
+		memcpy(buffer, m_Buffer + m_Offset, chunk);
+
+	m_Offset += chunk;
+
+	return chunk;
+}
+
+void BufferedStream::Write(const void *buffer, size_t count)
+{
+	m_InnerStream->Write(buffer, count);
+}
+
+void BufferedStream::Close(void)
+{
+	m_InnerStream->Close();
+}
+
+bool BufferedStream::IsEof(void) const
+{
+	return m_Offset == m_Size && m_InnerStream->IsEof();
+}
+
+Stream::Ptr BufferedStream::GetInnerStream(void) const
+{
+	return m_InnerStream;
+}
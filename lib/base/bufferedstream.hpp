@@ -0,0 +1,88 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef BUFFEREDSTREAM_H
+#define BUFFEREDSTREAM_H
+
+#include "base/i2-base.hpp"
+#include "base/stream.hpp"
+
+namespace icinga
+{
+
+/**
+ * A stream which reads ahead from another stream. Each refill asks the inner
+ * stream for as much data as it has available, so that e.g. a single TLS
+ * record can yield many messages. Writes are passed through unbuffered.
+ *
+ * The read methods are not thread-safe; there must be at most one reader.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API BufferedStream : public Stream
+{
+public:
+	DECLARE_PTR_TYPEDEFS(BufferedStream);
+
+	BufferedStream(const Stream::Ptr& innerStream, size_t bufferSize = 64 * 1024);
+	~BufferedStream(void);
+
+	virtual size_t Read(void *buffer, size_t count);
+	virtual size_t ReadSome(void *buffer, size_t count);
+	virtual void Write(const void *buffer, size_t count);
+
+	virtual void Close(void);
+	virtual bool IsEof(void) const;
+
+	size_t Fill(void);
+
+	/**
+	 * Returns a pointer to the data which is currently buffered. The
+	 * pointer is valid until the next call to any of the read methods.
+	 */
+	inline const char *GetData(void) const
+	{
+		return m_Buffer + m_Offset;
+	}
+
+	/**
+	 * Returns the number of bytes which are currently buffered.
+	 */
+	inline size_t GetAvailable(void) const
+	{
+		return m_Size - m_Offset;
+	}
+
+	void Consume(size_t count);
+
+	Stream::Ptr GetInnerStream(void) const;
+
+private:
+	Stream::Ptr m_InnerStream;
+
+	char *m_Buffer;
+	size_t m_BufferSize;
+	size_t m_Offset;
+	size_t m_Size;
+};
+
+}
+
+#endif /* BUFFEREDSTREAM_H */
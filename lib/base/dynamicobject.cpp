@@ -23,6 +23,7 @@
 #include "base/netstring.hpp"
 #include "base/json.hpp"
 #include "base/stdiostream.hpp"
+#include "base/bufferedstream.hpp"
 #include "base/debug.hpp"
 #include "base/objectlock.hpp"
 #include "base/logger.hpp"
@@ -332,13 +333,14 @@ void DynamicObject::RestoreObjects(const String& filename, int attributeTypes)
 	fp.open(filename.CStr(), std::ios_base::in);
 
 	StdioStream::Ptr sfp = make_shared<StdioStream>(&fp, false);
+	BufferedStream::Ptr bfp = make_shared<BufferedStream>(sfp);
 
 	unsigned long restored = 0;
 
 	ParallelWorkQueue upq;
 
 	String message;
-	while (NetString::ReadStringFromStream(sfp, &message)) {
+	while (NetString::ReadStringFromStream(bfp, &message)) {
 		upq.Enqueue(boost::bind(&DynamicObject::RestoreObject, message, attributeTypes));
 		restored++;
 	}
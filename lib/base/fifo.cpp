@@ -97,6 +97,23 @@ size_t FIFO::Read(void *buffer, size_t count)
 	return count;
 }
 
+/**
+ * Copies data from the beginning of the FIFO buffer without removing it.
+ *
+ * @param buffer The buffer where data should be stored.
+ * @param count The maximum number of bytes to copy.
+ * @returns The number of bytes copied.
+ */
+size_t FIFO::Peek(void *buffer, size_t count) const
+{
+	if (count > m_DataSize)
+		count = m_DataSize;
+
+	std::memcpy(buffer, m_Buffer + m_Offset, count);
+
+	return count;
+}
+
 /**
  * Implements IOQueue::Write.
  */
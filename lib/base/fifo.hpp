@@ -42,6 +42,7 @@ public:
 	~FIFO(void);
 
 	virtual size_t Read(void *buffer, size_t count);
+	size_t Peek(void *buffer, size_t count) const;
 	virtual void Write(const void *buffer, size_t count);
 	virtual void Close(void);
 	virtual bool IsEof(void) const;
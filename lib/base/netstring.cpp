@@ -18,8 +18,10 @@
  ******************************************************************************/
 
 #include "base/netstring.hpp"
+#include "base/bufferedstream.hpp"
 #include "base/debug.hpp"
 #include <sstream>
+#include <algorithm>
 
 using namespace icinga;
 
@@ -34,6 +36,11 @@ using namespace icinga;
  */
 bool NetString::ReadStringFromStream(const Stream::Ptr& stream, String *str)
 {
+	BufferedStream::Ptr bstream = dynamic_pointer_cast<BufferedStream>(stream);
+
+	if (bstream)
+		return ReadStringFromBufferedStream(bstream, str);
+
 	/* 16 bytes are enough for the header */
 	const size_t header_length = 16;
 	size_t read_length;
@@ -114,6 +121,145 @@ bool NetString::ReadStringFromStream(const Stream::Ptr& stream, String *str)
 	return true;
 }
 
+/**
+ * Reads data from a buffered stream in netstring format. The header is parsed
+ * directly from the read-ahead buffer and the payload is copied into the
+ * String without an intermediate buffer.
+ *
+ * @param stream The stream to read from.
+ * @param[out] str The String that has been read from the stream.
+ * @returns true if a complete String was read from the stream, false otherwise.
+ * @exception invalid_argument The input stream is invalid.
+ */
+bool NetString::ReadStringFromBufferedStream(const BufferedStream::Ptr& stream, String *str)
+{
+	size_t len = 0, digits = 0;
+
+	for (;;) {
+		if (stream->Fill() == 0) {
+			if (digits == 0)
+				return false;
+
+			BOOST_THROW_EXCEPTION(std::runtime_error("Read() failed."));
+		}
+
+		const char *data = stream->GetData();
+		size_t available = stream->GetAvailable();
+		size_t i;
+
+		for (i = 0; i < available; i++) {
+			char ch = data[i];
+
+			if (ch == ':')
+				break;
+
+			if (!isdigit(ch))
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing :)"));
+
+			/* no leading zeros allowed */
+			if (digits == 1 && len == 0)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (leading zero)"));
+
+			/* length specifier must have at most 9 characters */
+			if (digits >= 9)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Length specifier must not exceed 9 characters"));
+
+			len = len * 10 + (ch - '0');
+			digits++;
+		}
+
+		if (i < available) {
+			stream->Consume(i + 1);
+			break;
+		}
+
+		stream->Consume(available);
+	}
+
+	String result;
+	result.GetData().reserve(len);
+
+	size_t left = len;
+
+	while (left > 0) {
+		if (stream->Fill() == 0)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Read() failed."));
+
+		size_t chunk = std::min(left, stream->GetAvailable());
+		result.GetData().append(stream->GetData(), chunk);
+		stream->Consume(chunk);
+		left -= chunk;
+	}
+
+	char trailer;
+
+	if (stream->Read(&trailer, 1) != 1)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Read() failed."));
+
+	if (trailer != ',')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing ,)"));
+
+	str->swap(result);
+
+	return true;
+}
+
+/**
+ * Reads a netstring from a FIFO buffer. Unlike ReadStringFromStream() this
+ * never waits for more data: if the buffer doesn't contain a complete
+ * netstring yet it is left unchanged.
+ *
+ * @param buffer The buffer to read from.
+ * @param[out] str The String that has been read from the buffer.
+ * @returns true if a complete String was read from the buffer, false otherwise.
+ * @exception invalid_argument The input data is invalid.
+ */
+bool NetString::ReadStringFromBuffer(const FIFO::Ptr& buffer, String *str)
+{
+	/* at most 9 digits and the colon */
+	char header[10];
+	size_t header_length = buffer->Peek(header, sizeof(header));
+	size_t len = 0, i;
+
+	for (i = 0; i < header_length && header[i] != ':'; i++) {
+		if (!isdigit(header[i]))
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing :)"));
+
+		/* no leading zeros allowed */
+		if (i == 1 && header[0] == '0')
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (leading zero)"));
+
+		len = len * 10 + (header[i] - '0');
+	}
+
+	if (i == header_length) {
+		if (header_length == sizeof(header))
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Length specifier must not exceed 9 characters"));
+
+		return false;
+	}
+
+	if (buffer->GetAvailableBytes() < i + 1 + len + 1)
+		return false;
+
+	buffer->Read(NULL, i + 1);
+
+	String result(len, '\0');
+
+	if (len > 0)
+		buffer->Read(&result[0], len);
+
+	char trailer;
+	buffer->Read(&trailer, 1);
+
+	if (trailer != ',')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing ,)"));
+
+	str->swap(result);
+
+	return true;
+}
+
 /**
  * Writes data into a stream using the netstring format.
  *
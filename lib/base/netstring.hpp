@@ -23,6 +23,8 @@
 #include "base/i2-base.hpp"
 #include "base/string.hpp"
 #include "base/stream.hpp"
+#include "base/bufferedstream.hpp"
+#include "base/fifo.hpp"
 
 namespace icinga
 {
@@ -38,10 +40,13 @@ class I2_BASE_API NetString
 {
 public:
 	static bool ReadStringFromStream(const Stream::Ptr& stream, String *message);
+	static bool ReadStringFromBuffer(const FIFO::Ptr& buffer, String *message);
 	static void WriteStringToStream(const Stream::Ptr& stream, const String& message);
 
 private:
 	NetString(void);
+
+	static bool ReadStringFromBufferedStream(const BufferedStream::Ptr& stream, String *message);
 };
 
 }
@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "base/process.hpp"
+#include "base/processhelper.hpp"
 #include "base/exception.hpp"
 #include "base/convert.hpp"
 #include "base/array.hpp"
@@ -30,11 +31,21 @@
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/join.hpp>
 #include <boost/thread/once.hpp>
+#include <limits>
+#include <queue>
 
 #ifndef _WIN32
 #	include <execvpe.h>
 #	include <poll.h>
 
+#	ifdef HAVE_EPOLL
+#		include <sys/epoll.h>
+#	endif /* HAVE_EPOLL */
+
+#	ifdef HAVE_POSIX_SPAWN
+#		include <spawn.h>
+#	endif /* HAVE_POSIX_SPAWN */
+
 #	ifndef __APPLE__
 extern char **environ;
 #	else /* __APPLE__ */
@@ -46,26 +57,41 @@ extern char **environ;
 using namespace icinga;
 
 #define IOTHREADS 2
+#define MAX_IOTHREADS 16
 
-static boost::mutex l_ProcessMutex[IOTHREADS];
-static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
+static int l_IOThreadCount = IOTHREADS;
+static boost::mutex l_ProcessMutex[MAX_IOTHREADS];
+static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[MAX_IOTHREADS];
 #ifdef _WIN32
-static HANDLE l_Events[IOTHREADS];
+static HANDLE l_Events[MAX_IOTHREADS];
 #else /* _WIN32 */
-static int l_EventFDs[IOTHREADS][2];
-static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
+static int l_EventFDs[MAX_IOTHREADS][2];
+static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[MAX_IOTHREADS];
+#endif /* _WIN32 */
+#ifdef HAVE_EPOLL
+typedef std::pair<double, Process::ProcessHandle> ProcessTimeout;
+typedef std::priority_queue<ProcessTimeout, std::vector<ProcessTimeout>, std::greater<ProcessTimeout> > ProcessTimeoutQueue;
+
+static int l_EpollFDs[MAX_IOTHREADS];
+static ProcessTimeoutQueue l_Timeouts[MAX_IOTHREADS];
+static double l_WaitUntil[MAX_IOTHREADS]; /**< When the I/O thread wakes up next; 0 if it isn't waiting. */
+#endif /* HAVE_EPOLL */
+#ifndef _WIN32
+static boost::mutex l_EnvironmentMutex;
+static std::vector<char *> l_BaseEnvironment;
+static bool l_BaseEnvironmentValid = false;
 #endif /* _WIN32 */
 static boost::once_flag l_OnceFlag = BOOST_ONCE_INIT;
 
 INITIALIZE_ONCE(&Process::StaticInitialize);
 
 Process::Process(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment)
-	: m_Arguments(arguments), m_ExtraEnvironment(extraEnvironment), m_Timeout(600)
+	: m_Arguments(arguments), m_ExtraEnvironment(extraEnvironment), m_Timeout(600), m_UseHelper(false)
 { }
 
 void Process::StaticInitialize(void)
 {
-	for (int tid = 0; tid < IOTHREADS; tid++) {
+	for (int tid = 0; tid < MAX_IOTHREADS; tid++) {
 #ifdef _WIN32
 		l_Events[tid] = CreateEvent(NULL, TRUE, FALSE, NULL);
 #else /* _WIN32 */
@@ -95,9 +121,43 @@ void Process::StaticInitialize(void)
 
 void Process::ThreadInitialize(void)
 {
+	Value threads = ScriptVariable::Get("ProcessIOThreads", &Empty);
+
+	if (!threads.IsEmpty()) {
+		l_IOThreadCount = threads;
+
+		if (l_IOThreadCount < 1)
+			l_IOThreadCount = 1;
+		else if (l_IOThreadCount > MAX_IOTHREADS)
+			l_IOThreadCount = MAX_IOTHREADS;
+	}
+
 	/* Note to self: Make sure this runs _after_ we've daemonized. */
-	for (int tid = 0; tid < IOTHREADS; tid++) {
+	for (int tid = 0; tid < l_IOThreadCount; tid++) {
+#ifdef HAVE_EPOLL
+		l_EpollFDs[tid] = epoll_create1(EPOLL_CLOEXEC);
+
+		if (l_EpollFDs[tid] < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("epoll_create1")
+			    << boost::errinfo_errno(errno));
+		}
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.ptr = NULL;
+		event.events = EPOLLIN;
+
+		if (epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, l_EventFDs[tid][0], &event) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("epoll_ctl")
+			    << boost::errinfo_errno(errno));
+		}
+
+		boost::thread t(boost::bind(&Process::IOThreadProcEpoll, tid));
+#else /* HAVE_EPOLL */
 		boost::thread t(boost::bind(&Process::IOThreadProc, tid));
+#endif /* HAVE_EPOLL */
 		t.detach();
 	}
 }
@@ -148,6 +208,22 @@ double Process::GetTimeout(void) const
 	return m_Timeout;
 }
 
+/**
+ * Sets whether the process may be started by one of the helper processes
+ * (if any are running) instead of being forked from this process.
+ *
+ * @param use_helper Whether to use a helper process.
+ */
+void Process::SetUseHelper(bool use_helper)
+{
+	m_UseHelper = use_helper;
+}
+
+bool Process::GetUseHelper(void) const
+{
+	return m_UseHelper;
+}
+
 void Process::IOThreadProc(int tid)
 {
 #ifdef _WIN32
@@ -281,6 +357,123 @@ void Process::IOThreadProc(int tid)
 	}
 }
 
+#ifdef HAVE_EPOLL
+/**
+ * Note: Caller must hold l_ProcessMutex[tid].
+ */
+void Process::CloseProcess(int tid, const Process::Ptr& process)
+{
+	(void)epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_DEL, process->m_FD, NULL);
+	(void)close(process->m_FD);
+
+	l_Processes[tid].erase(process->m_Process);
+}
+
+/**
+ * I/O thread proc which uses epoll. File descriptors are registered once in
+ * Process::Run and timeouts are kept in a min-heap, so the cost of each
+ * wakeup does not depend on the number of running processes.
+ */
+void Process::IOThreadProcEpoll(int tid)
+{
+	epoll_event events[128];
+
+	Utility::SetThreadName("ProcessIO");
+
+	for (;;) {
+		int timeout = -1;
+
+		{
+			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+			ProcessTimeoutQueue& timeouts = l_Timeouts[tid];
+
+			/* Skip timeouts which belong to processes that have already terminated. */
+			while (!timeouts.empty()) {
+				std::map<ProcessHandle, Process::Ptr>::iterator it = l_Processes[tid].find(timeouts.top().second);
+
+				if (it != l_Processes[tid].end() && it->second->m_Result.ExecutionStart + it->second->m_Timeout == timeouts.top().first)
+					break;
+
+				timeouts.pop();
+			}
+
+			if (!timeouts.empty()) {
+				double delta = timeouts.top().first - Utility::GetTime();
+				timeout = (delta > 0) ? static_cast<int>(delta * 1000) + 1 : 0;
+				l_WaitUntil[tid] = timeouts.top().first;
+			} else
+				l_WaitUntil[tid] = std::numeric_limits<double>::max();
+		}
+
+		int rc = epoll_wait(l_EpollFDs[tid], events, sizeof(events) / sizeof(events[0]), timeout);
+
+		if (rc < 0 && errno != EINTR)
+			Log(LogCritical, "base", "epoll_wait() failed.");
+
+		double now = Utility::GetTime();
+
+		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+		l_WaitUntil[tid] = 0;
+
+		for (int i = 0; i < rc; i++) {
+			if (events[i].data.ptr == NULL) {
+				char buffer[512];
+				if (read(l_EventFDs[tid][0], buffer, sizeof(buffer)) < 0)
+					Log(LogCritical, "base", "Read from event FD failed.");
+
+				continue;
+			}
+
+			Process::Ptr process = static_cast<Process *>(events[i].data.ptr)->GetSelf();
+
+			if (!process->DoEvents())
+				CloseProcess(tid, process);
+		}
+
+		ProcessTimeoutQueue& timeouts = l_Timeouts[tid];
+
+		while (!timeouts.empty() && timeouts.top().first < now) {
+			ProcessTimeout pt = timeouts.top();
+			timeouts.pop();
+
+			std::map<ProcessHandle, Process::Ptr>::iterator it = l_Processes[tid].find(pt.second);
+
+			if (it == l_Processes[tid].end() || it->second->m_Result.ExecutionStart + it->second->m_Timeout != pt.first)
+				continue;
+
+			Process::Ptr process = it->second;
+
+			if (!process->DoEvents())
+				CloseProcess(tid, process);
+		}
+	}
+}
+#endif /* HAVE_EPOLL */
+
+#ifndef _WIN32
+/**
+ * Appends the process' environment to the specified vector. The strings are
+ * copied once and shared by all child processes, so callers must not free them.
+ *
+ * @param envp The vector which receives the environment.
+ */
+static void GetBaseEnvironment(std::vector<char *>& envp)
+{
+	boost::mutex::scoped_lock lock(l_EnvironmentMutex);
+
+	if (!l_BaseEnvironmentValid) {
+		for (int i = 0; environ[i] != NULL; i++)
+			l_BaseEnvironment.push_back(strdup(environ[i]));
+
+		l_BaseEnvironmentValid = true;
+	}
+
+	envp.insert(envp.end(), l_BaseEnvironment.begin(), l_BaseEnvironment.end());
+}
+#endif /* _WIN32 */
+
 String Process::PrettyPrintArguments(const Process::Arguments& arguments)
 {
 #ifdef _WIN32
@@ -296,6 +489,15 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 
 	m_Result.ExecutionStart = Utility::GetTime();
 
+	if (m_UseHelper && ProcessHelper::IsRunning()) {
+		m_PID = -1;
+
+		if (ProcessHelper::Run(m_Arguments, m_ExtraEnvironment, m_Timeout, callback)) {
+			m_ExtraEnvironment.reset();
+			return;
+		}
+	}
+
 #ifdef _WIN32
 	SECURITY_ATTRIBUTES sa = {};
 	sa.nLength = sizeof(sa);
@@ -473,50 +675,73 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 	argv[m_Arguments.size()] = NULL;
 
 	// build envp
-	int envc = 0;
-
-	/* count existing environment variables */
-	while (environ[envc] != NULL)
-		envc++;
+	std::vector<char *> envp;
 
-	char **envp = new char *[envc + (m_ExtraEnvironment ? m_ExtraEnvironment->GetLength() : 0) + 1];
+	/* the base environment is shared, only the extra variables are copied */
+	GetBaseEnvironment(envp);
 
-	for (int i = 0; i < envc; i++)
-		envp[i] = strdup(environ[i]);
+	size_t envc = envp.size();
 
 	if (m_ExtraEnvironment) {
 		ObjectLock olock(m_ExtraEnvironment);
 
-		int index = envc;
 		BOOST_FOREACH(const Dictionary::Pair& kv, m_ExtraEnvironment) {
 			String skv = kv.first + "=" + Convert::ToString(kv.second);
-			envp[index] = strdup(skv.CStr());
-			index++;
+			envp.push_back(strdup(skv.CStr()));
 		}
 	}
 
-	envp[envc + (m_ExtraEnvironment ? m_ExtraEnvironment->GetLength() : 0)] = NULL;
+	envp.push_back(NULL);
 
 	m_ExtraEnvironment.reset();
 
+	bool spawned = false;
+
+#ifdef HAVE_POSIX_SPAWN
+	Value use_posix_spawn = ScriptVariable::Get("UsePosixSpawn", &Empty);
+
+	if (!use_posix_spawn.IsEmpty() && static_cast<bool>(use_posix_spawn)) {
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+		int rc = posix_spawnp(&m_Process, argv[0], &actions, NULL, argv, &envp[0]);
+
+		posix_spawn_file_actions_destroy(&actions);
+
+		if (rc != 0) {
+			m_Process = -1;
+
+			std::ostringstream msgbuf;
+			msgbuf << "posix_spawnp(" << argv[0] << ") failed: " << Utility::FormatErrorNumber(rc);
+			m_Result.Output = msgbuf.str();
+		}
+
+		spawned = true;
+	}
+#endif /* HAVE_POSIX_SPAWN */
+
+	if (!spawned) {
 #ifdef HAVE_VFORK
-	Value use_vfork = ScriptVariable::Get("UseVfork");
+		Value use_vfork = ScriptVariable::Get("UseVfork");
 
-	if (use_vfork.IsEmpty() || static_cast<bool>(use_vfork))
-		m_Process = vfork();
-	else
-		m_Process = fork();
+		if (use_vfork.IsEmpty() || static_cast<bool>(use_vfork))
+			m_Process = vfork();
+		else
+			m_Process = fork();
 #else /* HAVE_VFORK */
-	m_Process = fork();
+		m_Process = fork();
 #endif /* HAVE_VFORK */
+	}
 
-	if (m_Process < 0) {
+	if (!spawned && m_Process < 0) {
 		BOOST_THROW_EXCEPTION(posix_error()
 			<< boost::errinfo_api_function("fork")
 			<< boost::errinfo_errno(errno));
 	}
 
-	if (m_Process == 0) {
+	if (!spawned && m_Process == 0) {
 		// child process
 
 		if (dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0) {
@@ -532,7 +757,7 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 			Log(LogWarning, "base", "Failed to renice child process.");
 #endif /* HAVE_NICE */
 
-		if (icinga2_execvpe(argv[0], argv, envp) < 0) {
+		if (icinga2_execvpe(argv[0], argv, &envp[0]) < 0) {
 			char errmsg[512];
 			strcpy(errmsg, "execvpe(");
 			strncat(errmsg, argv[0], sizeof(errmsg) - 1);
@@ -549,23 +774,37 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 
 	m_PID = m_Process;
 
-	Log(LogNotice, "Process")
-	    << "Running command " << PrettyPrintArguments(m_Arguments) <<": PID " << m_PID;
-
 	// free arguments
 	for (int i = 0; argv[i] != NULL; i++)
 		free(argv[i]);
 
 	delete[] argv;
 
-	// free environment
-	for (int i = 0; envp[i] != NULL; i++)
+	// free extra environment variables
+	for (size_t i = envc; envp[i] != NULL; i++)
 		free(envp[i]);
 
-	delete[] envp;
-
 	(void)close(fds[1]);
 
+	if (m_Process < 0) {
+		/* posix_spawn failed; report the error like a failed exec() */
+		(void)close(fds[0]);
+
+		Log(LogWarning, "Process", m_Result.Output);
+
+		m_Result.PID = m_PID;
+		m_Result.ExecutionEnd = Utility::GetTime();
+		m_Result.ExitStatus = 128;
+
+		if (callback)
+			Utility::QueueAsyncCallback(boost::bind(callback, m_Result));
+
+		return;
+	}
+
+	Log(LogNotice, "Process")
+	    << "Running command " << PrettyPrintArguments(m_Arguments) <<": PID " << m_PID;
+
 	Utility::SetNonBlocking(fds[0]);
 
 	m_FD = fds[0];
@@ -575,6 +814,33 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 
 	int tid = GetTID();
 
+#ifdef HAVE_EPOLL
+	{
+		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+		l_Processes[tid][m_Process] = GetSelf();
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.ptr = this;
+		event.events = EPOLLIN;
+
+		if (epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, m_FD, &event) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("epoll_ctl")
+			    << boost::errinfo_errno(errno));
+		}
+
+		if (m_Timeout != 0) {
+			double deadline = m_Result.ExecutionStart + m_Timeout;
+			l_Timeouts[tid].push(std::make_pair(deadline, m_Process));
+
+			/* The I/O thread only needs to be woken up if it would otherwise sleep past this timeout. */
+			if (deadline >= l_WaitUntil[tid])
+				return;
+		} else
+			return;
+	}
+#else /* HAVE_EPOLL */
 	{
 		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
 		l_Processes[tid][m_Process] = GetSelf();
@@ -582,6 +848,7 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 		l_FDs[tid][m_FD] = m_Process;
 #endif /* _WIN32 */
 	}
+#endif /* HAVE_EPOLL */
 
 #ifdef _WIN32
 	SetEvent(l_Events[tid]);
@@ -696,6 +963,6 @@ pid_t Process::GetPID(void) const
 
 int Process::GetTID(void) const
 {
-	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % IOTHREADS;
+	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % l_IOThreadCount;
 }
 
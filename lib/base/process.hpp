@@ -72,6 +72,9 @@ public:
 	void SetTimeout(double timeout);
 	double GetTimeout(void) const;
 
+	void SetUseHelper(bool use_helper);
+	bool GetUseHelper(void) const;
+
 	void Run(const boost::function<void (const ProcessResult&)>& callback = boost::function<void (const ProcessResult&)>());
 
 	pid_t GetPID(void) const;
@@ -88,6 +91,7 @@ private:
 	Dictionary::Ptr m_ExtraEnvironment;
 
 	double m_Timeout;
+	bool m_UseHelper;
 
 	ProcessHandle m_Process;
 	pid_t m_PID;
@@ -98,6 +102,10 @@ private:
 	ProcessResult m_Result;
 
 	static void IOThreadProc(int tid);
+#ifdef HAVE_EPOLL
+	static void IOThreadProcEpoll(int tid);
+	static void CloseProcess(int tid, const Process::Ptr& process);
+#endif /* HAVE_EPOLL */
 	bool DoEvents(void);
 	int GetTID(void) const;
 };
@@ -0,0 +1,657 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "base/processhelper.hpp"
+#include "base/application.hpp"
+#include "base/json.hpp"
+#include "base/array.hpp"
+#include "base/convert.hpp"
+#include "base/objectlock.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include "base/exception.hpp"
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+#include <map>
+
+#ifndef _WIN32
+#	include <execvpe.h>
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <sys/socket.h>
+#	include <sys/wait.h>
+
+#	ifndef __APPLE__
+extern char **environ;
+#	else /* __APPLE__ */
+#		include <crt_externs.h>
+#		define environ (*_NSGetEnviron())
+#	endif /* __APPLE__ */
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+#ifndef _WIN32
+
+#define MAX_HELPERS 16
+
+struct HelperState
+{
+	int FD;
+	pid_t PID;
+	bool Alive;
+	boost::mutex WriteMutex;
+	std::map<unsigned long, boost::function<void (const ProcessResult&)> > Callbacks;
+};
+
+static HelperState l_Helpers[MAX_HELPERS];
+static int l_HelperCount = 0;
+static boost::mutex l_HelperMutex;
+static unsigned long l_NextRequestID = 1;
+static boost::once_flag l_OnceFlag = BOOST_ONCE_INIT;
+
+/**
+ * Reads exactly the specified number of bytes from a file descriptor.
+ *
+ * @returns true if the data was read, false on EOF or error.
+ */
+static bool ReadFully(int fd, char *buffer, size_t count)
+{
+	while (count > 0) {
+		ssize_t rc = read(fd, buffer, count);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			return false;
+
+		buffer += rc;
+		count -= rc;
+	}
+
+	return true;
+}
+
+static bool WriteFully(int fd, const char *buffer, size_t count)
+{
+	while (count > 0) {
+		ssize_t rc = write(fd, buffer, count);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			return false;
+
+		buffer += rc;
+		count -= rc;
+	}
+
+	return true;
+}
+
+/**
+ * Reads a netstring-encoded message from a file descriptor.
+ */
+static bool ReadMessage(int fd, String *message)
+{
+	size_t len = 0;
+
+	for (int i = 0; ; i++) {
+		char ch;
+
+		if (!ReadFully(fd, &ch, 1))
+			return false;
+
+		if (ch == ':')
+			break;
+
+		if (!isdigit(ch) || i >= 9)
+			return false;
+
+		len = len * 10 + (ch - '0');
+	}
+
+	std::vector<char> data(len + 1);
+
+	if (!ReadFully(fd, &data[0], len + 1) || data[len] != ',')
+		return false;
+
+	*message = String(data.begin(), data.end() - 1);
+
+	return true;
+}
+
+static bool WriteMessage(int fd, const String& message)
+{
+	String netstring = Convert::ToString(message.GetLength()) + ":" + message + ",";
+
+	return WriteFully(fd, netstring.CStr(), netstring.GetLength());
+}
+
+/**
+ * Starts the specified number of helper processes. Each helper is a new
+ * instance of the icinga2 binary which only runs HelperMain() and therefore
+ * doesn't share the daemon's (potentially very large) address space.
+ *
+ * @param count The number of helper processes.
+ */
+void ProcessHelper::StartHelpers(int count)
+{
+	if (count > MAX_HELPERS)
+		count = MAX_HELPERS;
+
+	String exePath = Application::GetExePath(Application::GetArgV()[0]);
+
+	for (int i = 0; i < count; i++) {
+		int fds[2];
+
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("socketpair")
+			    << boost::errinfo_errno(errno));
+		}
+
+		Utility::SetCloExec(fds[0]);
+		Utility::SetCloExec(fds[1]);
+
+		char fdbuf[16];
+		snprintf(fdbuf, sizeof(fdbuf), "%d", fds[1]);
+
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("fork")
+			    << boost::errinfo_errno(errno));
+		}
+
+		if (pid == 0) {
+			/* Only the helper's end of the socket pair is passed on to the new process. */
+			if (fcntl(fds[1], F_SETFD, 0) < 0)
+				_exit(128);
+
+			(void)execl(exePath.CStr(), exePath.CStr(), "--process-helper", fdbuf, static_cast<char *>(NULL));
+
+			perror("execl() failed");
+			_exit(128);
+		}
+
+		(void)close(fds[1]);
+
+		l_Helpers[l_HelperCount].FD = fds[0];
+		l_Helpers[l_HelperCount].PID = pid;
+		l_Helpers[l_HelperCount].Alive = true;
+		l_HelperCount++;
+
+		Log(LogInformation, "ProcessHelper")
+		    << "Started process helper with PID " << pid;
+	}
+}
+
+/**
+ * Checks whether there is at least one helper process which can accept commands.
+ */
+bool ProcessHelper::IsRunning(void)
+{
+	boost::mutex::scoped_lock lock(l_HelperMutex);
+
+	for (int i = 0; i < l_HelperCount; i++) {
+		if (l_Helpers[i].Alive)
+			return true;
+	}
+
+	return false;
+}
+
+void ProcessHelper::ThreadInitialize(void)
+{
+	for (int i = 0; i < l_HelperCount; i++) {
+		boost::thread t(boost::bind(&ProcessHelper::ReaderThreadProc, i));
+		t.detach();
+	}
+}
+
+/**
+ * Executes a command using one of the helper processes.
+ *
+ * @returns true if the command was passed to a helper, false if no helper
+ *	    is available and the caller should run the command itself.
+ */
+bool ProcessHelper::Run(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment,
+    double timeout, const boost::function<void (const ProcessResult&)>& callback)
+{
+	boost::call_once(l_OnceFlag, &ProcessHelper::ThreadInitialize);
+
+	Array::Ptr args = make_shared<Array>();
+
+	BOOST_FOREACH(const String& argument, arguments)
+		args->Add(argument);
+
+	Dictionary::Ptr request = make_shared<Dictionary>();
+	request->Set("arguments", args);
+	request->Set("timeout", timeout);
+
+	if (extraEnvironment)
+		request->Set("environment", extraEnvironment);
+
+	for (int attempt = 0; attempt < l_HelperCount; attempt++) {
+		unsigned long id;
+		int helper;
+
+		{
+			boost::mutex::scoped_lock lock(l_HelperMutex);
+
+			id = l_NextRequestID++;
+			helper = id % l_HelperCount;
+
+			if (!l_Helpers[helper].Alive)
+				continue;
+
+			l_Helpers[helper].Callbacks[id] = callback;
+		}
+
+		request->Set("id", id);
+
+		String message = JsonEncode(request);
+
+		bool written;
+
+		{
+			boost::mutex::scoped_lock lock(l_Helpers[helper].WriteMutex);
+			written = WriteMessage(l_Helpers[helper].FD, message);
+		}
+
+		if (written)
+			return true;
+
+		boost::mutex::scoped_lock lock(l_HelperMutex);
+
+		/* The reader thread has already failed the callback because the helper died. */
+		if (l_Helpers[helper].Callbacks.erase(id) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Reads results from a helper process and invokes the callbacks.
+ */
+void ProcessHelper::ReaderThreadProc(int helper)
+{
+	Utility::SetThreadName("ProcessHelper");
+
+	HelperState& state = l_Helpers[helper];
+
+	for (;;) {
+		String message;
+
+		if (!ReadMessage(state.FD, &message))
+			break;
+
+		unsigned long id;
+		ProcessResult pr;
+
+		try {
+			Dictionary::Ptr result = JsonDecode(message);
+
+			id = result->Get("id");
+			pr.PID = result->Get("pid");
+			pr.ExecutionStart = result->Get("execution_start");
+			pr.ExecutionEnd = result->Get("execution_end");
+			pr.ExitStatus = result->Get("exit_status");
+			pr.Output = result->Get("output");
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ProcessHelper")
+			    << "Ignoring invalid message from process helper: " << DiagnosticInformation(ex);
+			continue;
+		}
+
+		boost::function<void (const ProcessResult&)> callback;
+
+		{
+			boost::mutex::scoped_lock lock(l_HelperMutex);
+
+			std::map<unsigned long, boost::function<void (const ProcessResult&)> >::iterator it;
+			it = state.Callbacks.find(id);
+
+			if (it == state.Callbacks.end())
+				continue;
+
+			callback = it->second;
+			state.Callbacks.erase(it);
+		}
+
+		if (callback)
+			Utility::QueueAsyncCallback(boost::bind(callback, pr));
+	}
+
+	Log(LogCritical, "ProcessHelper", "Process helper terminated unexpectedly.");
+
+	/* The helper might still be running if it sent an invalid message. */
+	(void)kill(state.PID, SIGKILL);
+
+	while (waitpid(state.PID, NULL, 0) < 0 && errno == EINTR)
+		; /* Try again. */
+
+	std::map<unsigned long, boost::function<void (const ProcessResult&)> > callbacks;
+
+	{
+		boost::mutex::scoped_lock lock(l_HelperMutex);
+		state.Alive = false;
+		callbacks.swap(state.Callbacks);
+	}
+
+	/* Fail all commands which were still running in the helper. */
+	typedef std::pair<unsigned long, boost::function<void (const ProcessResult&)> > kv_pair;
+	BOOST_FOREACH(const kv_pair& kv, callbacks) {
+		ProcessResult pr;
+		pr.PID = -1;
+		pr.ExecutionStart = pr.ExecutionEnd = Utility::GetTime();
+		pr.ExitStatus = 128;
+		pr.Output = "<Process helper terminated.>";
+
+		if (kv.second)
+			Utility::QueueAsyncCallback(boost::bind(kv.second, pr));
+	}
+}
+
+struct HelperChild
+{
+	Value ID;
+	pid_t PID;
+	int FD;
+	double ExecutionStart;
+	double Timeout;
+	std::string Output;
+};
+
+static void SendChildResult(int fd, HelperChild& child, bool timed_out)
+{
+	int status, exitcode;
+	String output = child.Output;
+
+	if (timed_out) {
+		kill(child.PID, SIGKILL);
+		output += "<Timeout exceeded.>";
+	}
+
+	while (waitpid(child.PID, &status, 0) < 0 && errno == EINTR)
+		; /* Try again. */
+
+	if (WIFEXITED(status)) {
+		exitcode = WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		std::ostringstream outputbuf;
+		outputbuf << "<Terminated by signal " << WTERMSIG(status) << ".>";
+		output += outputbuf.str();
+		exitcode = 128;
+	} else {
+		exitcode = 128;
+	}
+
+	Dictionary::Ptr result = make_shared<Dictionary>();
+	result->Set("id", child.ID);
+	result->Set("pid", child.PID);
+	result->Set("execution_start", child.ExecutionStart);
+	result->Set("execution_end", Utility::GetTime());
+	result->Set("exit_status", exitcode);
+	result->Set("output", output);
+
+	(void)WriteMessage(fd, JsonEncode(result));
+}
+
+static bool SpawnChild(const Dictionary::Ptr& request, HelperChild& child)
+{
+	Array::Ptr arguments = request->Get("arguments");
+	Dictionary::Ptr extraEnvironment = request->Get("environment");
+
+	if (!arguments || arguments->GetLength() == 0) {
+		errno = EINVAL;
+		return false;
+	}
+
+	std::vector<String> args;
+
+	{
+		ObjectLock olock(arguments);
+		BOOST_FOREACH(const String& argument, arguments)
+			args.push_back(argument);
+	}
+
+	std::vector<char *> argv;
+	BOOST_FOREACH(String& argument, args)
+		argv.push_back(const_cast<char *>(argument.CStr()));
+	argv.push_back(NULL);
+
+	std::vector<String> extra;
+
+	if (extraEnvironment) {
+		ObjectLock olock(extraEnvironment);
+
+		BOOST_FOREACH(const Dictionary::Pair& kv, extraEnvironment)
+			extra.push_back(kv.first + "=" + Convert::ToString(kv.second));
+	}
+
+	std::vector<char *> envp;
+	for (int i = 0; environ[i] != NULL; i++)
+		envp.push_back(environ[i]);
+	BOOST_FOREACH(String& kv, extra)
+		envp.push_back(const_cast<char *>(kv.CStr()));
+	envp.push_back(NULL);
+
+	int fds[2];
+
+	if (pipe(fds) < 0)
+		return false;
+
+	Utility::SetCloExec(fds[0]);
+	Utility::SetCloExec(fds[1]);
+
+	child.ID = request->Get("id");
+	child.Timeout = request->Get("timeout");
+	child.ExecutionStart = Utility::GetTime();
+	child.PID = fork();
+
+	if (child.PID < 0) {
+		(void)close(fds[0]);
+		(void)close(fds[1]);
+		return false;
+	}
+
+	if (child.PID == 0) {
+		if (dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0) {
+			perror("dup2() failed");
+			_exit(128);
+		}
+
+		(void)close(fds[0]);
+		(void)close(fds[1]);
+
+#ifdef HAVE_NICE
+		(void)nice(5);
+#endif /* HAVE_NICE */
+
+		if (icinga2_execvpe(argv[0], &argv[0], &envp[0]) < 0) {
+			char errmsg[512];
+			strcpy(errmsg, "execvpe(");
+			strncat(errmsg, argv[0], sizeof(errmsg) - 1);
+			strncat(errmsg, ") failed", sizeof(errmsg) - 1);
+			errmsg[sizeof(errmsg) - 1] = '\0';
+			perror(errmsg);
+			_exit(128);
+		}
+
+		_exit(128);
+	}
+
+	(void)close(fds[1]);
+
+	child.FD = fds[0];
+
+	return true;
+}
+
+/**
+ * Main loop for helper processes. Runs commands received on the control
+ * socket and sends their results back.
+ *
+ * @param fd The helper's end of the control socket.
+ * @returns The exit code for the helper process.
+ */
+int ProcessHelper::HelperMain(int fd)
+{
+	Utility::SetCloExec(fd);
+
+	std::vector<HelperChild> children;
+
+	for (;;) {
+		std::vector<pollfd> pfds(children.size() + 1);
+
+		pfds[0].fd = fd;
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+
+		double now = Utility::GetTime();
+		double timeout = -1;
+
+		for (size_t i = 0; i < children.size(); i++) {
+			pfds[i + 1].fd = children[i].FD;
+			pfds[i + 1].events = POLLIN;
+			pfds[i + 1].revents = 0;
+
+			if (children[i].Timeout != 0) {
+				double delta = children[i].ExecutionStart + children[i].Timeout - now;
+
+				if (delta < 0)
+					delta = 0;
+
+				if (timeout == -1 || delta < timeout)
+					timeout = delta;
+			}
+		}
+
+		int rc = poll(&pfds[0], pfds.size(), timeout == -1 ? -1 : static_cast<int>(timeout * 1000) + 1);
+
+		if (rc < 0 && errno != EINTR)
+			break;
+
+		if (rc < 0)
+			continue;
+
+		now = Utility::GetTime();
+
+		std::vector<HelperChild> running;
+
+		for (size_t i = 0; i < children.size(); i++) {
+			HelperChild& child = children[i];
+			bool done = false, timed_out = false;
+
+			if (pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+				char buffer[512];
+				ssize_t count = read(child.FD, buffer, sizeof(buffer));
+
+				if (count > 0)
+					child.Output.append(buffer, count);
+				else if (count == 0 || errno != EINTR)
+					done = true;
+			}
+
+			if (!done && child.Timeout != 0 && child.ExecutionStart + child.Timeout < now)
+				done = timed_out = true;
+
+			if (done) {
+				(void)close(child.FD);
+				SendChildResult(fd, child, timed_out);
+			} else
+				running.push_back(child);
+		}
+
+		children.swap(running);
+
+		if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			String message;
+
+			/* The daemon has gone away. */
+			if (!ReadMessage(fd, &message))
+				break;
+
+			Dictionary::Ptr request;
+
+			try {
+				request = JsonDecode(message);
+			} catch (const std::exception&) {
+				continue;
+			}
+
+			HelperChild child;
+
+			if (SpawnChild(request, child)) {
+				children.push_back(child);
+			} else {
+				child.PID = -1;
+
+				Dictionary::Ptr result = make_shared<Dictionary>();
+				result->Set("id", request->Get("id"));
+				result->Set("pid", -1);
+				result->Set("execution_start", now);
+				result->Set("execution_end", now);
+				result->Set("exit_status", 128);
+				result->Set("output", "<Process helper could not start the command: " + Utility::FormatErrorNumber(errno) + ">");
+
+				(void)WriteMessage(fd, JsonEncode(result));
+			}
+		}
+	}
+
+	BOOST_FOREACH(HelperChild& child, children) {
+		kill(child.PID, SIGKILL);
+		(void)waitpid(child.PID, NULL, 0);
+	}
+
+	return 0;
+}
+
+#else /* _WIN32 */
+
+void ProcessHelper::StartHelpers(int)
+{ }
+
+bool ProcessHelper::IsRunning(void)
+{
+	return false;
+}
+
+int ProcessHelper::HelperMain(int)
+{
+	return EXIT_FAILURE;
+}
+
+bool ProcessHelper::Run(const Process::Arguments&, const Dictionary::Ptr&,
+    double, const boost::function<void (const ProcessResult&)>&)
+{
+	return false;
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,62 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef PROCESSHELPER_H
+#define PROCESSHELPER_H
+
+#include "base/i2-base.hpp"
+#include "base/process.hpp"
+#include <boost/function.hpp>
+
+namespace icinga
+{
+
+/**
+ * A pool of helper processes which execute commands on behalf of the daemon.
+ * The helpers are started by re-executing the icinga2 binary, so forking one
+ * of them is much cheaper than forking the (potentially very large) daemon
+ * process itself.
+ *
+ * Requests and results are exchanged as JSON-encoded netstrings over a UNIX
+ * socket pair.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API ProcessHelper
+{
+public:
+	static void StartHelpers(int count);
+	static bool IsRunning(void);
+
+	static int HelperMain(int fd);
+
+	static bool Run(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment,
+	    double timeout, const boost::function<void (const ProcessResult&)>& callback);
+
+private:
+	ProcessHelper(void);
+
+	static void ReaderThreadProc(int helper);
+	static void ThreadInitialize(void);
+};
+
+}
+
+#endif /* PROCESSHELPER_H */
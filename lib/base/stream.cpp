@@ -22,6 +22,20 @@
 
 using namespace icinga;
 
+/**
+ * Reads at least one byte but no more than the specified number of bytes
+ * from the stream. Unlike Read() this doesn't wait for the buffer to be
+ * filled completely. The default implementation simply calls Read().
+ *
+ * @param buffer The buffer where data should be stored.
+ * @param count The maximum number of bytes to read.
+ * @returns The number of bytes actually read. 0 on EOF.
+ */
+size_t Stream::ReadSome(void *buffer, size_t count)
+{
+	return Read(buffer, count);
+}
+
 bool Stream::ReadLine(String *line, ReadLineContext& context)
 {
 	if (context.Eof)
@@ -66,6 +66,8 @@ public:
 	 */
 	virtual size_t Read(void *buffer, size_t count) = 0;
 
+	virtual size_t ReadSome(void *buffer, size_t count);
+
 	/**
 	 * Writes data to the stream.
 	 *
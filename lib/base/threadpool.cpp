@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "base/threadpool.hpp"
+#include "base/array.hpp"
 #include "base/logger.hpp"
 #include "base/debug.hpp"
 #include "base/utility.hpp"
@@ -30,11 +31,14 @@ using namespace icinga;
 int ThreadPool::m_NextID = 1;
 
 ThreadPool::ThreadPool(size_t max_threads)
-	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_Stopped(false)
+	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_Stopped(false), m_WorkStealing(false)
 {
 	if (m_MaxThreads != UINT_MAX && m_MaxThreads < sizeof(m_Queues) / sizeof(m_Queues[0]))
 		m_MaxThreads = sizeof(m_Queues) / sizeof(m_Queues[0]);
 
+	for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++)
+		m_Queues[i].Pool = this;
+
 	Start();
 }
 
@@ -100,13 +104,38 @@ void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
 
 			UpdateUtilization(ThreadIdle);
 
+			bool thief = false;
+
 			while (queue.Items.empty() && !queue.Stopped && !Zombie) {
 				if (queue.Items.empty())
 					queue.CVStarved.notify_all();
 
+				/* Post() wakes us up via WakeThief() when another queue backs up. */
+				if (!thief && queue.Pool->GetWorkStealing()) {
+					queue.Pool->SetIdleThief(queue, true);
+					thief = true;
+				}
+
+				if (queue.StealRequested) {
+					Queue *victim = queue.StealVictim;
+					queue.StealRequested = false;
+					queue.StealVictim = NULL;
+
+					lock.unlock();
+					queue.Pool->StealWork(queue, *victim);
+					lock.lock();
+
+					continue;
+				}
+
+				queue.WaitingWorkers++;
 				queue.CV.wait(lock);
+				queue.WaitingWorkers--;
 			}
 
+			if (thief)
+				queue.Pool->SetIdleThief(queue, false);
+
 			if (Zombie)
 				break;
 
@@ -199,6 +228,7 @@ bool ThreadPool::Post(const ThreadPool::WorkFunction& callback, SchedulerPolicy
 	wi.Timestamp = Utility::GetTime();
 
 	Queue& queue = m_Queues[Utility::Random() % (sizeof(m_Queues) / sizeof(m_Queues[0]))];
+	bool backlog;
 
 	{
 		boost::mutex::scoped_lock lock(queue.Mutex);
@@ -211,11 +241,164 @@ bool ThreadPool::Post(const ThreadPool::WorkFunction& callback, SchedulerPolicy
 
 		queue.Items.push_back(wi);
 		queue.CV.notify_one();
+
+		/* The queue's own workers can't pick up all of its items right away. */
+		backlog = (queue.Items.size() > static_cast<size_t>(queue.WaitingWorkers));
+	}
+
+	if (backlog && GetWorkStealing())
+		WakeThief(queue);
+
+	return true;
+}
+
+/**
+ * Enables or disables work stealing. When enabled an idle worker thread is
+ * woken up whenever a queue backs up and takes half of its pending work items.
+ *
+ * @param enabled Whether to enable work stealing.
+ */
+void ThreadPool::SetWorkStealing(bool enabled)
+{
+	boost::mutex::scoped_lock lock(m_MgmtMutex);
+	m_WorkStealing = enabled;
+}
+
+bool ThreadPool::GetWorkStealing(void) const
+{
+	boost::mutex::scoped_lock lock(const_cast<boost::mutex&>(m_MgmtMutex));
+	return m_WorkStealing;
+}
+
+/**
+ * Registers or unregisters an idle worker which is looking for work items
+ * in the other queues.
+ */
+void ThreadPool::SetIdleThief(Queue& queue, bool idle)
+{
+	boost::mutex::scoped_lock lock(m_StealMutex);
+
+	if (idle)
+		queue.IdleThieves++;
+	else
+		queue.IdleThieves--;
+}
+
+/**
+ * Wakes up an idle worker of another queue so that it takes some of the
+ * victim's work items.
+ *
+ * Note: Caller must not hold any queue Mutex.
+ *
+ * @param victim The queue which has backed up.
+ */
+void ThreadPool::WakeThief(Queue& victim)
+{
+	size_t count = sizeof(m_Queues) / sizeof(m_Queues[0]);
+	size_t offset = Utility::Random() % count;
+	Queue *thief = NULL;
+
+	{
+		boost::mutex::scoped_lock lock(m_StealMutex);
+
+		for (size_t i = 0; i < count; i++) {
+			Queue& queue = m_Queues[(offset + i) % count];
+
+			if (&queue != &victim && queue.IdleThieves > 0) {
+				thief = &queue;
+				break;
+			}
+		}
+	}
+
+	if (!thief)
+		return;
+
+	boost::mutex::scoped_lock lock(thief->Mutex);
+
+	thief->StealRequested = true;
+	thief->StealVictim = &victim;
+	thief->CV.notify_one();
+}
+
+/**
+ * Moves half of the victim's work items into the specified queue.
+ *
+ * Note: Caller must not hold any queue Mutex.
+ *
+ * @param thief The queue which should receive the work items.
+ * @param victim The queue to take the work items from.
+ * @returns true if work items were moved, false otherwise.
+ */
+bool ThreadPool::StealWork(Queue& thief, Queue& victim)
+{
+	std::deque<WorkItem> items;
+
+	{
+		boost::mutex::scoped_lock lock(victim.Mutex);
+
+		/* Take the newer half of the items; the victim's own workers keep the older ones. */
+		size_t count = (victim.Items.size() + 1) / 2;
+
+		if (count == 0)
+			return false;
+
+		items.assign(victim.Items.end() - count, victim.Items.end());
+		victim.Items.erase(victim.Items.end() - count, victim.Items.end());
 	}
 
+	boost::mutex::scoped_lock lock(thief.Mutex);
+
+	thief.Items.insert(thief.Items.end(), items.begin(), items.end());
+	thief.StealCount += items.size();
+
+	if (items.size() > 1)
+		thief.CV.notify_all();
+
 	return true;
 }
 
+/**
+ * Retrieves statistics about the thread pool's queues.
+ *
+ * @returns A dictionary with the statistics.
+ */
+Dictionary::Ptr ThreadPool::GetStats(void)
+{
+	Array::Ptr queues = make_shared<Array>();
+	size_t total_pending = 0, total_steals = 0;
+
+	for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
+		Queue& queue = m_Queues[i];
+
+		boost::mutex::scoped_lock lock(queue.Mutex);
+
+		size_t alive = 0;
+
+		for (size_t t = 0; t < sizeof(queue.Threads) / sizeof(queue.Threads[0]); t++) {
+			if (queue.Threads[t].State != ThreadDead && !queue.Threads[t].Zombie)
+				alive++;
+		}
+
+		Dictionary::Ptr stats = make_shared<Dictionary>();
+		stats->Set("pending", queue.Items.size());
+		stats->Set("threads", alive);
+		stats->Set("steals", queue.StealCount);
+		queues->Add(stats);
+
+		total_pending += queue.Items.size();
+		total_steals += queue.StealCount;
+	}
+
+	Dictionary::Ptr result = make_shared<Dictionary>();
+	result->Set("work_stealing", GetWorkStealing());
+	result->Set("pending", total_pending);
+	result->Set("steals", total_steals);
+	result->Set("queues", queues);
+
+	return result;
+}
+
 void ThreadPool::ManagerThreadProc(void)
 {
 	std::ostringstream idbuf;
@@ -225,7 +408,7 @@ void ThreadPool::ManagerThreadProc(void)
 	double lastStats = 0;
 
 	for (;;) {
-		size_t total_pending = 0, total_alive = 0;
+		size_t total_pending = 0, total_alive = 0, total_steals = 0;
 		double total_avg_latency = 0;
 		double total_utilization = 0;
 
@@ -308,6 +491,7 @@ void ThreadPool::ManagerThreadProc(void)
 			total_alive += alive;
 			total_avg_latency += avg_latency;
 			total_utilization += utilization;
+			total_steals += queue.StealCount;
 		}
 
 		double now = Utility::GetTime();
@@ -319,7 +503,8 @@ void ThreadPool::ManagerThreadProc(void)
 			    << "Pool #" << m_ID << ": Pending tasks: " << total_pending << "; Average latency: "
 			    << (long)(total_avg_latency * 1000 / (sizeof(m_Queues) / sizeof(m_Queues[0]))) << "ms"
 			    << "; Threads: " << total_alive
-			    << "; Pool utilization: " << (total_utilization / (sizeof(m_Queues) / sizeof(m_Queues[0]))) << "%";
+			    << "; Pool utilization: " << (total_utilization / (sizeof(m_Queues) / sizeof(m_Queues[0]))) << "%"
+			    << "; Stolen tasks: " << total_steals;
 		}
 	}
 }
@@ -21,6 +21,7 @@
 #define THREADPOOL_H
 
 #include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
 #include <boost/function.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -57,6 +58,11 @@ public:
 
 	bool Post(const WorkFunction& callback, SchedulerPolicy policy = DefaultScheduler);
 
+	void SetWorkStealing(bool enabled);
+	bool GetWorkStealing(void) const;
+
+	Dictionary::Ptr GetStats(void);
+
 private:
 	enum ThreadState
 	{
@@ -103,12 +109,23 @@ private:
 		double ServiceTime;
 		int TaskCount;
 
+		unsigned long StealCount; /**< Number of work items this queue took from other queues. */
+
+		int WaitingWorkers; /**< Number of workers which are waiting for work items. */
+		bool StealRequested; /**< Set by WakeThief() when another queue has backed up. */
+		Queue *StealVictim;
+
+		int IdleThieves; /**< Protected by ThreadPool::m_StealMutex. */
+
 		bool Stopped;
 
+		ThreadPool *Pool;
+
 		WorkerThread Threads[16];
 
 		Queue(void)
-			: WaitTime(0), ServiceTime(0), TaskCount(0), Stopped(false)
+			: WaitTime(0), ServiceTime(0), TaskCount(0), StealCount(0), WaitingWorkers(0),
+			  StealRequested(false), StealVictim(NULL), IdleThieves(0), Stopped(false), Pool(NULL)
 		{ }
 
 		void SpawnWorker(boost::thread_group& group);
@@ -128,7 +145,15 @@ private:
 
 	Queue m_Queues[QUEUECOUNT];
 
+	bool m_WorkStealing;
+
+	boost::mutex m_StealMutex;
+
 	void ManagerThreadProc(void);
+
+	void SetIdleThief(Queue& queue, bool idle);
+	void WakeThief(Queue& victim);
+	bool StealWork(Queue& thief, Queue& victim);
 };
 
 }
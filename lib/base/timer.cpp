@@ -18,6 +18,9 @@
  ******************************************************************************/
 
 #include "base/timer.hpp"
+#include "base/timingwheel.hpp"
+#include "base/scriptvariable.hpp"
+#include "base/logger.hpp"
 #include "base/debug.hpp"
 #include "base/utility.hpp"
 #include <boost/bind.hpp>
@@ -28,6 +31,9 @@
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
+#include <algorithm>
+#include <iterator>
+#include <limits>
 
 using namespace icinga;
 
@@ -39,11 +45,62 @@ typedef boost::multi_index_container<
 	>
 > TimerSet;
 
+enum TimerBackend
+{
+	TimerBackendSet,
+	TimerBackendWheel
+};
+
 static boost::mutex l_Mutex;
 static boost::condition_variable l_CV;
 static boost::thread l_Thread;
 static bool l_StopThread;
+static TimerBackend l_Backend = TimerBackendSet;
 static TimerSet l_Timers;
+static TimingWheel l_Wheel;
+static double l_WheelWaitUntil = 0; /**< When the timer thread wakes up next; 0 if it isn't waiting. */
+
+/**
+ * Note: Caller must hold l_Mutex.
+ */
+static void InsertTimer(Timer *timer)
+{
+	if (l_Backend == TimerBackendWheel) {
+		double next = Timer::Holder(timer).GetNextUnlocked();
+		l_Wheel.Insert(timer, next);
+
+		/* Only wake up the worker if it would otherwise sleep past this timer. */
+		if (next < l_WheelWaitUntil)
+			l_CV.notify_all();
+	} else {
+		l_Timers.insert(timer);
+
+		/* Notify the worker that we've rescheduled a timer. */
+		l_CV.notify_all();
+	}
+}
+
+/**
+ * Note: Caller must hold l_Mutex.
+ */
+static void EraseTimer(Timer *timer)
+{
+	if (l_Backend == TimerBackendWheel)
+		l_Wheel.Remove(timer);
+	else
+		l_Timers.erase(timer);
+}
+
+/**
+ * Note: Caller must hold l_Mutex.
+ */
+static void GetTimers(std::vector<Timer *>& timers)
+{
+	if (l_Backend == TimerBackendWheel)
+		l_Wheel.GetTimers(timers);
+	else
+		std::copy(l_Timers.begin(), l_Timers.end(), std::back_inserter(timers));
+}
 
 /**
  * Constructor for the Timer class.
@@ -61,13 +118,43 @@ Timer::~Timer(void)
 }
 
 /**
- * Initializes the timer sub-system.
+ * Initializes the timer sub-system. The "TimerBackend" script variable
+ * selects how pending timers are stored: "set" (the default) or "wheel".
+ * Timers which were started before this function is called are moved
+ * to the selected backend.
  */
 void Timer::Initialize(void)
 {
+	String backend = ScriptVariable::Get("TimerBackend", &Empty);
+
+	if (!backend.IsEmpty() && backend != "wheel" && backend != "set") {
+		Log(LogWarning, "Timer")
+		    << "Invalid timer backend '" << backend << "'. Falling back to 'set'.";
+	}
+
+	TimerBackend new_backend = (backend == "wheel") ? TimerBackendWheel : TimerBackendSet;
+
 	boost::mutex::scoped_lock lock(l_Mutex);
+
+	if (new_backend != l_Backend) {
+		std::vector<Timer *> timers;
+		GetTimers(timers);
+
+		BOOST_FOREACH(Timer *timer, timers)
+			EraseTimer(timer);
+
+		l_Backend = new_backend;
+
+		BOOST_FOREACH(Timer *timer, timers)
+			InsertTimer(timer);
+	}
+
 	l_StopThread = false;
-	l_Thread = boost::thread(&Timer::TimerThreadProc);
+
+	if (l_Backend == TimerBackendWheel)
+		l_Thread = boost::thread(&Timer::WheelThreadProc);
+	else
+		l_Thread = boost::thread(&Timer::TimerThreadProc);
 }
 
 /**
@@ -155,10 +242,11 @@ void Timer::Stop(void)
 	boost::mutex::scoped_lock lock(l_Mutex);
 
 	m_Started = false;
-	l_Timers.erase(this);
+	EraseTimer(this);
 
 	/* Notify the worker thread that we've disabled a timer. */
-	l_CV.notify_all();
+	if (l_Backend != TimerBackendWheel)
+		l_CV.notify_all();
 }
 
 /**
@@ -185,11 +273,8 @@ void Timer::Reschedule(double next)
 
 	if (m_Started) {
 		/* Remove and re-add the timer to update the index. */
-		l_Timers.erase(this);
-		l_Timers.insert(this);
-
-		/* Notify the worker that we've rescheduled a timer. */
-		l_CV.notify_all();
+		EraseTimer(this);
+		InsertTimer(this);
 	}
 }
 
@@ -218,12 +303,10 @@ void Timer::AdjustTimers(double adjustment)
 
 	double now = Utility::GetTime();
 
-	typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
-	TimerView& idx = boost::get<1>(l_Timers);
-
-	std::vector<Timer *> timers;
+	std::vector<Timer *> all_timers, timers;
+	GetTimers(all_timers);
 
-	BOOST_FOREACH(Timer *timer, idx) {
+	BOOST_FOREACH(Timer *timer, all_timers) {
 		if (abs(now - (timer->m_Next + adjustment)) <
 		    abs(now - timer->m_Next)) {
 			timer->m_Next += adjustment;
@@ -231,9 +314,13 @@ void Timer::AdjustTimers(double adjustment)
 		}
 	}
 
+	/* The wheel's current tick has to follow the clock before the timers are re-inserted. */
+	if (l_Backend == TimerBackendWheel)
+		l_Wheel.Rebase(now);
+
 	BOOST_FOREACH(Timer *timer, timers) {
-		l_Timers.erase(timer);
-		l_Timers.insert(timer);
+		EraseTimer(timer);
+		InsertTimer(timer);
 	}
 
 	/* Notify the worker that we've rescheduled some timers. */
@@ -284,3 +371,57 @@ void Timer::TimerThreadProc(void)
 		Utility::QueueAsyncCallback(boost::bind(&Timer::Call, ptimer));
 	}
 }
+
+/**
+ * Worker thread proc for Timer objects when the timing wheel backend is used.
+ * All timers which expire within the same tick are dispatched as one batch.
+ */
+void Timer::WheelThreadProc(void)
+{
+	Utility::SetThreadName("Timer Thread");
+
+	for (;;) {
+		std::vector<Timer::Ptr> expired_timers;
+
+		{
+			boost::mutex::scoped_lock lock(l_Mutex);
+
+			/* Wait until there is at least one timer. */
+			while (l_Wheel.IsEmpty() && !l_StopThread) {
+				l_WheelWaitUntil = std::numeric_limits<double>::max();
+				l_CV.wait(lock);
+			}
+
+			l_WheelWaitUntil = 0;
+
+			if (l_StopThread)
+				break;
+
+			/* Expired timers are removed from the wheel so they don't get
+			 * called again until the current call is completed. */
+			std::vector<Timer *> expired;
+			l_Wheel.Advance(Utility::GetTime(), expired);
+
+			if (expired.empty()) {
+				double next = l_Wheel.GetNextExpiry();
+				double wait = next - Utility::GetTime();
+
+				if (wait > 0) {
+					/* Wait for the next tick which has timers. */
+					l_WheelWaitUntil = next;
+					l_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+					l_WheelWaitUntil = 0;
+				}
+
+				continue;
+			}
+
+			BOOST_FOREACH(Timer *timer, expired)
+				expired_timers.push_back(timer->GetSelf());
+		}
+
+		/* Asynchronously call the timers. */
+		BOOST_FOREACH(const Timer::Ptr& timer, expired_timers)
+			Utility::QueueAsyncCallback(boost::bind(&Timer::Call, timer));
+	}
+}
@@ -88,6 +88,7 @@ private:
 	void Call();
 
 	static void TimerThreadProc(void);
+	static void WheelThreadProc(void);
 };
 
 }
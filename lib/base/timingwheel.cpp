@@ -0,0 +1,294 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "base/timingwheel.hpp"
+#include "base/utility.hpp"
+#include <boost/foreach.hpp>
+#include <cmath>
+
+using namespace icinga;
+
+/* The first level has 256 slots, each of the upper levels has 64 slots. */
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_ROOT_SIZE (1 << WHEEL_ROOT_BITS)
+#define WHEEL_LEVEL_SIZE (1 << WHEEL_LEVEL_BITS)
+#define WHEEL_LEVELS (sizeof(m_Levels) / sizeof(m_Levels[0]))
+
+static inline int GetLevelShift(int level)
+{
+	return WHEEL_ROOT_BITS + (level - 1) * WHEEL_LEVEL_BITS;
+}
+
+/**
+ * Constructor for the TimingWheel class.
+ *
+ * @param resolution The length of a tick in seconds.
+ */
+TimingWheel::TimingWheel(double resolution)
+	: m_Resolution(resolution)
+{
+	m_CurrentTick = GetTick(Utility::GetTime());
+
+	for (size_t i = 0; i < WHEEL_LEVELS; i++) {
+		m_Levels[i].resize(i == 0 ? WHEEL_ROOT_SIZE : WHEEL_LEVEL_SIZE);
+		m_Counts[i] = 0;
+	}
+}
+
+boost::uint64_t TimingWheel::GetTick(double ts) const
+{
+	if (ts <= 0)
+		return 0;
+
+	return static_cast<boost::uint64_t>(std::floor(ts / m_Resolution));
+}
+
+/**
+ * Adds a timer to the wheel. The timer must not already be part of the wheel.
+ *
+ * @param timer The timer.
+ * @param next The timestamp when the timer expires.
+ */
+void TimingWheel::Insert(Timer *timer, double next)
+{
+	Entry entry;
+	entry.Object = timer;
+	entry.Next = next;
+	entry.Tick = GetTick(next);
+
+	InsertEntry(entry);
+}
+
+void TimingWheel::InsertEntry(const Entry& entry)
+{
+	boost::uint64_t tick = entry.Tick;
+
+	/* Timers which are already due expire with the next tick. */
+	if (tick < m_CurrentTick)
+		tick = m_CurrentTick;
+
+	boost::uint64_t delta = tick - m_CurrentTick;
+
+	int level;
+	size_t slot;
+
+	if (delta < WHEEL_ROOT_SIZE) {
+		level = 0;
+		slot = tick & (WHEEL_ROOT_SIZE - 1);
+	} else {
+		for (level = 1; level < static_cast<int>(WHEEL_LEVELS) - 1; level++) {
+			if (delta < (static_cast<boost::uint64_t>(1) << (GetLevelShift(level) + WHEEL_LEVEL_BITS)))
+				break;
+		}
+
+		/* Timers beyond the range of the top level are parked in its
+		 * farthest slot and re-evaluated when that slot is cascaded. */
+		boost::uint64_t max_delta = (static_cast<boost::uint64_t>(1) << (GetLevelShift(level) + WHEEL_LEVEL_BITS)) - 1;
+
+		if (delta > max_delta)
+			tick = m_CurrentTick + max_delta;
+
+		slot = (tick >> GetLevelShift(level)) & (WHEEL_LEVEL_SIZE - 1);
+	}
+
+	Slot& list = m_Levels[level][slot];
+
+	Location location;
+	location.Level = level;
+	location.Slot = slot;
+	location.Iterator = list.insert(list.end(), entry);
+
+	m_Index[entry.Object] = location;
+	m_Counts[level]++;
+}
+
+/**
+ * Removes a timer from the wheel.
+ *
+ * @param timer The timer.
+ * @returns true if the timer was part of the wheel, false otherwise.
+ */
+bool TimingWheel::Remove(Timer *timer)
+{
+	boost::unordered_map<Timer *, Location>::iterator it = m_Index.find(timer);
+
+	if (it == m_Index.end())
+		return false;
+
+	const Location& location = it->second;
+
+	m_Levels[location.Level][location.Slot].erase(location.Iterator);
+	m_Counts[location.Level]--;
+
+	m_Index.erase(it);
+
+	return true;
+}
+
+bool TimingWheel::IsEmpty(void) const
+{
+	return m_Index.empty();
+}
+
+size_t TimingWheel::GetLength(void) const
+{
+	return m_Index.size();
+}
+
+/**
+ * Returns the time when the wheel needs to be advanced next, i.e. either the
+ * tick of the earliest timer in the first level or the next point in time
+ * where timers from the upper levels have to be cascaded down.
+ *
+ * @returns The timestamp, or -1 if the wheel is empty.
+ */
+double TimingWheel::GetNextExpiry(void) const
+{
+	if (IsEmpty())
+		return -1;
+
+	bool upper = (m_Counts[0] != m_Index.size());
+
+	for (boost::uint64_t tick = m_CurrentTick; tick < m_CurrentTick + WHEEL_ROOT_SIZE; tick++) {
+		size_t slot = tick & (WHEEL_ROOT_SIZE - 1);
+
+		if (slot == 0 && upper)
+			return tick * m_Resolution;
+
+		if (!m_Levels[0][slot].empty())
+			return tick * m_Resolution;
+	}
+
+	return (m_CurrentTick + WHEEL_ROOT_SIZE) * m_Resolution;
+}
+
+/**
+ * Moves the timers from a slot in an upper level into the lower levels.
+ *
+ * @returns The index of the slot.
+ */
+size_t TimingWheel::Cascade(int level, size_t index)
+{
+	Slot entries;
+	entries.swap(m_Levels[level][index]);
+
+	BOOST_FOREACH(const Entry& entry, entries) {
+		m_Index.erase(entry.Object);
+		m_Counts[level]--;
+
+		InsertEntry(entry);
+	}
+
+	return index;
+}
+
+/**
+ * Processes all ticks up to the specified timestamp and removes the
+ * timers which have expired.
+ *
+ * @param now The current time.
+ * @param expired Receives the expired timers.
+ */
+void TimingWheel::Advance(double now, std::vector<Timer *>& expired)
+{
+	boost::uint64_t target = GetTick(now);
+
+	/* The clock went backwards; otherwise nothing would expire until it has caught up again. */
+	if (target + 1 < m_CurrentTick)
+		Rebase(now);
+
+	while (m_CurrentTick <= target) {
+		if (IsEmpty()) {
+			m_CurrentTick = target + 1;
+			break;
+		}
+
+		size_t index = m_CurrentTick & (WHEEL_ROOT_SIZE - 1);
+
+		/* Skip ahead to the next cascade point if the first level is empty. */
+		if (index != 0 && m_Counts[0] == 0) {
+			m_CurrentTick = std::min((m_CurrentTick | (WHEEL_ROOT_SIZE - 1)) + 1, target + 1);
+			continue;
+		}
+
+		if (index == 0) {
+			for (size_t level = 1; level < WHEEL_LEVELS; level++) {
+				if (Cascade(level, (m_CurrentTick >> GetLevelShift(level)) & (WHEEL_LEVEL_SIZE - 1)) != 0)
+					break;
+			}
+		}
+
+		Slot entries;
+		entries.swap(m_Levels[0][index]);
+
+		BOOST_FOREACH(const Entry& entry, entries) {
+			m_Index.erase(entry.Object);
+			m_Counts[0]--;
+
+			expired.push_back(entry.Object);
+		}
+
+		m_CurrentTick++;
+	}
+}
+
+/**
+ * Moves the wheel's current tick to the specified timestamp and re-sorts
+ * all timers relative to it. This is necessary when the system clock
+ * is set back.
+ *
+ * @param now The current time.
+ */
+void TimingWheel::Rebase(double now)
+{
+	std::vector<Entry> entries;
+
+	for (size_t level = 0; level < WHEEL_LEVELS; level++) {
+		BOOST_FOREACH(Slot& slot, m_Levels[level]) {
+			entries.insert(entries.end(), slot.begin(), slot.end());
+			slot.clear();
+		}
+
+		m_Counts[level] = 0;
+	}
+
+	m_Index.clear();
+
+	m_CurrentTick = GetTick(now);
+
+	BOOST_FOREACH(Entry& entry, entries) {
+		entry.Tick = GetTick(entry.Next);
+		InsertEntry(entry);
+	}
+}
+
+/**
+ * Retrieves all timers which are currently part of the wheel.
+ *
+ * @param timers Receives the timers.
+ */
+void TimingWheel::GetTimers(std::vector<Timer *>& timers) const
+{
+	typedef std::pair<Timer *, Location> kv_pair;
+	BOOST_FOREACH(const kv_pair& kv, m_Index) {
+		timers.push_back(kv.first);
+	}
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include "base/i2-base.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <list>
+#include <vector>
+
+namespace icinga
+{
+
+class Timer;
+
+/**
+ * A hierarchical timing wheel. Inserting and removing timers takes constant
+ * time; expired timers are collected in batches once per tick.
+ *
+ * This class is not thread-safe. Callers must provide their own locking.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API TimingWheel
+{
+public:
+	TimingWheel(double resolution = 0.01);
+
+	void Insert(Timer *timer, double next);
+	bool Remove(Timer *timer);
+
+	bool IsEmpty(void) const;
+	size_t GetLength(void) const;
+
+	double GetNextExpiry(void) const;
+	void Advance(double now, std::vector<Timer *>& expired);
+	void Rebase(double now);
+
+	void GetTimers(std::vector<Timer *>& timers) const;
+
+private:
+	struct Entry
+	{
+		Timer *Object;
+		double Next;
+		boost::uint64_t Tick;
+	};
+
+	typedef std::list<Entry> Slot;
+
+	struct Location
+	{
+		int Level;
+		size_t Slot;
+		Slot::iterator Iterator;
+	};
+
+	double m_Resolution;
+	boost::uint64_t m_CurrentTick; /**< The next tick which has not been processed yet. */
+
+	std::vector<Slot> m_Levels[4];
+	size_t m_Counts[4];
+
+	boost::unordered_map<Timer *, Location> m_Index;
+
+	boost::uint64_t GetTick(double ts) const;
+
+	void InsertEntry(const Entry& entry);
+	size_t Cascade(int level, size_t index);
+};
+
+}
+
+#endif /* TIMINGWHEEL_H */
@@ -65,6 +65,9 @@ TlsStream::TlsStream(const Socket::Ptr& socket, ConnectionRole role, const share
 
 	SSL_set_fd(m_SSL.get(), socket->GetFD());
 
+	/* TryWrite() may have to retry a write with a different buffer */
+	SSL_set_mode(m_SSL.get(), SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
 	if (m_Role == RoleServer)
 		SSL_set_accept_state(m_SSL.get());
 	else
@@ -85,6 +88,11 @@ bool TlsStream::IsVerifyOK(void) const
 	return m_VerifyOK;
 }
 
+Socket::Ptr TlsStream::GetSocket(void) const
+{
+	return m_Socket;
+}
+
 /**
  * Retrieves the X509 certficate for this client.
  *
@@ -156,6 +164,20 @@ void TlsStream::Handshake(void)
  * Processes data for the stream.
  */
 size_t TlsStream::Read(void *buffer, size_t count)
+{
+	return ReadInternal(buffer, count, false);
+}
+
+/**
+ * Reads whatever data is available from the TLS session, but at least one
+ * byte. Blocks until data is available.
+ */
+size_t TlsStream::ReadSome(void *buffer, size_t count)
+{
+	return ReadInternal(buffer, count, true);
+}
+
+size_t TlsStream::ReadInternal(void *buffer, size_t count, bool partial)
 {
 	size_t left = count;
 	std::ostringstream msgbuf;
@@ -212,9 +234,113 @@ size_t TlsStream::Read(void *buffer, size_t count)
 		}
 
 		left -= rc;
+
+		if (partial)
+			break;
 	}
 
-	return count;
+	return count - left;
+}
+
+/**
+ * Reads data from the TLS session without blocking. Callers are expected to
+ * wait for the socket to become readable (e.g. using epoll) before calling
+ * this method again.
+ *
+ * @param wantWrite Set to true if the TLS session has to write data (e.g.
+ *		    during a renegotiation) before the read can continue. In
+ *		    that case callers have to wait until the socket is writable.
+ * @returns The number of bytes read; 0 if no data is available or the
+ *	    stream has been closed (see IsEof()).
+ */
+size_t TlsStream::TryRead(void *buffer, size_t count, bool *wantWrite)
+{
+	std::ostringstream msgbuf;
+	char errbuf[120];
+	int rc, err;
+
+	{
+		boost::mutex::scoped_lock alock(m_IOActionLock);
+		boost::mutex::scoped_lock lock(m_SSLLock);
+
+		if (m_Eof)
+			return 0;
+
+		rc = SSL_read(m_SSL.get(), buffer, count);
+
+		if (rc > 0)
+			return rc;
+
+		err = SSL_get_error(m_SSL.get(), rc);
+	}
+
+	if (wantWrite)
+		*wantWrite = (err == SSL_ERROR_WANT_WRITE);
+
+	switch (err) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			return 0;
+		case SSL_ERROR_ZERO_RETURN:
+			Close();
+			return 0;
+		default:
+			if (ERR_peek_error() != 0) {
+				msgbuf << "SSL_read() failed with code " << ERR_peek_error() << ", \"" << ERR_error_string(ERR_peek_error(), errbuf) << "\"";
+				Log(LogCritical, "TlsStream", msgbuf.str());
+			}
+
+			BOOST_THROW_EXCEPTION(openssl_error()
+			    << boost::errinfo_api_function("SSL_read")
+			    << errinfo_openssl_error(ERR_peek_error()));
+	}
+}
+
+/**
+ * Writes data to the TLS session without blocking. If the write would block
+ * the caller must retry later with the same data (the buffer itself may be
+ * different).
+ *
+ * @returns The number of bytes written; 0 if the write would block.
+ */
+size_t TlsStream::TryWrite(const void *buffer, size_t count)
+{
+	std::ostringstream msgbuf;
+	char errbuf[120];
+	int rc, err;
+
+	{
+		boost::mutex::scoped_lock alock(m_IOActionLock);
+		boost::mutex::scoped_lock lock(m_SSLLock);
+
+		if (m_Eof)
+			return 0;
+
+		rc = SSL_write(m_SSL.get(), buffer, count);
+
+		if (rc > 0)
+			return rc;
+
+		err = SSL_get_error(m_SSL.get(), rc);
+	}
+
+	switch (err) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			return 0;
+		case SSL_ERROR_ZERO_RETURN:
+			Close();
+			return 0;
+		default:
+			if (ERR_peek_error() != 0) {
+				msgbuf << "SSL_write() failed with code " << ERR_peek_error() << ", \"" << ERR_error_string(ERR_peek_error(), errbuf) << "\"";
+				Log(LogCritical, "TlsStream", msgbuf.str());
+			}
+
+			BOOST_THROW_EXCEPTION(openssl_error()
+			    << boost::errinfo_api_function("SSL_write")
+			    << errinfo_openssl_error(ERR_peek_error()));
+	}
 }
 
 void TlsStream::Write(const void *buffer, size_t count)
@@ -48,12 +48,18 @@ public:
 	virtual void Close(void);
 
 	virtual size_t Read(void *buffer, size_t count);
+	virtual size_t ReadSome(void *buffer, size_t count);
 	virtual void Write(const void *buffer, size_t count);
 
+	size_t TryRead(void *buffer, size_t count, bool *wantWrite = NULL);
+	size_t TryWrite(const void *buffer, size_t count);
+
 	virtual bool IsEof(void) const;
 
 	bool IsVerifyOK(void) const;
 
+	Socket::Ptr GetSocket(void) const;
+
 private:
 	shared_ptr<SSL> m_SSL;
 	bool m_Eof;
@@ -67,6 +73,8 @@ private:
 	static int m_SSLIndex;
 	static bool m_SSLIndexInitialized;
 
+	size_t ReadInternal(void *buffer, size_t count, bool partial);
+
 	static int ValidateCertificate(int preverify_ok, X509_STORE_CTX *ctx);
 	static void NullCertificateDeleter(X509 *certificate);
 };
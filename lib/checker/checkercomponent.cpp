@@ -29,11 +29,14 @@
 #include "base/exception.hpp"
 #include "base/convert.hpp"
 #include "base/statsfunction.hpp"
+#include "base/scriptfunction.hpp"
+#include "config/configcompilercontext.hpp"
 #include <boost/foreach.hpp>
 
 using namespace icinga;
 
 REGISTER_TYPE(CheckerComponent);
+REGISTER_SCRIPTFUNCTION(ValidateSchedulerShards, &CheckerComponent::ValidateSchedulerShards);
 
 REGISTER_STATSFUNCTION(CheckerComponentStats, &CheckerComponent::StatsFunc);
 
@@ -49,11 +52,36 @@ Value CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Pt
 		stats->Set("idle", idle);
 		stats->Set("pending", pending);
 
-		nodes->Set(checker->GetName(), stats);
-
 		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Add(make_shared<PerfdataValue>(perfdata_prefix + "idle", Convert::ToDouble(idle)));
 		perfdata->Add(make_shared<PerfdataValue>(perfdata_prefix + "pending", Convert::ToDouble(pending)));
+
+		if (checker->m_Shards.size() > 1) {
+			Array::Ptr shards = make_shared<Array>();
+
+			BOOST_FOREACH(const Shard::Ptr& shard, checker->m_Shards) {
+				unsigned long shard_idle, shard_pending;
+
+				{
+					boost::mutex::scoped_lock lock(shard->Mutex);
+					shard_idle = shard->IdleCheckables.size();
+					shard_pending = shard->PendingCheckables.size();
+				}
+
+				Dictionary::Ptr shard_stats = make_shared<Dictionary>();
+				shard_stats->Set("idle", shard_idle);
+				shard_stats->Set("pending", shard_pending);
+				shards->Add(shard_stats);
+
+				String shard_prefix = perfdata_prefix + "shard" + Convert::ToString(shard->Index) + "_";
+				perfdata->Add(make_shared<PerfdataValue>(shard_prefix + "idle", Convert::ToDouble(shard_idle)));
+				perfdata->Add(make_shared<PerfdataValue>(shard_prefix + "pending", Convert::ToDouble(shard_pending)));
+			}
+
+			stats->Set("shards", shards);
+		}
+
+		nodes->Set(checker->GetName(), stats);
 	}
 
 	status->Set("checkercomponent", nodes);
@@ -63,6 +91,14 @@ Value CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Pt
 
 void CheckerComponent::OnConfigLoaded(void)
 {
+	int shards = GetSchedulerShards();
+
+	if (shards < 1)
+		shards = 1;
+
+	for (int i = 0; i < shards; i++)
+		m_Shards.push_back(make_shared<Shard>(i));
+
 	DynamicObject::OnStarted.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
 	DynamicObject::OnStopped.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
 	DynamicObject::OnPaused.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
@@ -77,7 +113,8 @@ void CheckerComponent::Start(void)
 
 	m_Stopped = false;
 
-	m_Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this));
+	BOOST_FOREACH(const Shard::Ptr& shard, m_Shards)
+		shard->Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this, boost::ref(*shard)));
 
 	m_ResultTimer = make_shared<Timer>();
 	m_ResultTimer->SetInterval(5);
@@ -89,30 +126,48 @@ void CheckerComponent::Stop(void)
 {
 	Log(LogInformation, "CheckerComponent", "Checker stopped.");
 
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+	BOOST_FOREACH(const Shard::Ptr& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
 		m_Stopped = true;
-		m_CV.notify_all();
+		shard->CV.notify_all();
 	}
 
 	m_ResultTimer->Stop();
-	m_Thread.join();
+
+	BOOST_FOREACH(const Shard::Ptr& shard, m_Shards)
+		shard->Thread.join();
 
 	DynamicObject::Stop();
 }
 
-void CheckerComponent::CheckThreadProc(void)
+/**
+ * Returns the shard which is responsible for scheduling the specified checkable.
+ *
+ * @threadsafety Always.
+ */
+CheckerComponent::Shard& CheckerComponent::GetShard(const Checkable::Ptr& checkable) const
+{
+	if (m_Shards.size() == 1)
+		return *m_Shards[0];
+
+	return *m_Shards[Utility::SDBM(checkable->GetName()) % m_Shards.size()];
+}
+
+void CheckerComponent::CheckThreadProc(Shard& shard)
 {
-	Utility::SetThreadName("Check Scheduler");
+	if (m_Shards.size() > 1)
+		Utility::SetThreadName("Check Scheduler #" + Convert::ToString(shard.Index));
+	else
+		Utility::SetThreadName("Check Scheduler");
 
-	boost::mutex::scoped_lock lock(m_Mutex);
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
 	for (;;) {
 		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
+		CheckTimeView& idx = boost::get<1>(shard.IdleCheckables);
 
 		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+			shard.CV.wait(lock);
 
 		if (m_Stopped)
 			break;
@@ -124,12 +179,12 @@ void CheckerComponent::CheckThreadProc(void)
 
 		if (wait > 0) {
 			/* Wait for the next check. */
-			m_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+			shard.CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
 
 			continue;
 		}
 
-		m_IdleCheckables.erase(checkable);
+		shard.IdleCheckables.erase(checkable);
 
 		bool forced = checkable->GetForceNextCheck();
 		bool check = true;
@@ -167,7 +222,7 @@ void CheckerComponent::CheckThreadProc(void)
 
 		/* reschedule the checkable if checks are disabled */
 		if (!check) {
-			m_IdleCheckables.insert(checkable);
+			shard.IdleCheckables.insert(checkable);
 			lock.unlock();
 
 			checkable->UpdateNextCheck();
@@ -177,7 +232,7 @@ void CheckerComponent::CheckThreadProc(void)
 			continue;
 		}
 
-		m_PendingCheckables.insert(checkable);
+		shard.PendingCheckables.insert(checkable);
 
 		lock.unlock();
 
@@ -219,20 +274,22 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 	}
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
 		CheckerComponent::CheckableSet::iterator it;
-		it = m_PendingCheckables.find(checkable);
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		it = shard.PendingCheckables.find(checkable);
+		if (it != shard.PendingCheckables.end()) {
+			shard.PendingCheckables.erase(it);
 
 			if (checkable->IsActive())
-				m_IdleCheckables.insert(checkable);
+				shard.IdleCheckables.insert(checkable);
 
-			m_CV.notify_all();
+			shard.CV.notify_all();
 		}
 	}
 
@@ -244,12 +301,8 @@ void CheckerComponent::ResultTimerHandler(void)
 {
 	std::ostringstream msgbuf;
 
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
-
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: "
-		    << (CIB::GetActiveHostChecksStatistics(5) + CIB::GetActiveServiceChecksStatistics(5)) / 5.0;
-	}
+	msgbuf << "Pending checkables: " << GetPendingCheckables() << "; Idle checkables: " << GetIdleCheckables() << "; Checks/s: "
+	    << (CIB::GetActiveHostChecksStatistics(5) + CIB::GetActiveServiceChecksStatistics(5)) / 5.0;
 
 	Log(LogNotice, "CheckerComponent", msgbuf.str());
 }
@@ -265,29 +318,33 @@ void CheckerComponent::ObjectHandler(const DynamicObject::Ptr& object)
 	bool same_zone = (!zone || Zone::GetLocalZone() == zone);
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		if (object->IsActive() && !object->IsPaused() && same_zone) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(checkable);
+			shard.IdleCheckables.insert(checkable);
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.IdleCheckables.erase(checkable);
+			shard.PendingCheckables.erase(checkable);
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
 	}
 }
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	Shard& shard = GetShard(checkable);
+
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
 	/* remove and re-insert the object from the set in order to force an index update */
 	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	CheckableView& idx = boost::get<0>(shard.IdleCheckables);
 
 	CheckableView::iterator it = idx.find(checkable);
 	if (it == idx.end())
@@ -295,19 +352,39 @@ void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 
 	idx.erase(checkable);
 	idx.insert(checkable);
-	m_CV.notify_all();
+	shard.CV.notify_all();
 }
 
 unsigned long CheckerComponent::GetIdleCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
 
-	return m_IdleCheckables.size();
+	BOOST_FOREACH(const Shard::Ptr& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->IdleCheckables.size();
+	}
+
+	return count;
 }
 
 unsigned long CheckerComponent::GetPendingCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
 
-	return m_PendingCheckables.size();
+	BOOST_FOREACH(const Shard::Ptr& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->PendingCheckables.size();
+	}
+
+	return count;
+}
+
+void CheckerComponent::ValidateSchedulerShards(const String& location, const Dictionary::Ptr& attrs)
+{
+	Value shards = attrs->Get("scheduler_shards");
+
+	if (!shards.IsEmpty() && shards < 1) {
+		ConfigCompilerContext::GetInstance()->AddMessage(true, "Validation failed for " +
+		    location + ": Attribute 'scheduler_shards' must be at least 1.");
+	}
 }
@@ -31,6 +31,7 @@
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
+#include <vector>
 
 namespace icinga
 {
@@ -76,18 +77,40 @@ public:
 	unsigned long GetIdleCheckables(void);
 	unsigned long GetPendingCheckables(void);
 
+	static void ValidateSchedulerShards(const String& location, const Dictionary::Ptr& attrs);
+
 private:
-	boost::mutex m_Mutex;
-	boost::condition_variable m_CV;
+	/**
+	 * A partition of the scheduled checkables. Each shard has its own
+	 * scheduler thread so that the shards don't contend on a single lock.
+	 */
+	struct Shard
+	{
+		DECLARE_PTR_TYPEDEFS(Shard);
+
+		size_t Index;
+
+		boost::mutex Mutex;
+		boost::condition_variable CV;
+		boost::thread Thread;
+
+		CheckableSet IdleCheckables;
+		CheckableSet PendingCheckables;
+
+		Shard(size_t index)
+			: Index(index)
+		{ }
+	};
+
 	bool m_Stopped;
-	boost::thread m_Thread;
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+	std::vector<Shard::Ptr> m_Shards;
 
 	Timer::Ptr m_ResultTimer;
 
-	void CheckThreadProc(void);
+	Shard& GetShard(const Checkable::Ptr& checkable) const;
+
+	void CheckThreadProc(Shard& shard);
 	void ResultTimerHandler(void);
 
 	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
@@ -29,6 +29,7 @@
 #include "base/exception.hpp"
 #include "base/convert.hpp"
 #include "base/scriptvariable.hpp"
+#include "base/processhelper.hpp"
 #include "base/context.hpp"
 #include "config.h"
 #include <boost/program_options.hpp>
@@ -361,6 +362,12 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 		}
 	}
 
+	/* the helper processes are new instances of the icinga2 binary and don't inherit the config */
+	Value helpers = ScriptVariable::Get("ProcessHelpers", &Empty);
+
+	if (!helpers.IsEmpty() && helpers > 0)
+		ProcessHelper::StartHelpers(helpers);
+
 	// activate config only after daemonization: it starts threads and that is not compatible with fork()
 	if (!ConfigItem::ActivateItems()) {
 		Log(LogCritical, "cli", "Error activating configuration.");
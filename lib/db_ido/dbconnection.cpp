@@ -57,7 +57,7 @@ void DbConnection::Start(void)
 {
 	DynamicObject::Start();
 
-	DbObject::OnQuery.connect(boost::bind(&DbConnection::ExecuteQuery, this, _1));
+	DbObject::OnQuery.connect(boost::bind(&DbConnection::QueryHandler, this, _1));
 }
 
 void DbConnection::Resume(void)
@@ -71,6 +71,11 @@ void DbConnection::Resume(void)
 	m_CleanUpTimer->SetInterval(60);
 	m_CleanUpTimer->OnTimerExpired.connect(boost::bind(&DbConnection::CleanUpHandler, this));
 	m_CleanUpTimer->Start();
+
+	m_StatusUpdateTimer = make_shared<Timer>();
+	m_StatusUpdateTimer->SetInterval(1);
+	m_StatusUpdateTimer->OnTimerExpired.connect(boost::bind(&DbConnection::FlushStatusUpdates, this));
+	m_StatusUpdateTimer->Start();
 }
 
 void DbConnection::Pause(void)
@@ -81,6 +86,10 @@ void DbConnection::Pause(void)
 	     << "Pausing IDO connection: " << GetName();
 
 	m_CleanUpTimer.reset();
+	m_StatusUpdateTimer.reset();
+
+	/* Hand the buffered status updates to the connection before it disconnects. */
+	FlushStatusUpdates();
 }
 
 void DbConnection::StaticInitialize(void)
@@ -231,6 +240,8 @@ void DbConnection::CleanUpExecuteQuery(const String&, const String&, double)
 
 void DbConnection::SetObjectID(const DbObject::Ptr& dbobj, const DbReference& dbref)
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	if (dbref.IsValid())
 		m_ObjectIDs[dbobj] = dbref;
 	else
@@ -239,6 +250,8 @@ void DbConnection::SetObjectID(const DbObject::Ptr& dbobj, const DbReference& db
 
 DbReference DbConnection::GetObjectID(const DbObject::Ptr& dbobj) const
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	std::map<DbObject::Ptr, DbReference>::const_iterator it;
 
 	it = m_ObjectIDs.find(dbobj);
@@ -259,6 +272,8 @@ void DbConnection::SetInsertID(const DbType::Ptr& type, const DbReference& objid
 	if (!objid.IsValid())
 		return;
 
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	if (dbref.IsValid())
 		m_InsertIDs[std::make_pair(type, objid)] = dbref;
 	else
@@ -275,6 +290,8 @@ DbReference DbConnection::GetInsertID(const DbType::Ptr& type, const DbReference
 	if (!objid.IsValid())
 		return DbReference();
 
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	std::map<std::pair<DbType::Ptr, DbReference>, DbReference>::const_iterator it;
 
 	it = m_InsertIDs.find(std::make_pair(type, objid));
@@ -285,8 +302,50 @@ DbReference DbConnection::GetInsertID(const DbType::Ptr& type, const DbReference
 	return it->second;
 }
 
+void DbConnection::SetConfigHash(const DbObject::Ptr& dbobj, const String& hash)
+{
+	SetConfigHash(dbobj->GetType(), GetObjectID(dbobj), hash);
+}
+
+void DbConnection::SetConfigHash(const DbType::Ptr& type, const DbReference& objid, const String& hash)
+{
+	if (!objid.IsValid())
+		return;
+
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
+	if (!hash.IsEmpty())
+		m_ConfigHashes[std::make_pair(type, objid)] = hash;
+	else
+		m_ConfigHashes.erase(std::make_pair(type, objid));
+}
+
+String DbConnection::GetConfigHash(const DbObject::Ptr& dbobj) const
+{
+	return GetConfigHash(dbobj->GetType(), GetObjectID(dbobj));
+}
+
+String DbConnection::GetConfigHash(const DbType::Ptr& type, const DbReference& objid) const
+{
+	if (!objid.IsValid())
+		return String();
+
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
+	std::map<std::pair<DbType::Ptr, DbReference>, String>::const_iterator it;
+
+	it = m_ConfigHashes.find(std::make_pair(type, objid));
+
+	if (it == m_ConfigHashes.end())
+		return String();
+
+	return it->second;
+}
+
 void DbConnection::SetNotificationInsertID(const CustomVarObject::Ptr& obj, const DbReference& dbref)
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	if (dbref.IsValid())
 		m_NotificationInsertIDs[obj] = dbref;
 	else
@@ -295,6 +354,8 @@ void DbConnection::SetNotificationInsertID(const CustomVarObject::Ptr& obj, cons
 
 DbReference DbConnection::GetNotificationInsertID(const CustomVarObject::Ptr& obj) const
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	std::map<CustomVarObject::Ptr, DbReference>::const_iterator it;
 
 	it = m_NotificationInsertIDs.find(obj);
@@ -307,6 +368,8 @@ DbReference DbConnection::GetNotificationInsertID(const CustomVarObject::Ptr& ob
 
 void DbConnection::SetObjectActive(const DbObject::Ptr& dbobj, bool active)
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	if (active)
 		m_ActiveObjects.insert(dbobj);
 	else
@@ -315,13 +378,18 @@ void DbConnection::SetObjectActive(const DbObject::Ptr& dbobj, bool active)
 
 bool DbConnection::GetObjectActive(const DbObject::Ptr& dbobj) const
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	return (m_ActiveObjects.find(dbobj) != m_ActiveObjects.end());
 }
 
 void DbConnection::ClearIDCache(void)
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	m_ObjectIDs.clear();
 	m_InsertIDs.clear();
+	m_ConfigHashes.clear();
 	m_NotificationInsertIDs.clear();
 	m_ActiveObjects.clear();
 	m_ConfigUpdates.clear();
@@ -330,6 +398,8 @@ void DbConnection::ClearIDCache(void)
 
 void DbConnection::SetConfigUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	if (hasupdate)
 		m_ConfigUpdates.insert(dbobj);
 	else
@@ -338,11 +408,15 @@ void DbConnection::SetConfigUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 
 bool DbConnection::GetConfigUpdate(const DbObject::Ptr& dbobj) const
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	return (m_ConfigUpdates.find(dbobj) != m_ConfigUpdates.end());
 }
 
 void DbConnection::SetStatusUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	if (hasupdate)
 		m_StatusUpdates.insert(dbobj);
 	else
@@ -351,6 +425,8 @@ void DbConnection::SetStatusUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 
 bool DbConnection::GetStatusUpdate(const DbObject::Ptr& dbobj) const
 {
+	boost::mutex::scoped_lock lock(m_IDMutex);
+
 	return (m_StatusUpdates.find(dbobj) != m_StatusUpdates.end());
 }
 
@@ -359,6 +435,56 @@ void DbConnection::ExecuteQuery(const DbQuery&)
 	/* Default handler does nothing. */
 }
 
+size_t DbConnection::GetPendingQueryCount(void)
+{
+	return 0;
+}
+
+/**
+ * Status upserts (hoststatus, servicestatus, customvariablestatus, ...) only
+ * ever need their latest row. They are buffered per object and table so that
+ * a newer update replaces an older one which has not been sent yet; the buffer
+ * is flushed once per second or as soon as the connection's query queue is empty.
+ */
+void DbConnection::QueryHandler(const DbQuery& query)
+{
+	if (query.Category != DbCatState || query.Type != (DbQueryInsert | DbQueryUpdate) ||
+	    !query.Object || !query.WhereCriteria) {
+		ExecuteQuery(query);
+		return;
+	}
+
+	String varname = query.WhereCriteria->Get("varname");
+	StatusUpdateKey key = std::make_pair(query.Object, query.Table + "/" + varname);
+
+	{
+		boost::mutex::scoped_lock lock(m_StatusUpdateMutex);
+		m_PendingStatusUpdates[key] = query;
+	}
+
+	if (GetPendingQueryCount() == 0)
+		FlushStatusUpdates();
+}
+
+void DbConnection::FlushStatusUpdates(void)
+{
+	/* Hold the flush lock until all queries have been enqueued. Otherwise a
+	 * concurrent flush could enqueue a newer row before this older one. */
+	boost::mutex::scoped_lock flushLock(m_StatusFlushMutex);
+
+	std::map<StatusUpdateKey, DbQuery> queries;
+
+	{
+		boost::mutex::scoped_lock lock(m_StatusUpdateMutex);
+		queries.swap(m_PendingStatusUpdates);
+	}
+
+	typedef std::pair<StatusUpdateKey, DbQuery> kv_pair;
+	BOOST_FOREACH(const kv_pair& kv, queries) {
+		ExecuteQuery(kv.second);
+	}
+}
+
 void DbConnection::UpdateAllObjects(void)
 {
 	DynamicType::Ptr type;
@@ -370,50 +496,122 @@ void DbConnection::UpdateAllObjects(void)
 				if (!GetObjectActive(dbobj))
 					ActivateObject(dbobj);
 
-				dbobj->SendConfigUpdate();
+				Dictionary::Ptr configFields = dbobj->GetConfigFields();
+				String configHash = dbobj->CalculateConfigHash(configFields);
+
+				/* only rewrite the config for objects which changed since the last config dump */
+				if (configHash != GetConfigHash(dbobj)) {
+					dbobj->SendConfigUpdate(configFields, configHash);
+					SetConfigHash(dbobj, configHash);
+				} else
+					dbobj->SendConfigUpdateLight();
+
 				dbobj->SendStatusUpdate();
 			}
 		}
 	}
 }
 
+/**
+ * Builds the statements which remove the custom variable and relation rows
+ * of an object which was deleted from the configuration. Config dumps only
+ * replace these rows for objects which still exist. The object's config hash
+ * is reset as well so that its config is written again if it is re-added.
+ *
+ * @param dbobj The deleted object.
+ * @returns The SQL statements.
+ */
+std::vector<String> DbConnection::GetDeletedObjectQueries(const DbObject::Ptr& dbobj) const
+{
+	std::vector<String> queries;
+
+	DbReference objid = GetObjectID(dbobj);
+
+	if (!objid.IsValid())
+		return queries;
+
+	DbType::Ptr type = dbobj->GetType();
+	String table = type->GetTable();
+	String prefix = GetTablePrefix();
+	String sobjid = Convert::ToString(static_cast<long>(objid));
+
+	queries.push_back("DELETE FROM " + prefix + "customvariables WHERE object_id = " + sobjid);
+	queries.push_back("UPDATE " + prefix + table + "s SET config_hash = NULL WHERE " + type->GetIDColumn() + " = " + sobjid);
+
+	if (table == "host")
+		queries.push_back("DELETE FROM " + prefix + "hostdependencies WHERE dependent_host_object_id = " + sobjid);
+	else if (table == "service")
+		queries.push_back("DELETE FROM " + prefix + "servicedependencies WHERE dependent_service_object_id = " + sobjid);
+
+	/* relation tables which reference the object's row in its config table */
+	std::vector<String> relations;
+
+	if (table == "host") {
+		relations.push_back("_parenthosts");
+		relations.push_back("_contacts");
+		relations.push_back("_contactgroups");
+	} else if (table == "service") {
+		relations.push_back("_contacts");
+		relations.push_back("_contactgroups");
+	} else if (table == "hostgroup" || table == "servicegroup" || table == "contactgroup")
+		relations.push_back("_members");
+	else if (table == "timeperiod")
+		relations.push_back("_timeranges");
+	else if (table == "contact")
+		relations.push_back("_addresses");
+
+	DbReference insertid = GetInsertID(dbobj);
+
+	if (insertid.IsValid()) {
+		BOOST_FOREACH(const String& relation, relations) {
+			queries.push_back("DELETE FROM " + prefix + table + relation + " WHERE " +
+			    table + "_id = " + Convert::ToString(static_cast<long>(insertid)));
+		}
+	}
+
+	return queries;
+}
+
 void DbConnection::PrepareDatabase(void)
 {
 	/*
 	 * only clear tables on reconnect which
 	 * cannot be updated by their existing ids
 	 * for details check https://dev.icinga.org/issues/5565
+	 *
+	 * tables which are written in OnConfigUpdate() are
+	 * cleaned up per object when its config hash changes
 	 */
 
 	//ClearConfigTable("commands");
 	ClearConfigTable("comments");
-	ClearConfigTable("contact_addresses");
+	//ClearConfigTable("contact_addresses");
 	ClearConfigTable("contact_notificationcommands");
-	ClearConfigTable("contactgroup_members");
+	//ClearConfigTable("contactgroup_members");
 	//ClearConfigTable("contactgroups");
 	//ClearConfigTable("contacts");
 	//ClearConfigTable("contactstatus");
-	ClearConfigTable("customvariables");
+	//ClearConfigTable("customvariables");
 	ClearConfigTable("customvariablestatus");
 	ClearConfigTable("endpoints");
 	ClearConfigTable("endpointstatus");
-	ClearConfigTable("host_contactgroups");
-	ClearConfigTable("host_contacts");
-	ClearConfigTable("host_parenthosts");
-	ClearConfigTable("hostdependencies");
-	ClearConfigTable("hostgroup_members");
+	//ClearConfigTable("host_contactgroups");
+	//ClearConfigTable("host_contacts");
+	//ClearConfigTable("host_parenthosts");
+	//ClearConfigTable("hostdependencies");
+	//ClearConfigTable("hostgroup_members");
 	//ClearConfigTable("hostgroups");
 	//ClearConfigTable("hosts");
 	//ClearConfigTable("hoststatus");
 	ClearConfigTable("scheduleddowntime");
-	ClearConfigTable("service_contactgroups");
-	ClearConfigTable("service_contacts");
-	ClearConfigTable("servicedependencies");
-	ClearConfigTable("servicegroup_members");
+	//ClearConfigTable("service_contactgroups");
+	//ClearConfigTable("service_contacts");
+	//ClearConfigTable("servicedependencies");
+	//ClearConfigTable("servicegroup_members");
 	//ClearConfigTable("servicegroups");
 	//ClearConfigTable("services");
 	//ClearConfigTable("servicestatus");
-	ClearConfigTable("timeperiod_timeranges");
+	//ClearConfigTable("timeperiod_timeranges");
 	//ClearConfigTable("timeperiods");
 
 	BOOST_FOREACH(const DbType::Ptr& type, DbType::GetAllTypes()) {
@@ -25,6 +25,7 @@
 #include "db_ido/dbobject.hpp"
 #include "db_ido/dbquery.hpp"
 #include "base/timer.hpp"
+#include <boost/thread/mutex.hpp>
 
 namespace icinga
 {
@@ -49,6 +50,11 @@ public:
 	DbReference GetInsertID(const DbObject::Ptr& dbobj) const;
 	DbReference GetInsertID(const DbType::Ptr& type, const DbReference& objid) const;
 
+	void SetConfigHash(const DbObject::Ptr& dbobj, const String& hash);
+	void SetConfigHash(const DbType::Ptr& type, const DbReference& objid, const String& hash);
+	String GetConfigHash(const DbObject::Ptr& dbobj) const;
+	String GetConfigHash(const DbType::Ptr& type, const DbReference& objid) const;
+
 	void SetNotificationInsertID(const CustomVarObject::Ptr& obj, const DbReference& dbref);
 	DbReference GetNotificationInsertID(const CustomVarObject::Ptr& obj) const;
 
@@ -72,6 +78,7 @@ protected:
 	virtual void Pause(void);
 
 	virtual void ExecuteQuery(const DbQuery& query) = 0;
+	virtual size_t GetPendingQueryCount(void);
 	virtual void ActivateObject(const DbObject::Ptr& dbobj) = 0;
 	virtual void DeactivateObject(const DbObject::Ptr& dbobj) = 0;
 
@@ -82,17 +89,31 @@ protected:
 
 	void PrepareDatabase(void);
 
+	std::vector<String> GetDeletedObjectQueries(const DbObject::Ptr& dbobj) const;
+
 private:
+	mutable boost::mutex m_IDMutex;
 	std::map<DbObject::Ptr, DbReference> m_ObjectIDs;
 	std::map<std::pair<DbType::Ptr, DbReference>, DbReference> m_InsertIDs;
+	std::map<std::pair<DbType::Ptr, DbReference>, String> m_ConfigHashes;
 	std::map<CustomVarObject::Ptr, DbReference> m_NotificationInsertIDs;
 	std::set<DbObject::Ptr> m_ActiveObjects;
 	std::set<DbObject::Ptr> m_ConfigUpdates;
 	std::set<DbObject::Ptr> m_StatusUpdates;
 	Timer::Ptr m_CleanUpTimer;
 
+	typedef std::pair<DbObject::Ptr, String> StatusUpdateKey;
+
+	boost::mutex m_StatusUpdateMutex;
+	boost::mutex m_StatusFlushMutex;
+	std::map<StatusUpdateKey, DbQuery> m_PendingStatusUpdates;
+	Timer::Ptr m_StatusUpdateTimer;
+
 	void CleanUpHandler(void);
 
+	void QueryHandler(const DbQuery& query);
+	void FlushStatusUpdates(void);
+
 	virtual void ClearConfigTable(const String& table) = 0;
 
 	static Timer::Ptr m_ProgramStatusTimer;
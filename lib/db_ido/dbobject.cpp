@@ -31,6 +31,9 @@
 #include "base/utility.hpp"
 #include "base/initialize.hpp"
 #include "base/logger.hpp"
+#include "base/json.hpp"
+#include "base/serializer.hpp"
+#include "base/tlsutility.hpp"
 #include <boost/foreach.hpp>
 
 using namespace icinga;
@@ -75,13 +78,102 @@ DbType::Ptr DbObject::GetType(void) const
 	return m_Type;
 }
 
+/**
+ * Calculates a hash over everything the config dump writes for this object.
+ * Subclasses which write additional rows (e.g. group members) have to
+ * include the data for those rows as well.
+ */
+String DbObject::CalculateConfigHash(const Dictionary::Ptr& configFields) const
+{
+	Array::Ptr data = make_shared<Array>();
+	data->Add(configFields);
+
+	CustomVarObject::Ptr custom_var_object = dynamic_pointer_cast<CustomVarObject>(GetObject());
+
+	if (custom_var_object)
+		data->Add(CompatUtility::GetCustomAttributeConfig(custom_var_object));
+
+	return HashValue(data);
+}
+
+static Value NormalizeHashValue(const Value& value)
+{
+	if (value.IsObjectType<DbValue>())
+		return NormalizeHashValue(DbValue::ExtractValue(value));
+
+	if (value.IsObjectType<DynamicObject>()) {
+		DynamicObject::Ptr object = value;
+		return object->GetName();
+	}
+
+	if (value.IsObjectType<Dictionary>()) {
+		Dictionary::Ptr dict = value;
+		Dictionary::Ptr result = make_shared<Dictionary>();
+
+		ObjectLock olock(dict);
+		BOOST_FOREACH(const Dictionary::Pair& kv, dict) {
+			result->Set(kv.first, NormalizeHashValue(kv.second));
+		}
+
+		return result;
+	}
+
+	if (value.IsObjectType<Array>()) {
+		Array::Ptr arr = value;
+		Array::Ptr result = make_shared<Array>();
+
+		ObjectLock olock(arr);
+		BOOST_FOREACH(const Value& item, arr) {
+			result->Add(NormalizeHashValue(item));
+		}
+
+		return result;
+	}
+
+	return value;
+}
+
+/**
+ * Hashes an arbitrary value. Objects which are nested in other values
+ * are represented by their name, top-level objects by their config attributes.
+ */
+String DbObject::HashValue(const Value& value)
+{
+	Value temp;
+
+	if (value.IsObjectType<DynamicObject>())
+		temp = Serialize(value, FAConfig);
+	else
+		temp = value;
+
+	return SHA256(JsonEncode(NormalizeHashValue(temp)));
+}
+
+String DbObject::HashValue(const std::set<String>& values)
+{
+	Array::Ptr arr = make_shared<Array>();
+
+	BOOST_FOREACH(const String& value, values) {
+		arr->Add(value);
+	}
+
+	return HashValue(arr);
+}
+
 void DbObject::SendConfigUpdate(void)
+{
+	Dictionary::Ptr fields = GetConfigFields();
+
+	SendConfigUpdate(fields, CalculateConfigHash(fields));
+}
+
+void DbObject::SendConfigUpdate(const Dictionary::Ptr& configFields, const String& configHash)
 {
 	/* update custom var config for all objects */
 	SendVarsConfigUpdate();
 
 	/* config objects */
-	Dictionary::Ptr fields = GetConfigFields();
+	Dictionary::Ptr fields = configFields;
 
 	if (!fields)
 		return;
@@ -94,6 +186,7 @@ void DbObject::SendConfigUpdate(void)
 	query.Fields->Set(GetType()->GetIDColumn(), GetObject());
 	query.Fields->Set("instance_id", 0); /* DbConnection class fills in real ID */
 	query.Fields->Set("config_type", 1);
+	query.Fields->Set("config_hash", configHash);
 	query.WhereCriteria = make_shared<Dictionary>();
 	query.WhereCriteria->Set(GetType()->GetIDColumn(), GetObject());
 	query.Object = GetSelf();
@@ -103,6 +196,19 @@ void DbObject::SendConfigUpdate(void)
 	m_LastConfigUpdate = Utility::GetTime();
 
 	OnConfigUpdate();
+	OnConfigUpdateLight();
+}
+
+/**
+ * Used instead of SendConfigUpdate() for objects whose config did not change
+ * since the last config dump. Only refreshes the data which is not covered
+ * by the config hash (e.g. comments and downtimes).
+ */
+void DbObject::SendConfigUpdateLight(void)
+{
+	m_LastConfigUpdate = Utility::GetTime();
+
+	OnConfigUpdateLight();
 }
 
 void DbObject::SendStatusUpdate(void)
@@ -160,6 +266,15 @@ void DbObject::SendVarsConfigUpdate(void)
 
 	Dictionary::Ptr vars = CompatUtility::GetCustomAttributeConfig(custom_var_object);
 
+	/* remove the vars from the previous config dump */
+	DbQuery query_del1;
+	query_del1.Table = "customvariables";
+	query_del1.Type = DbQueryDelete;
+	query_del1.Category = DbCatConfig;
+	query_del1.WhereCriteria = make_shared<Dictionary>();
+	query_del1.WhereCriteria->Set("object_id", obj);
+	OnQuery(query_del1);
+
 	if (vars) {
 		Log(LogDebug, "DbObject")
 		    << "Updating object vars for '" << custom_var_object->GetName() << "'";
@@ -264,6 +379,11 @@ void DbObject::OnConfigUpdate(void)
 	/* Default handler does nothing. */
 }
 
+void DbObject::OnConfigUpdateLight(void)
+{
+	/* Default handler does nothing. */
+}
+
 void DbObject::OnStatusUpdate(void)
 {
 	/* Default handler does nothing. */
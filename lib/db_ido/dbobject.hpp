@@ -79,7 +79,11 @@ public:
 
 	static boost::signals2::signal<void (const DbQuery&)> OnQuery;
 
+	virtual String CalculateConfigHash(const Dictionary::Ptr& configFields) const;
+
 	void SendConfigUpdate(void);
+	void SendConfigUpdate(const Dictionary::Ptr& configFields, const String& configHash);
+	void SendConfigUpdateLight(void);
 	void SendStatusUpdate(void);
 	void SendVarsConfigUpdate(void);
 	void SendVarsStatusUpdate(void);
@@ -93,8 +97,12 @@ protected:
 	virtual bool IsStatusAttribute(const String& attribute) const;
 
 	virtual void OnConfigUpdate(void);
+	virtual void OnConfigUpdateLight(void);
 	virtual void OnStatusUpdate(void);
 
+	static String HashValue(const Value& value);
+	static String HashValue(const std::set<String>& values);
+
 private:
 	String m_Name1;
 	String m_Name2;
@@ -31,6 +31,7 @@
 #include "base/convert.hpp"
 #include "base/objectlock.hpp"
 #include "base/logger.hpp"
+#include "base/tlsutility.hpp"
 #include <boost/foreach.hpp>
 
 using namespace icinga;
@@ -177,6 +178,39 @@ void HostDbObject::OnConfigUpdate(void)
 {
 	Host::Ptr host = static_pointer_cast<Host>(GetObject());
 
+	/* remove the rows from the previous config dump */
+	DbQuery query_del1;
+	query_del1.Table = GetType()->GetTable() + "_parenthosts";
+	query_del1.Type = DbQueryDelete;
+	query_del1.Category = DbCatConfig;
+	query_del1.WhereCriteria = make_shared<Dictionary>();
+	query_del1.WhereCriteria->Set(GetType()->GetTable() + "_id", DbValue::FromObjectInsertID(host));
+	OnQuery(query_del1);
+
+	DbQuery query_del2;
+	query_del2.Table = GetType()->GetTable() + "dependencies";
+	query_del2.Type = DbQueryDelete;
+	query_del2.Category = DbCatConfig;
+	query_del2.WhereCriteria = make_shared<Dictionary>();
+	query_del2.WhereCriteria->Set("dependent_host_object_id", host);
+	OnQuery(query_del2);
+
+	DbQuery query_del3;
+	query_del3.Table = GetType()->GetTable() + "_contacts";
+	query_del3.Type = DbQueryDelete;
+	query_del3.Category = DbCatConfig;
+	query_del3.WhereCriteria = make_shared<Dictionary>();
+	query_del3.WhereCriteria->Set("host_id", DbValue::FromObjectInsertID(host));
+	OnQuery(query_del3);
+
+	DbQuery query_del4;
+	query_del4.Table = GetType()->GetTable() + "_contactgroups";
+	query_del4.Type = DbQueryDelete;
+	query_del4.Category = DbCatConfig;
+	query_del4.WhereCriteria = make_shared<Dictionary>();
+	query_del4.WhereCriteria->Set("host_id", DbValue::FromObjectInsertID(host));
+	OnQuery(query_del4);
+
 	/* parents */
 	BOOST_FOREACH(const Checkable::Ptr& checkable, host->GetParents()) {
 		Host::Ptr parent = dynamic_pointer_cast<Host>(checkable);
@@ -275,12 +309,69 @@ void HostDbObject::OnConfigUpdate(void)
 		query_contact.Fields = fields_contact;
 		OnQuery(query_contact);
 	}
+}
+
+void HostDbObject::OnConfigUpdateLight(void)
+{
+	Host::Ptr host = static_pointer_cast<Host>(GetObject());
 
 	/* update comments and downtimes on config change */
 	DbEvents::AddComments(host);
 	DbEvents::AddDowntimes(host);
 }
 
+String HostDbObject::CalculateConfigHash(const Dictionary::Ptr& configFields) const
+{
+	String hashData = DbObject::CalculateConfigHash(configFields);
+
+	Host::Ptr host = static_pointer_cast<Host>(GetObject());
+
+	Array::Ptr groups = host->GetGroups();
+
+	if (groups)
+		hashData += DbObject::HashValue(groups);
+
+	std::set<String> parents;
+
+	BOOST_FOREACH(const Checkable::Ptr& checkable, host->GetParents()) {
+		Host::Ptr parent = dynamic_pointer_cast<Host>(checkable);
+
+		if (parent)
+			parents.insert(parent->GetName());
+	}
+
+	hashData += DbObject::HashValue(parents);
+
+	std::set<String> dependencies;
+
+	BOOST_FOREACH(const Dependency::Ptr& dep, host->GetDependencies()) {
+		Checkable::Ptr parent = dep->GetParent();
+
+		if (parent)
+			dependencies.insert(parent->GetName() + "|" + Convert::ToString(dep->GetStateFilter()) + "|" + dep->GetPeriodRaw());
+	}
+
+	hashData += DbObject::HashValue(dependencies);
+
+	std::set<String> users;
+
+	BOOST_FOREACH(const User::Ptr& user, CompatUtility::GetCheckableNotificationUsers(host)) {
+		users.insert(user->GetName());
+	}
+
+	hashData += DbObject::HashValue(users);
+
+	std::set<String> usergroups;
+
+	BOOST_FOREACH(const UserGroup::Ptr& usergroup, CompatUtility::GetCheckableNotificationUserGroups(host)) {
+		usergroups.insert(usergroup->GetName());
+	}
+
+	hashData += DbObject::HashValue(usergroups);
+
+	return SHA256(hashData);
+}
+
 void HostDbObject::OnStatusUpdate(void)
 {
 }
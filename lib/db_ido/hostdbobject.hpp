@@ -41,8 +41,11 @@ public:
 	virtual Dictionary::Ptr GetConfigFields(void) const;
 	virtual Dictionary::Ptr GetStatusFields(void) const;
 
+	virtual String CalculateConfigHash(const Dictionary::Ptr& configFields) const;
+
 private:
 	virtual void OnConfigUpdate(void);
+	virtual void OnConfigUpdateLight(void);
 	virtual void OnStatusUpdate(void);
 };
 
@@ -23,6 +23,7 @@
 #include "base/objectlock.hpp"
 #include "base/initialize.hpp"
 #include "base/dynamictype.hpp"
+#include "base/tlsutility.hpp"
 #include <boost/foreach.hpp>
 
 using namespace icinga;
@@ -55,6 +56,14 @@ void HostGroupDbObject::OnConfigUpdate(void)
 {
 	HostGroup::Ptr group = static_pointer_cast<HostGroup>(GetObject());
 
+	DbQuery query_del1;
+	query_del1.Table = DbType::GetByName("HostGroup")->GetTable() + "_members";
+	query_del1.Type = DbQueryDelete;
+	query_del1.Category = DbCatConfig;
+	query_del1.WhereCriteria = make_shared<Dictionary>();
+	query_del1.WhereCriteria->Set("hostgroup_id", DbValue::FromObjectInsertID(group));
+	OnQuery(query_del1);
+
 	BOOST_FOREACH(const Host::Ptr& host, group->GetMembers()) {
 		DbQuery query1;
 		query1.Table = DbType::GetByName("HostGroup")->GetTable() + "_members";
@@ -67,3 +76,20 @@ void HostGroupDbObject::OnConfigUpdate(void)
 		OnQuery(query1);
 	}
 }
+
+String HostGroupDbObject::CalculateConfigHash(const Dictionary::Ptr& configFields) const
+{
+	String hashData = DbObject::CalculateConfigHash(configFields);
+
+	HostGroup::Ptr group = static_pointer_cast<HostGroup>(GetObject());
+
+	std::set<String> members;
+
+	BOOST_FOREACH(const Host::Ptr& member, group->GetMembers()) {
+		members.insert(member->GetName());
+	}
+
+	hashData += DbObject::HashValue(members);
+
+	return SHA256(hashData);
+}
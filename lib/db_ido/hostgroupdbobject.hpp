@@ -42,6 +42,8 @@ public:
 	virtual Dictionary::Ptr GetConfigFields(void) const;
 	virtual Dictionary::Ptr GetStatusFields(void) const;
 
+	virtual String CalculateConfigHash(const Dictionary::Ptr& configFields) const;
+
 protected:
 	virtual void OnConfigUpdate(void);
 
@@ -35,6 +35,7 @@
 #include "base/dynamictype.hpp"
 #include "base/utility.hpp"
 #include "base/logger.hpp"
+#include "base/tlsutility.hpp"
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/join.hpp>
 
@@ -176,6 +177,31 @@ void ServiceDbObject::OnConfigUpdate(void)
 {
 	Service::Ptr service = static_pointer_cast<Service>(GetObject());
 
+	/* remove the rows from the previous config dump */
+	DbQuery query_del1;
+	query_del1.Table = GetType()->GetTable() + "dependencies";
+	query_del1.Type = DbQueryDelete;
+	query_del1.Category = DbCatConfig;
+	query_del1.WhereCriteria = make_shared<Dictionary>();
+	query_del1.WhereCriteria->Set("dependent_service_object_id", service);
+	OnQuery(query_del1);
+
+	DbQuery query_del2;
+	query_del2.Table = GetType()->GetTable() + "_contacts";
+	query_del2.Type = DbQueryDelete;
+	query_del2.Category = DbCatConfig;
+	query_del2.WhereCriteria = make_shared<Dictionary>();
+	query_del2.WhereCriteria->Set("service_id", DbValue::FromObjectInsertID(service));
+	OnQuery(query_del2);
+
+	DbQuery query_del3;
+	query_del3.Table = GetType()->GetTable() + "_contactgroups";
+	query_del3.Type = DbQueryDelete;
+	query_del3.Category = DbCatConfig;
+	query_del3.WhereCriteria = make_shared<Dictionary>();
+	query_del3.WhereCriteria->Set("service_id", DbValue::FromObjectInsertID(service));
+	OnQuery(query_del3);
+
 	/* service dependencies */
 	Log(LogDebug, "ServiceDbObject")
 	    << "service dependencies for '" << service->GetName() << "'";
@@ -254,12 +280,58 @@ void ServiceDbObject::OnConfigUpdate(void)
 		query_contact.Fields = fields_contact;
 		OnQuery(query_contact);
 	}
+}
+
+void ServiceDbObject::OnConfigUpdateLight(void)
+{
+	Service::Ptr service = static_pointer_cast<Service>(GetObject());
 
 	/* update comments and downtimes on config change */
 	DbEvents::AddComments(service);
 	DbEvents::AddDowntimes(service);
 }
 
+String ServiceDbObject::CalculateConfigHash(const Dictionary::Ptr& configFields) const
+{
+	String hashData = DbObject::CalculateConfigHash(configFields);
+
+	Service::Ptr service = static_pointer_cast<Service>(GetObject());
+
+	Array::Ptr groups = service->GetGroups();
+
+	if (groups)
+		hashData += DbObject::HashValue(groups);
+
+	std::set<String> dependencies;
+
+	BOOST_FOREACH(const Dependency::Ptr& dep, service->GetDependencies()) {
+		Checkable::Ptr parent = dep->GetParent();
+
+		if (parent)
+			dependencies.insert(parent->GetName() + "|" + Convert::ToString(dep->GetStateFilter()) + "|" + dep->GetPeriodRaw());
+	}
+
+	hashData += DbObject::HashValue(dependencies);
+
+	std::set<String> users;
+
+	BOOST_FOREACH(const User::Ptr& user, CompatUtility::GetCheckableNotificationUsers(service)) {
+		users.insert(user->GetName());
+	}
+
+	hashData += DbObject::HashValue(users);
+
+	std::set<String> usergroups;
+
+	BOOST_FOREACH(const UserGroup::Ptr& usergroup, CompatUtility::GetCheckableNotificationUserGroups(service)) {
+		usergroups.insert(usergroup->GetName());
+	}
+
+	hashData += DbObject::HashValue(usergroups);
+
+	return SHA256(hashData);
+}
+
 void ServiceDbObject::OnStatusUpdate(void)
 {
 }
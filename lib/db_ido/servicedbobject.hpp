@@ -44,10 +44,13 @@ public:
 	virtual Dictionary::Ptr GetConfigFields(void) const;
 	virtual Dictionary::Ptr GetStatusFields(void) const;
 
+	virtual String CalculateConfigHash(const Dictionary::Ptr& configFields) const;
+
 protected:
 	virtual bool IsStatusAttribute(const String& attribute) const;
 
 	virtual void OnConfigUpdate(void);
+	virtual void OnConfigUpdateLight(void);
 	virtual void OnStatusUpdate(void);
 };
 
@@ -22,6 +22,7 @@
 #include "db_ido/dbvalue.hpp"
 #include "base/objectlock.hpp"
 #include "base/initialize.hpp"
+#include "base/tlsutility.hpp"
 #include <boost/foreach.hpp>
 
 using namespace icinga;
@@ -54,6 +55,14 @@ void ServiceGroupDbObject::OnConfigUpdate(void)
 {
 	ServiceGroup::Ptr group = static_pointer_cast<ServiceGroup>(GetObject());
 
+	DbQuery query_del1;
+	query_del1.Table = DbType::GetByName("ServiceGroup")->GetTable() + "_members";
+	query_del1.Type = DbQueryDelete;
+	query_del1.Category = DbCatConfig;
+	query_del1.WhereCriteria = make_shared<Dictionary>();
+	query_del1.WhereCriteria->Set("servicegroup_id", DbValue::FromObjectInsertID(group));
+	OnQuery(query_del1);
+
 	BOOST_FOREACH(const Service::Ptr& service, group->GetMembers()) {
 		DbQuery query1;
 		query1.Table = DbType::GetByName("ServiceGroup")->GetTable() + "_members";
@@ -66,3 +75,20 @@ void ServiceGroupDbObject::OnConfigUpdate(void)
 		OnQuery(query1);
 	}
 }
+
+String ServiceGroupDbObject::CalculateConfigHash(const Dictionary::Ptr& configFields) const
+{
+	String hashData = DbObject::CalculateConfigHash(configFields);
+
+	ServiceGroup::Ptr group = static_pointer_cast<ServiceGroup>(GetObject());
+
+	std::set<String> members;
+
+	BOOST_FOREACH(const Service::Ptr& member, group->GetMembers()) {
+		members.insert(member->GetName());
+	}
+
+	hashData += DbObject::HashValue(members);
+
+	return SHA256(hashData);
+}
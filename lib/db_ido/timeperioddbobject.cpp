@@ -25,6 +25,7 @@
 #include "base/utility.hpp"
 #include "base/exception.hpp"
 #include "base/objectlock.hpp"
+#include "base/tlsutility.hpp"
 #include <boost/foreach.hpp>
 
 using namespace icinga;
@@ -100,3 +101,17 @@ void TimePeriodDbObject::OnConfigUpdate(void)
 		}
 	}
 }
+
+String TimePeriodDbObject::CalculateConfigHash(const Dictionary::Ptr& configFields) const
+{
+	String hashData = DbObject::CalculateConfigHash(configFields);
+
+	TimePeriod::Ptr tp = static_pointer_cast<TimePeriod>(GetObject());
+
+	Dictionary::Ptr ranges = tp->GetRanges();
+
+	if (ranges)
+		hashData += DbObject::HashValue(ranges);
+
+	return SHA256(hashData);
+}
@@ -41,6 +41,8 @@ public:
 	virtual Dictionary::Ptr GetConfigFields(void) const;
 	virtual Dictionary::Ptr GetStatusFields(void) const;
 	virtual void OnConfigUpdate(void);
+
+	virtual String CalculateConfigHash(const Dictionary::Ptr& configFields) const;
 };
 
 }
@@ -88,6 +88,14 @@ void UserDbObject::OnConfigUpdate(void)
 	Log(LogDebug, "UserDbObject")
 	    << "contact addresses for '" << user->GetName() << "'";
 
+	DbQuery query_del1;
+	query_del1.Table = "contact_addresses";
+	query_del1.Type = DbQueryDelete;
+	query_del1.Category = DbCatConfig;
+	query_del1.WhereCriteria = make_shared<Dictionary>();
+	query_del1.WhereCriteria->Set("contact_id", DbValue::FromObjectInsertID(user));
+	OnQuery(query_del1);
+
 	Dictionary::Ptr vars = user->GetVars();
 
 	if (vars) { /* This is sparta. */
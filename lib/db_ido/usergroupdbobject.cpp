@@ -23,6 +23,7 @@
 #include "base/objectlock.hpp"
 #include "base/initialize.hpp"
 #include "base/dynamictype.hpp"
+#include "base/tlsutility.hpp"
 #include <boost/foreach.hpp>
 
 using namespace icinga;
@@ -73,3 +74,20 @@ void UserGroupDbObject::OnConfigUpdate(void)
 		OnQuery(query2);
 	}
 }
+
+String UserGroupDbObject::CalculateConfigHash(const Dictionary::Ptr& configFields) const
+{
+	String hashData = DbObject::CalculateConfigHash(configFields);
+
+	UserGroup::Ptr group = static_pointer_cast<UserGroup>(GetObject());
+
+	std::set<String> members;
+
+	BOOST_FOREACH(const User::Ptr& member, group->GetMembers()) {
+		members.insert(member->GetName());
+	}
+
+	hashData += DbObject::HashValue(members);
+
+	return SHA256(hashData);
+}
@@ -30,26 +30,53 @@
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/tuple/tuple.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/foreach.hpp>
 
 using namespace icinga;
 
-#define SCHEMA_VERSION "1.12.0"
+#define SCHEMA_VERSION "1.13.0"
 
 REGISTER_TYPE(IdoMysqlConnection);
 REGISTER_STATSFUNCTION(IdoMysqlConnectionStats, &IdoMysqlConnection::StatsFunc);
 
+/* Limits for a single multi-row INSERT; well below the default max_allowed_packet. */
+static const size_t l_MaxBatchRows = 500;
+static const size_t l_MaxBatchSize = 512 * 1024;
+
+/* Upper bound for the number of distinct prepared statements kept per connection. */
+static const size_t l_MaxStatements = 256;
+
+/* Queries for a writer are dropped when more than this many are deferred. */
+static const size_t l_MaxDeferredQueries = 100000;
+
+/* Insert-only history tables whose rows can be collected into multi-row INSERTs. */
+static bool IsHistoryTable(const String& table)
+{
+	return (table == "statehistory" || table == "logentries" || table == "servicechecks" ||
+	    table == "hostchecks" || table == "eventhandlers" || table == "flappinghistory" ||
+	    table == "externalcommands" || table == "processevents" || table == "systemcommands");
+}
+
+/* Status tables with a unique key on the columns used in their upsert WHERE criteria. */
+static bool IsStatusTable(const String& table)
+{
+	return (table == "hoststatus" || table == "servicestatus" || table == "contactstatus" ||
+	    table == "customvariablestatus");
+}
+
 Value IdoMysqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const IdoMysqlConnection::Ptr& idomysqlconnection, DynamicType::GetObjectsByType<IdoMysqlConnection>()) {
-		size_t items = idomysqlconnection->m_QueryQueue.GetLength();
+		size_t items = idomysqlconnection->GetPendingQueryCount();
 
 		Dictionary::Ptr stats = make_shared<Dictionary>();
 		stats->Set("version", SCHEMA_VERSION);
 		stats->Set("instance_name", idomysqlconnection->GetInstanceName());
 		stats->Set("query_queue_items", items);
+		stats->Set("writer_connections", idomysqlconnection->m_Writers.size());
 
 		nodes->Set(idomysqlconnection->GetName(), stats);
 
@@ -61,13 +88,26 @@ Value IdoMysqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::
 	return 0;
 }
 
+void IdoMysqlConnection::OnConfigLoaded(void)
+{
+	DbConnection::OnConfigLoaded();
+
+	m_WritersSuspended = false;
+
+	int count = std::max(1, GetWriterConnections());
+
+	for (int i = 0; i < count; i++)
+		m_Writers.push_back(make_shared<IdoMysqlWriter>());
+}
+
 void IdoMysqlConnection::Resume(void)
 {
 	DbConnection::Resume();
 
-	m_Connected = false;
-
-	m_QueryQueue.SetExceptionCallback(boost::bind(&IdoMysqlConnection::ExceptionHandler, this, _1));
+	BOOST_FOREACH(const IdoMysqlWriter::Ptr& writer, m_Writers) {
+		writer->Connected = false;
+		writer->Queue.SetExceptionCallback(boost::bind(&IdoMysqlConnection::ExceptionHandler, this, writer, _1));
+	}
 
 	m_TxTimer = make_shared<Timer>();
 	m_TxTimer->SetInterval(1);
@@ -89,303 +129,445 @@ void IdoMysqlConnection::Pause(void)
 
 	DbConnection::Pause();
 
-	m_QueryQueue.Enqueue(boost::bind(&IdoMysqlConnection::Disconnect, this));
-	m_QueryQueue.Join();
+	BOOST_FOREACH(const IdoMysqlWriter::Ptr& writer, m_Writers) {
+		writer->Queue.Enqueue(boost::bind(&IdoMysqlConnection::Disconnect, this, writer));
+	}
+
+	BOOST_FOREACH(const IdoMysqlWriter::Ptr& writer, m_Writers) {
+		writer->Queue.Join();
+	}
 }
 
-void IdoMysqlConnection::ExceptionHandler(boost::exception_ptr exp)
+void IdoMysqlConnection::ExceptionHandler(const IdoMysqlWriter::Ptr& writer, boost::exception_ptr exp)
 {
 	Log(LogCritical, "IdoMysqlConnection", "Exception during database operation: Verify that your database is operational!");
 
 	Log(LogDebug, "IdoMysqlConnection")
 	    << "Exception during database operation: " << DiagnosticInformation(exp);
 
-	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	boost::mutex::scoped_lock lock(writer->Mutex);
 
-	if (m_Connected) {
-		mysql_close(&m_Connection);
+	ClearStatements(writer);
 
-		m_Connected = false;
+	if (writer->Connected) {
+		mysql_close(&writer->Connection);
+
+		writer->Connected = false;
 	}
+
+	writer->InsertBatches.clear();
 }
 
-void IdoMysqlConnection::AssertOnWorkQueue(void)
+void IdoMysqlConnection::AssertOnWorkQueue(const IdoMysqlWriter::Ptr& writer)
 {
-	ASSERT(boost::this_thread::get_id() == m_QueryQueue.GetThreadId());
+	ASSERT(boost::this_thread::get_id() == writer->Queue.GetThreadId());
 }
 
-void IdoMysqlConnection::Disconnect(void)
+void IdoMysqlConnection::Disconnect(const IdoMysqlWriter::Ptr& writer)
 {
-	AssertOnWorkQueue();
+	AssertOnWorkQueue(writer);
 
-	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	boost::mutex::scoped_lock lock(writer->Mutex);
 
-	if (!m_Connected)
+	if (!writer->Connected)
 		return;
 
-	Query("COMMIT");
-	mysql_close(&m_Connection);
+	FlushInsertBatches(writer);
+	Query(writer, "COMMIT");
+	ClearStatements(writer);
+	mysql_close(&writer->Connection);
 
-	m_Connected = false;
+	writer->Connected = false;
 }
 
 void IdoMysqlConnection::TxTimerHandler(void)
 {
-	m_QueryQueue.Enqueue(boost::bind(&IdoMysqlConnection::NewTransaction, this), true);
+	BOOST_FOREACH(const IdoMysqlWriter::Ptr& writer, m_Writers) {
+		writer->Queue.Enqueue(boost::bind(&IdoMysqlConnection::NewTransaction, this, writer), true);
+	}
 }
 
-void IdoMysqlConnection::NewTransaction(void)
+void IdoMysqlConnection::NewTransaction(const IdoMysqlWriter::Ptr& writer)
 {
-	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	boost::mutex::scoped_lock lock(writer->Mutex);
 
-	if (!m_Connected)
+	if (!writer->Connected)
 		return;
 
-	Query("COMMIT");
-	Query("BEGIN");
+	FlushInsertBatches(writer);
+	Query(writer, "COMMIT");
+	Query(writer, "BEGIN");
 }
 
 void IdoMysqlConnection::ReconnectTimerHandler(void)
 {
-	m_QueryQueue.Enqueue(boost::bind(&IdoMysqlConnection::Reconnect, this));
+	m_Writers[0]->Queue.Enqueue(boost::bind(&IdoMysqlConnection::Reconnect, this));
+
+	for (std::vector<IdoMysqlWriter::Ptr>::size_type i = 1; i < m_Writers.size(); i++)
+		m_Writers[i]->Queue.Enqueue(boost::bind(&IdoMysqlConnection::ReconnectWriter, this, m_Writers[i]));
 }
 
 void IdoMysqlConnection::Reconnect(void)
 {
-	AssertOnWorkQueue();
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
+
+	AssertOnWorkQueue(primary);
 
 	CONTEXT("Reconnecting to MySQL IDO database '" + GetName() + "'");
 
-	std::vector<DbObject::Ptr> active_dbobjs;
+	bool reconnect = false;
 
 	{
-		boost::mutex::scoped_lock lock(m_ConnectionMutex);
-
-		bool reconnect = false;
+		boost::mutex::scoped_lock lock(primary->Mutex);
 
-		if (m_Connected) {
+		if (primary->Connected) {
 			/* Check if we're really still connected */
-			if (mysql_ping(&m_Connection) == 0)
+			if (mysql_ping(&primary->Connection) == 0)
 				return;
 
-			mysql_close(&m_Connection);
-			m_Connected = false;
+			ClearStatements(primary);
+			mysql_close(&primary->Connection);
+			primary->Connected = false;
 			reconnect = true;
 		}
+	}
 
-		ClearIDCache();
+	std::vector<DbObject::Ptr> active_dbobjs;
 
-		String ihost, iuser, ipasswd, idb;
-		const char *host, *user , *passwd, *db;
-		long port;
+	/* the additional writers must not use the ID cache while it is rebuilt */
+	SuspendWriters();
 
-		ihost = GetHost();
-		iuser = GetUser();
-		ipasswd = GetPassword();
-		idb = GetDatabase();
+	bool connected;
 
-		host = (!ihost.IsEmpty()) ? ihost.CStr() : NULL;
-		port = GetPort();
-		user = (!iuser.IsEmpty()) ? iuser.CStr() : NULL;
-		passwd = (!ipasswd.IsEmpty()) ? ipasswd.CStr() : NULL;
-		db = (!idb.IsEmpty()) ? idb.CStr() : NULL;
+	try {
+		connected = ConnectPrimary(reconnect, active_dbobjs);
+	} catch (...) {
+		ResumeWriters();
+		throw;
+	}
 
-		/* connection */
-		if (!mysql_init(&m_Connection)) {
-			Log(LogCritical, "IdoMysqlConnection")
-			    << "mysql_init() failed: \"" << mysql_error(&m_Connection) << "\"";
+	ResumeWriters();
 
-			BOOST_THROW_EXCEPTION(std::bad_alloc());
-		}
+	if (!connected)
+		return;
 
-		if (!mysql_real_connect(&m_Connection, host, user, passwd, db, port, NULL, CLIENT_FOUND_ROWS)) {
-			Log(LogCritical, "IdoMysqlConnection")
-			    << "Connection to database '" << db << "' with user '" << user << "' on '" << host << ":" << port
-			    << "' failed: \"" << mysql_error(&m_Connection) << "\"";
+	UpdateAllObjects();
 
-			BOOST_THROW_EXCEPTION(std::runtime_error(mysql_error(&m_Connection)));
+	/* deactivate all deleted configuration objects */
+	BOOST_FOREACH(const DbObject::Ptr& dbobj, active_dbobjs) {
+		if (dbobj->GetObject() == NULL) {
+			Log(LogNotice, "IdoMysqlConnection")
+			    << "Deactivate deleted object name1: '" << dbobj->GetName1()
+			    << "' name2: '" << dbobj->GetName2() + "'.";
+			DeactivateObject(dbobj);
 		}
+	}
+}
 
-		m_Connected = true;
+/**
+ * Makes the additional writers defer their queries, e.g. while the primary
+ * connection rebuilds the ID cache. Returns once queries which are already
+ * being executed have finished.
+ *
+ * Must not be called while holding the primary connection's mutex.
+ */
+void IdoMysqlConnection::SuspendWriters(void)
+{
+	{
+		boost::mutex::scoped_lock lock(m_ActivationMutex);
+		m_WritersSuspended = true;
+	}
 
-		String dbVersionName = "idoutils";
-		IdoMysqlResult result = Query("SELECT version FROM " + GetTablePrefix() + "dbversion WHERE name='" + Escape(dbVersionName) + "'");
+	for (std::vector<IdoMysqlWriter::Ptr>::size_type i = 1; i < m_Writers.size(); i++)
+		boost::mutex::scoped_lock wlock(m_Writers[i]->Mutex);
+}
 
-		Dictionary::Ptr row = FetchRow(result);
+void IdoMysqlConnection::ResumeWriters(void)
+{
+	{
+		boost::mutex::scoped_lock lock(m_ActivationMutex);
+		m_WritersSuspended = false;
+	}
 
-		if (!row) {
-			Log(LogCritical, "IdoMysqlConnection", "Schema does not provide any valid version! Verify your schema installation.");
+	for (std::vector<IdoMysqlWriter::Ptr>::size_type i = 1; i < m_Writers.size(); i++)
+		m_Writers[i]->Queue.Enqueue(boost::bind(&IdoMysqlConnection::ResumeDeferredQueries, this, m_Writers[i]));
+}
 
-			Application::Exit(EXIT_FAILURE);
-		}
+bool IdoMysqlConnection::AreWritersSuspended(void)
+{
+	boost::mutex::scoped_lock lock(m_ActivationMutex);
 
-		DiscardRows(result);
+	return m_WritersSuspended;
+}
 
-		String version = row->Get("version");
+/**
+ * Connects the primary connection and rebuilds the ID cache.
+ *
+ * @param reconnect Whether the connection was lost.
+ * @param[out] active_dbobjs The objects which were active in the database.
+ * @returns false if the connection was not enabled.
+ */
+bool IdoMysqlConnection::ConnectPrimary(bool reconnect, std::vector<DbObject::Ptr>& active_dbobjs)
+{
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
 
-		if (Utility::CompareVersion(SCHEMA_VERSION, version) < 0) {
-			Log(LogCritical, "IdoMysqlConnection")
-			    << "Schema version '" << version << "' does not match the required version '"
-			    << SCHEMA_VERSION << "'! Please check the upgrade documentation.";
+	boost::mutex::scoped_lock lock(primary->Mutex);
 
-			Application::Exit(EXIT_FAILURE);
-		}
+	ClearIDCache();
+	ClearStatements(primary);
+	primary->InsertBatches.clear();
 
-		String instanceName = GetInstanceName();
+	Connect(primary);
 
-		result = Query("SELECT instance_id FROM " + GetTablePrefix() + "instances WHERE instance_name = '" + Escape(instanceName) + "'");
-		row = FetchRow(result);
+	String dbVersionName = "idoutils";
+	IdoMysqlResult result = Query(primary, "SELECT version FROM " + GetTablePrefix() + "dbversion WHERE name='" + Escape(primary, dbVersionName) + "'");
 
-		if (!row) {
-			Query("INSERT INTO " + GetTablePrefix() + "instances (instance_name, instance_description) VALUES ('" + Escape(instanceName) + "', '" + Escape(GetInstanceDescription()) + "')");
-			m_InstanceID = GetLastInsertID();
-		} else {
-			m_InstanceID = DbReference(row->Get("instance_id"));
-		}
+	Dictionary::Ptr row = FetchRow(result);
+
+	if (!row) {
+		Log(LogCritical, "IdoMysqlConnection", "Schema does not provide any valid version! Verify your schema installation.");
+
+		Application::Exit(EXIT_FAILURE);
+	}
 
+	DiscardRows(result);
+
+	String version = row->Get("version");
+
+	if (Utility::CompareVersion(SCHEMA_VERSION, version) < 0) {
+		Log(LogCritical, "IdoMysqlConnection")
+		    << "Schema version '" << version << "' does not match the required version '"
+		    << SCHEMA_VERSION << "'! Please check the upgrade documentation.";
+
+		Application::Exit(EXIT_FAILURE);
+	}
+
+	String instanceName = GetInstanceName();
+
+	result = Query(primary, "SELECT instance_id FROM " + GetTablePrefix() + "instances WHERE instance_name = '" + Escape(primary, instanceName) + "'");
+	row = FetchRow(result);
+
+	if (!row) {
+		Query(primary, "INSERT INTO " + GetTablePrefix() + "instances (instance_name, instance_description) VALUES ('" + Escape(primary, instanceName) + "', '" + Escape(primary, GetInstanceDescription()) + "')");
+		m_InstanceID = GetLastInsertID(primary);
+	} else {
+		m_InstanceID = DbReference(row->Get("instance_id"));
+	}
+
+	DiscardRows(result);
+
+	Endpoint::Ptr my_endpoint = Endpoint::GetLocalEndpoint();
+
+	/* we have an endpoint in a cluster setup, so decide if we can proceed here */
+	if (my_endpoint && GetHAMode() == HARunOnce) {
+		/* get the current endpoint writing to programstatus table */
+		result = Query(primary, "SELECT UNIX_TIMESTAMP(status_update_time) AS status_update_time, endpoint_name FROM " +
+		    GetTablePrefix() + "programstatus WHERE instance_id = " + Convert::ToString(m_InstanceID));
+		row = FetchRow(result);
 		DiscardRows(result);
 
-		Endpoint::Ptr my_endpoint = Endpoint::GetLocalEndpoint();
+		String endpoint_name;
 
-		/* we have an endpoint in a cluster setup, so decide if we can proceed here */
-		if (my_endpoint && GetHAMode() == HARunOnce) {
-			/* get the current endpoint writing to programstatus table */
-			result = Query("SELECT UNIX_TIMESTAMP(status_update_time) AS status_update_time, endpoint_name FROM " +
-			    GetTablePrefix() + "programstatus WHERE instance_id = " + Convert::ToString(m_InstanceID));
-			row = FetchRow(result);
-			DiscardRows(result);
+		if (row)
+			endpoint_name = row->Get("endpoint_name");
+		else
+			Log(LogNotice, "IdoMysqlConnection", "Empty program status table");
 
-			String endpoint_name;
+		/* if we did not write into the database earlier, another instance is active */
+		if (endpoint_name != my_endpoint->GetName()) {
+			double status_update_time;
 
 			if (row)
-				endpoint_name = row->Get("endpoint_name");
+				status_update_time = row->Get("status_update_time");
 			else
-				Log(LogNotice, "IdoMysqlConnection", "Empty program status table");
+				status_update_time = 0;
 
-			/* if we did not write into the database earlier, another instance is active */
-			if (endpoint_name != my_endpoint->GetName()) {
-				double status_update_time;
+			double status_update_age = Utility::GetTime() - status_update_time;
 
-				if (row)
-					status_update_time = row->Get("status_update_time");
-				else
-					status_update_time = 0;
+			Log(LogNotice, "IdoMysqlConnection")
+			    << "Last update by '" << endpoint_name << "' was " << status_update_age << "s ago.";
+
+			if (status_update_age < GetFailoverTimeout()) {
+				mysql_close(&primary->Connection);
+				primary->Connected = false;
 
-				double status_update_age = Utility::GetTime() - status_update_time;
+				return false;
+			}
 
+			/* activate the IDO only, if we're authoritative in this zone */
+			if (IsPaused()) {
 				Log(LogNotice, "IdoMysqlConnection")
-				    << "Last update by '" << endpoint_name << "' was " << status_update_age << "s ago.";
+				    << "Local endpoint '" << my_endpoint->GetName() << "' is not authoritative, bailing out.";
 
-				if (status_update_age < GetFailoverTimeout()) {
-					mysql_close(&m_Connection);
-					m_Connected = false;
+				mysql_close(&primary->Connection);
+				primary->Connected = false;
 
-					return;
-				}
+				return false;
+			}
+		}
 
-				/* activate the IDO only, if we're authoritative in this zone */
-				if (IsPaused()) {
-					Log(LogNotice, "IdoMysqlConnection")
-					    << "Local endpoint '" << my_endpoint->GetName() << "' is not authoritative, bailing out.";
+		Log(LogNotice, "IdoMysqlConnection", "Enabling IDO connection.");
+	}
 
-					mysql_close(&m_Connection);
-					m_Connected = false;
+	Log(LogInformation, "IdoMysqlConnection")
+	    << "MySQL IDO instance id: " << static_cast<long>(m_InstanceID) << " (schema version: '" + version + "')";
 
-					return;
-				}
-			}
+	/* set session time zone to utc */
+	Query(primary, "SET SESSION TIME_ZONE='+00:00'");
 
-			Log(LogNotice, "IdoMysqlConnection", "Enabling IDO connection.");
-		}
+	/* record connection */
+	Query(primary, "INSERT INTO " + GetTablePrefix() + "conninfo " +
+	    "(instance_id, connect_time, last_checkin_time, agent_name, agent_version, connect_type, data_start_time) VALUES ("
+	    + Convert::ToString(static_cast<long>(m_InstanceID)) + ", NOW(), NOW(), 'icinga2 db_ido_mysql', '" + Escape(primary, Application::GetVersion())
+	    + "', '" + (reconnect ? "RECONNECT" : "INITIAL") + "', NOW())");
 
-		Log(LogInformation, "IdoMysqlConnection")
-		    << "MySQL IDO instance id: " << static_cast<long>(m_InstanceID) << " (schema version: '" + version + "')";
+	/* clear config tables for the initial config dump */
+	PrepareDatabase();
 
-		/* set session time zone to utc */
-		Query("SET SESSION TIME_ZONE='+00:00'");
+	std::ostringstream q1buf;
+	q1buf << "SELECT object_id, objecttype_id, name1, name2, is_active FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
+	result = Query(primary, q1buf.str());
 
-		/* record connection */
-		Query("INSERT INTO " + GetTablePrefix() + "conninfo " +
-		    "(instance_id, connect_time, last_checkin_time, agent_name, agent_version, connect_type, data_start_time) VALUES ("
-		    + Convert::ToString(static_cast<long>(m_InstanceID)) + ", NOW(), NOW(), 'icinga2 db_ido_mysql', '" + Escape(Application::GetVersion())
-		    + "', '" + (reconnect ? "RECONNECT" : "INITIAL") + "', NOW())");
+	while ((row = FetchRow(result))) {
+		DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
 
-		/* clear config tables for the initial config dump */
-		PrepareDatabase();
+		if (!dbtype)
+			continue;
 
-		std::ostringstream q1buf;
-		q1buf << "SELECT object_id, objecttype_id, name1, name2, is_active FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
-		result = Query(q1buf.str());
+		DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
+		SetObjectID(dbobj, DbReference(row->Get("object_id")));
+		SetObjectActive(dbobj, row->Get("is_active"));
 
-		while ((row = FetchRow(result))) {
-			DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
+		if (GetObjectActive(dbobj))
+			active_dbobjs.push_back(dbobj);
+	}
 
-			if (!dbtype)
-				continue;
+	Query(primary, "BEGIN");
 
-			DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
-			SetObjectID(dbobj, DbReference(row->Get("object_id")));
-			SetObjectActive(dbobj, row->Get("is_active"));
+	return true;
+}
 
-			if (GetObjectActive(dbobj))
-				active_dbobjs.push_back(dbobj);
-		}
+/* caller must hold writer->Mutex */
+void IdoMysqlConnection::Connect(const IdoMysqlWriter::Ptr& writer)
+{
+	String ihost, iuser, ipasswd, idb;
+	const char *host, *user , *passwd, *db;
+	long port;
+
+	ihost = GetHost();
+	iuser = GetUser();
+	ipasswd = GetPassword();
+	idb = GetDatabase();
+
+	host = (!ihost.IsEmpty()) ? ihost.CStr() : NULL;
+	port = GetPort();
+	user = (!iuser.IsEmpty()) ? iuser.CStr() : NULL;
+	passwd = (!ipasswd.IsEmpty()) ? ipasswd.CStr() : NULL;
+	db = (!idb.IsEmpty()) ? idb.CStr() : NULL;
+
+	/* connection */
+	if (!mysql_init(&writer->Connection)) {
+		Log(LogCritical, "IdoMysqlConnection")
+		    << "mysql_init() failed: \"" << mysql_error(&writer->Connection) << "\"";
+
+		BOOST_THROW_EXCEPTION(std::bad_alloc());
+	}
+
+	if (!mysql_real_connect(&writer->Connection, host, user, passwd, db, port, NULL, CLIENT_FOUND_ROWS)) {
+		Log(LogCritical, "IdoMysqlConnection")
+		    << "Connection to database '" << db << "' with user '" << user << "' on '" << host << ":" << port
+		    << "' failed: \"" << mysql_error(&writer->Connection) << "\"";
 
-		Query("BEGIN");
+		BOOST_THROW_EXCEPTION(std::runtime_error(mysql_error(&writer->Connection)));
 	}
 
-	UpdateAllObjects();
+	writer->Connected = true;
+}
 
-	/* deactivate all deleted configuration objects */
-	BOOST_FOREACH(const DbObject::Ptr& dbobj, active_dbobjs) {
-		if (dbobj->GetObject() == NULL) {
-			Log(LogNotice, "IdoMysqlConnection")
-			    << "Deactivate deleted object name1: '" << dbobj->GetName1()
-			    << "' name2: '" << dbobj->GetName2() + "'.";
-			DeactivateObject(dbobj);
-		}
+/**
+ * Connects one of the additional writers. They only carry state and history
+ * queries, so they wait until the primary connection is established.
+ */
+void IdoMysqlConnection::ReconnectWriter(const IdoMysqlWriter::Ptr& writer)
+{
+	AssertOnWorkQueue(writer);
+
+	boost::mutex::scoped_lock lock(writer->Mutex);
+
+	if (writer->Connected) {
+		/* Check if we're really still connected */
+		if (mysql_ping(&writer->Connection) == 0)
+			return;
+
+		ClearStatements(writer);
+		mysql_close(&writer->Connection);
+		writer->Connected = false;
 	}
+
+	writer->InsertBatches.clear();
+
+	{
+		IdoMysqlWriter::Ptr primary = m_Writers[0];
+		boost::mutex::scoped_lock plock(primary->Mutex);
+
+		if (!primary->Connected)
+			return;
+	}
+
+	Connect(writer);
+
+	/* set session time zone to utc */
+	Query(writer, "SET SESSION TIME_ZONE='+00:00'");
+
+	Query(writer, "BEGIN");
+
+	lock.unlock();
+
+	/* queries which were received while the writer was disconnected */
+	ResumeDeferredQueries(writer);
 }
 
 void IdoMysqlConnection::ClearConfigTable(const String& table)
 {
-	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + Convert::ToString(static_cast<long>(m_InstanceID)));
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
+
+	Query(primary, "DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + Convert::ToString(static_cast<long>(m_InstanceID)));
 }
 
-IdoMysqlResult IdoMysqlConnection::Query(const String& query)
+IdoMysqlResult IdoMysqlConnection::Query(const IdoMysqlWriter::Ptr& writer, const String& query)
 {
-	AssertOnWorkQueue();
+	AssertOnWorkQueue(writer);
 
 	Log(LogDebug, "IdoMysqlConnection")
 	    << "Query: " << query;
 
-	if (mysql_query(&m_Connection, query.CStr()) != 0) {
+	if (mysql_query(&writer->Connection, query.CStr()) != 0) {
 		std::ostringstream msgbuf;
-		String message = mysql_error(&m_Connection);
+		String message = mysql_error(&writer->Connection);
 		msgbuf << "Error \"" << message << "\" when executing query \"" << query << "\"";
 		Log(LogCritical, "IdoMysqlConnection", msgbuf.str());
 
 		BOOST_THROW_EXCEPTION(
 		    database_error()
-		        << errinfo_message(mysql_error(&m_Connection))
+		        << errinfo_message(mysql_error(&writer->Connection))
 			<< errinfo_database_query(query)
 		);
 	}
 
-	m_AffectedRows = mysql_affected_rows(&m_Connection);
+	writer->AffectedRows = mysql_affected_rows(&writer->Connection);
 
-	MYSQL_RES *result = mysql_use_result(&m_Connection);
+	MYSQL_RES *result = mysql_use_result(&writer->Connection);
 
 	if (!result) {
-		if (mysql_field_count(&m_Connection) > 0) {
+		if (mysql_field_count(&writer->Connection) > 0) {
 			std::ostringstream msgbuf;
-			String message = mysql_error(&m_Connection);
+			String message = mysql_error(&writer->Connection);
 			msgbuf << "Error \"" << message << "\" when executing query \"" << query << "\"";
 			Log(LogCritical, "IdoMysqlConnection", msgbuf.str());
 
 			BOOST_THROW_EXCEPTION(
 			    database_error()
-				<< errinfo_message(mysql_error(&m_Connection))
+				<< errinfo_message(mysql_error(&writer->Connection))
 				<< errinfo_database_query(query)
 			);
 		}
@@ -396,28 +578,28 @@ IdoMysqlResult IdoMysqlConnection::Query(const String& query)
 	return IdoMysqlResult(result, std::ptr_fun(mysql_free_result));
 }
 
-DbReference IdoMysqlConnection::GetLastInsertID(void)
+DbReference IdoMysqlConnection::GetLastInsertID(const IdoMysqlWriter::Ptr& writer)
 {
-	AssertOnWorkQueue();
+	AssertOnWorkQueue(writer);
 
-	return DbReference(mysql_insert_id(&m_Connection));
+	return DbReference(mysql_insert_id(&writer->Connection));
 }
 
-int IdoMysqlConnection::GetAffectedRows(void)
+int IdoMysqlConnection::GetAffectedRows(const IdoMysqlWriter::Ptr& writer)
 {
-	AssertOnWorkQueue();
+	AssertOnWorkQueue(writer);
 
-	return m_AffectedRows;
+	return writer->AffectedRows;
 }
 
-String IdoMysqlConnection::Escape(const String& s)
+String IdoMysqlConnection::Escape(const IdoMysqlWriter::Ptr& writer, const String& s)
 {
-	AssertOnWorkQueue();
+	AssertOnWorkQueue(writer);
 
 	size_t length = s.GetLength();
 	char *to = new char[s.GetLength() * 2 + 1];
 
-	mysql_real_escape_string(&m_Connection, to, s.CStr(), length);
+	mysql_real_escape_string(&writer->Connection, to, s.CStr(), length);
 
 	String result = String(to);
 
@@ -428,7 +610,7 @@ String IdoMysqlConnection::Escape(const String& s)
 
 Dictionary::Ptr IdoMysqlConnection::FetchRow(const IdoMysqlResult& result)
 {
-	AssertOnWorkQueue();
+	AssertOnWorkQueue(m_Writers[0]);
 
 	MYSQL_ROW row;
 	MYSQL_FIELD *field;
@@ -463,13 +645,17 @@ void IdoMysqlConnection::DiscardRows(const IdoMysqlResult& result)
 
 void IdoMysqlConnection::ActivateObject(const DbObject::Ptr& dbobj)
 {
-	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
+
+	boost::mutex::scoped_lock lock(primary->Mutex);
 	InternalActivateObject(dbobj);
 }
 
 void IdoMysqlConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
 {
-	if (!m_Connected)
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
+
+	if (!primary->Connected)
 		return;
 
 	DbReference dbref = GetObjectID(dbobj);
@@ -479,26 +665,131 @@ void IdoMysqlConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
 		if (!dbobj->GetName2().IsEmpty()) {
 			qbuf << "INSERT INTO " + GetTablePrefix() + "objects (instance_id, objecttype_id, name1, name2, is_active) VALUES ("
 			     << static_cast<long>(m_InstanceID) << ", " << dbobj->GetType()->GetTypeID() << ", "
-			     << "'" << Escape(dbobj->GetName1()) << "', '" << Escape(dbobj->GetName2()) << "', 1)";
+			     << "'" << Escape(primary, dbobj->GetName1()) << "', '" << Escape(primary, dbobj->GetName2()) << "', 1)";
 		} else {
 			qbuf << "INSERT INTO " + GetTablePrefix() + "objects (instance_id, objecttype_id, name1, is_active) VALUES ("
 			     << static_cast<long>(m_InstanceID) << ", " << dbobj->GetType()->GetTypeID() << ", "
-			     << "'" << Escape(dbobj->GetName1()) << "', 1)";
+			     << "'" << Escape(primary, dbobj->GetName1()) << "', 1)";
 		}
 
-		Query(qbuf.str());
-		SetObjectID(dbobj, GetLastInsertID());
+		Query(primary, qbuf.str());
+		SetObjectID(dbobj, GetLastInsertID(primary));
 	} else {
 		qbuf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 1 WHERE object_id = " << static_cast<long>(dbref);
-		Query(qbuf.str());
+		Query(primary, qbuf.str());
+	}
+}
+
+/**
+ * Returns the objects a query refers to which don't have an object ID yet.
+ */
+std::vector<DbObject::Ptr> IdoMysqlConnection::GetUnresolvedObjects(const DbQuery& query) const
+{
+	std::vector<DbObject::Ptr> dbobjs;
+	Dictionary::Ptr dicts[] = { query.Fields, query.WhereCriteria };
+
+	for (size_t i = 0; i < sizeof(dicts) / sizeof(dicts[0]); i++) {
+		if (!dicts[i])
+			continue;
+
+		ObjectLock olock(dicts[i]);
+
+		BOOST_FOREACH(const Dictionary::Pair& kv, dicts[i]) {
+			if (DbValue::IsObjectInsertID(kv.second))
+				continue;
+
+			Value rawvalue = DbValue::ExtractValue(kv.second);
+
+			if (!rawvalue.IsObjectType<DynamicObject>())
+				continue;
+
+			DbObject::Ptr dbobj = DbObject::GetOrCreateByObject(rawvalue);
+
+			if (dbobj && !GetObjectID(dbobj).IsValid())
+				dbobjs.push_back(dbobj);
+		}
+	}
+
+	return dbobjs;
+}
+
+bool IdoMysqlConnection::HasPendingActivation(const DbQuery& query)
+{
+	std::vector<DbObject::Ptr> dbobjs = GetUnresolvedObjects(query);
+
+	if (dbobjs.empty())
+		return false;
+
+	boost::mutex::scoped_lock lock(m_ActivationMutex);
+
+	BOOST_FOREACH(const DbObject::Ptr& dbobj, dbobjs) {
+		if (m_PendingActivations.find(dbobj) != m_PendingActivations.end())
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Rows in the objects table are only ever created by the primary connection.
+ * ExecuteQuery() schedules the activation before it passes a query to one of
+ * the additional writers. Those writers never wait for the primary connection:
+ * they defer the query until the object has been activated.
+ */
+void IdoMysqlConnection::ActivateObjectForWriters(const DbObject::Ptr& dbobj)
+{
+	try {
+		if (!GetObjectID(dbobj).IsValid())
+			ActivateObject(dbobj);
+	} catch (...) {
+		boost::mutex::scoped_lock lock(m_ActivationMutex);
+		m_PendingActivations.erase(dbobj);
+
+		throw;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(m_ActivationMutex);
+		m_PendingActivations.erase(dbobj);
+	}
+
+	for (std::vector<IdoMysqlWriter::Ptr>::size_type i = 1; i < m_Writers.size(); i++)
+		m_Writers[i]->Queue.Enqueue(boost::bind(&IdoMysqlConnection::ResumeDeferredQueries, this, m_Writers[i]));
+}
+
+/**
+ * Executes the deferred queries of a writer in order, up to the first one
+ * which still waits for an object to be activated.
+ */
+void IdoMysqlConnection::ResumeDeferredQueries(const IdoMysqlWriter::Ptr& writer)
+{
+	for (;;) {
+		DbQuery query;
+
+		{
+			boost::mutex::scoped_lock lock(writer->Mutex);
+
+			if (!writer->Connected || writer->DeferredQueries.empty() || AreWritersSuspended())
+				return;
+
+			if (HasPendingActivation(writer->DeferredQueries.front()))
+				return;
+
+			query = writer->DeferredQueries.front();
+			writer->DeferredQueries.pop_front();
+		}
+
+		InternalExecuteQuery(writer, query, NULL, true);
 	}
 }
 
 void IdoMysqlConnection::DeactivateObject(const DbObject::Ptr& dbobj)
 {
-	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
+
+	boost::mutex::scoped_lock lock(primary->Mutex);
 
-	if (!m_Connected)
+	if (!primary->Connected)
 		return;
 
 	DbReference dbref = GetObjectID(dbobj);
@@ -508,14 +799,21 @@ void IdoMysqlConnection::DeactivateObject(const DbObject::Ptr& dbobj)
 
 	std::ostringstream qbuf;
 	qbuf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 0 WHERE object_id = " << static_cast<long>(dbref);
-	Query(qbuf.str());
+	Query(primary, qbuf.str());
+
+	/* the relation and custom variable rows aren't cleared by PrepareDatabase() */
+	BOOST_FOREACH(const String& query, GetDeletedObjectQueries(dbobj)) {
+		Query(primary, query);
+	}
+
+	SetConfigHash(dbobj, String());
 
 	/* Note that we're _NOT_ clearing the db refs via SetReference/SetConfigUpdate/SetStatusUpdate
 	 * because the object is still in the database. */
 }
 
-/* caller must hold m_ConnectionMutex */
-bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& value, Value *result)
+/* caller must hold writer->Mutex */
+bool IdoMysqlConnection::FieldToEscapedString(const IdoMysqlWriter::Ptr& writer, const String& key, const Value& value, Value *result)
 {
 	if (key == "instance_id") {
 		*result = static_cast<long>(m_InstanceID);
@@ -541,18 +839,22 @@ bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& va
 		if (DbValue::IsObjectInsertID(value)) {
 			dbrefcol = GetInsertID(dbobjcol);
 
-			ASSERT(dbrefcol.IsValid());
+			if (!dbrefcol.IsValid()) {
+				ASSERT(writer != m_Writers[0]);
+				return false;
+			}
 		} else {
 			dbrefcol = GetObjectID(dbobjcol);
 
-			if (!dbrefcol.IsValid()) {
+			/* additional writers can't create objects, see ActivateObjectForWriters() */
+			if (!dbrefcol.IsValid() && writer == m_Writers[0]) {
 				InternalActivateObject(dbobjcol);
 
 				dbrefcol = GetObjectID(dbobjcol);
-
-				if (!dbrefcol.IsValid())
-					return false;
 			}
+
+			if (!dbrefcol.IsValid())
+				return false;
 		}
 
 		*result = static_cast<long>(dbrefcol);
@@ -564,54 +866,253 @@ bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& va
 	} else if (DbValue::IsTimestampNow(value)) {
 		*result = "NOW()";
 	} else {
-		*result = "'" + Escape(rawvalue) + "'";
+		*result = "'" + Escape(writer, rawvalue) + "'";
+	}
+
+	return true;
+}
+
+/**
+ * Like FieldToEscapedString() but for prepared statements: *expr receives the
+ * SQL expression for the field and the value to bind (if any) is appended to params.
+ *
+ * Caller must hold writer->Mutex.
+ */
+bool IdoMysqlConnection::FieldToParameter(const IdoMysqlWriter::Ptr& writer, const String& key, const Value& value, String *expr, std::vector<String>& params)
+{
+	Value rawvalue = DbValue::ExtractValue(value);
+
+	if (DbValue::IsTimestamp(value)) {
+		*expr = "FROM_UNIXTIME(?)";
+		params.push_back(Convert::ToString(static_cast<long>(rawvalue)));
+	} else if (DbValue::IsTimestampNow(value)) {
+		*expr = "NOW()";
+	} else if (key == "instance_id" || key == "notification_id" || rawvalue.IsObjectType<DynamicObject>()) {
+		Value id;
+
+		if (!FieldToEscapedString(writer, key, value, &id))
+			return false;
+
+		*expr = "?";
+		params.push_back(id);
+	} else {
+		*expr = "?";
+		params.push_back(rawvalue);
 	}
 
 	return true;
 }
 
+/**
+ * Executes a statement with '?' placeholders. Statements are prepared once
+ * per distinct query text and connection and reused afterwards.
+ */
+void IdoMysqlConnection::ExecutePrepared(const IdoMysqlWriter::Ptr& writer, const String& query, const std::vector<String>& params)
+{
+	AssertOnWorkQueue(writer);
+
+	Log(LogDebug, "IdoMysqlConnection")
+	    << "Prepared query: " << query;
+
+	MYSQL_STMT *stmt;
+	std::map<String, MYSQL_STMT *>::const_iterator it = writer->Statements.find(query);
+
+	if (it != writer->Statements.end()) {
+		stmt = it->second;
+	} else {
+		if (writer->Statements.size() >= l_MaxStatements)
+			ClearStatements(writer);
+
+		stmt = mysql_stmt_init(&writer->Connection);
+
+		if (!stmt)
+			BOOST_THROW_EXCEPTION(std::bad_alloc());
+
+		if (mysql_stmt_prepare(stmt, query.CStr(), query.GetLength()) != 0) {
+			String message = mysql_stmt_error(stmt);
+			mysql_stmt_close(stmt);
+
+			Log(LogCritical, "IdoMysqlConnection")
+			    << "Error \"" << message << "\" when preparing query \"" << query << "\"";
+
+			BOOST_THROW_EXCEPTION(
+			    database_error()
+				<< errinfo_message(message)
+				<< errinfo_database_query(query)
+			);
+		}
+
+		writer->Statements[query] = stmt;
+	}
+
+	std::vector<MYSQL_BIND> binds(params.size());
+	std::vector<unsigned long> lengths(params.size());
+
+	for (std::vector<String>::size_type i = 0; i < params.size(); i++) {
+		lengths[i] = params[i].GetLength();
+
+		binds[i].buffer_type = MYSQL_TYPE_STRING;
+		binds[i].buffer = const_cast<char *>(params[i].CStr());
+		binds[i].buffer_length = lengths[i];
+		binds[i].length = &lengths[i];
+	}
+
+	if ((!binds.empty() && mysql_stmt_bind_param(stmt, &binds[0]) != 0) || mysql_stmt_execute(stmt) != 0) {
+		String message = mysql_stmt_error(stmt);
+
+		Log(LogCritical, "IdoMysqlConnection")
+		    << "Error \"" << message << "\" when executing query \"" << query << "\"";
+
+		writer->Statements.erase(query);
+		mysql_stmt_close(stmt);
+
+		BOOST_THROW_EXCEPTION(
+		    database_error()
+			<< errinfo_message(message)
+			<< errinfo_database_query(query)
+		);
+	}
+
+	writer->AffectedRows = mysql_stmt_affected_rows(stmt);
+}
+
+void IdoMysqlConnection::ClearStatements(const IdoMysqlWriter::Ptr& writer)
+{
+	typedef std::pair<String, MYSQL_STMT *> kv_pair;
+	BOOST_FOREACH(const kv_pair& kv, writer->Statements) {
+		mysql_stmt_close(kv.second);
+	}
+
+	writer->Statements.clear();
+}
+
 void IdoMysqlConnection::ExecuteQuery(const DbQuery& query)
 {
 	ASSERT(query.Category != DbCatInvalid);
 
-	m_QueryQueue.Enqueue(boost::bind(&IdoMysqlConnection::InternalExecuteQuery, this, query, (DbQueryType *)NULL), true);
+	IdoMysqlWriter::Ptr writer = GetWriter(query);
+
+	if (writer != m_Writers[0]) {
+		BOOST_FOREACH(const DbObject::Ptr& dbobj, GetUnresolvedObjects(query)) {
+			{
+				boost::mutex::scoped_lock lock(m_ActivationMutex);
+
+				if (!m_PendingActivations.insert(dbobj).second)
+					continue;
+			}
+
+			m_Writers[0]->Queue.Enqueue(boost::bind(&IdoMysqlConnection::ActivateObjectForWriters, this, dbobj), true);
+		}
+	}
+
+	writer->Queue.Enqueue(boost::bind(&IdoMysqlConnection::InternalExecuteQuery, this, writer, query, (DbQueryType *)NULL, false), true);
 }
 
-void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType *typeOverride)
+/**
+ * Picks the connection for a query. Config, notification and program status
+ * queries as well as queries which don't refer to an object use the primary
+ * connection. All other queries are distributed by the object they belong to
+ * so that queries for the same object are executed in order.
+ */
+IdoMysqlWriter::Ptr IdoMysqlConnection::GetWriter(const DbQuery& query) const
 {
-	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	if (m_Writers.size() == 1 || query.Category == DbCatConfig ||
+	    query.Category == DbCatNotification || query.Category == DbCatProgramStatus)
+		return m_Writers[0];
 
-	if ((query.Category & GetCategories()) == 0)
-		return;
-
-	if (!m_Connected)
-		return;
+	DynamicObject::Ptr object;
 
-	std::ostringstream qbuf, where;
-	int type;
+	if (query.Object)
+		object = query.Object->GetObject();
 
-	if (query.WhereCriteria) {
-		where << " WHERE ";
+	const char *columns[] = { "service_object_id", "host_object_id", "object_id" };
 
-		ObjectLock olock(query.WhereCriteria);
+	for (size_t i = 0; !object && i < sizeof(columns) / sizeof(columns[0]); i++) {
 		Value value;
-		bool first = true;
 
-		BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
-			if (!FieldToEscapedString(kv.first, kv.second, &value))
-				return;
+		if (query.WhereCriteria && query.WhereCriteria->Contains(columns[i]))
+			value = DbValue::ExtractValue(query.WhereCriteria->Get(columns[i]));
+		else if (query.Fields && query.Fields->Contains(columns[i]))
+			value = DbValue::ExtractValue(query.Fields->Get(columns[i]));
 
-			if (!first)
-				where << " AND ";
+		if (value.IsObjectType<DynamicObject>())
+			object = value;
+	}
 
-			where << kv.first << " = " << value;
+	if (!object)
+		return m_Writers[0];
 
-			if (first)
-				first = false;
+	return m_Writers[boost::hash<DynamicObject *>()(object.get()) % m_Writers.size()];
+}
+
+size_t IdoMysqlConnection::GetPendingQueryCount(void)
+{
+	size_t items = 0;
+
+	BOOST_FOREACH(const IdoMysqlWriter::Ptr& writer, m_Writers) {
+		items += writer->Queue.GetLength();
+	}
+
+	return items;
+}
+
+/**
+ * Executes a query on a writer. Queries on additional writers are deferred
+ * while the writer is disconnected or an object they refer to hasn't been
+ * activated yet; later queries are deferred as well so that the queries for
+ * an object stay in order.
+ *
+ * @param deferred Whether the query is run by ResumeDeferredQueries().
+ */
+void IdoMysqlConnection::InternalExecuteQuery(const IdoMysqlWriter::Ptr& writer, const DbQuery& query,
+    DbQueryType *typeOverride, bool deferred)
+{
+	boost::mutex::scoped_lock lock(writer->Mutex);
+
+	if ((query.Category & GetCategories()) == 0)
+		return;
+
+	if (writer != m_Writers[0] && !typeOverride && !deferred) {
+		bool defer = !writer->DeferredQueries.empty() || AreWritersSuspended() || HasPendingActivation(query);
+
+		if (!defer && !writer->Connected) {
+			/* keep the query until the writer has reconnected unless the database is unavailable */
+			IdoMysqlWriter::Ptr primary = m_Writers[0];
+			boost::mutex::scoped_lock plock(primary->Mutex);
+			defer = primary->Connected;
 		}
+
+		if (defer) {
+			if (writer->DeferredQueries.size() >= l_MaxDeferredQueries) {
+				Log(LogDebug, "IdoMysqlConnection")
+				    << "Dropping query for table '" << query.Table << "': Too many deferred queries.";
+				return;
+			}
+
+			if (writer->DeferredQueries.size() == l_MaxDeferredQueries - 1)
+				Log(LogWarning, "IdoMysqlConnection", "Too many deferred queries for a writer connection. Further queries will be dropped.");
+
+			writer->DeferredQueries.push_back(query);
+			return;
+		}
+	} else if (deferred && AreWritersSuspended()) {
+		/* the writers were suspended after the query had been dequeued */
+		writer->DeferredQueries.push_front(query);
+		return;
 	}
 
-	type = typeOverride ? *typeOverride : query.Type;
+	if (!writer->Connected)
+		return;
+
+	std::ostringstream qbuf, where;
+	std::vector<String> params;
+	int type = typeOverride ? *typeOverride : query.Type;
+
+	if (BatchQuery(writer, query, type))
+		return;
+
+	/* Pending rows for this table have to be written before it is modified otherwise. */
+	FlushInsertBatches(writer, query.Table);
 
 	bool upsert = false;
 
@@ -652,14 +1153,13 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 
 		ObjectLock olock(query.Fields);
 
+		String value;
 		bool first = true;
 		BOOST_FOREACH(const Dictionary::Pair& kv, query.Fields) {
-			Value value;
-
 			if (kv.second.IsEmpty())
 				continue;
 
-			if (!FieldToEscapedString(kv.first, kv.second, &value))
+			if (!FieldToParameter(writer, kv.first, kv.second, &value, params))
 				return;
 
 			if (type == DbQueryInsert) {
@@ -685,16 +1185,38 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 			qbuf << " (" << colbuf.str() << ") VALUES (" << valbuf.str() << ")";
 	}
 
-	if (type != DbQueryInsert)
+	if (type != DbQueryInsert) {
+		if (query.WhereCriteria) {
+			where << " WHERE ";
+
+			ObjectLock olock(query.WhereCriteria);
+			String expr;
+			bool first = true;
+
+			BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
+				if (!FieldToParameter(writer, kv.first, kv.second, &expr, params))
+					return;
+
+				if (!first)
+					where << " AND ";
+
+				where << kv.first << " = " << expr;
+
+				if (first)
+					first = false;
+			}
+		}
+
 		qbuf << where.str();
+	}
 
-	Query(qbuf.str());
+	ExecutePrepared(writer, qbuf.str(), params);
 
-	if (upsert && GetAffectedRows() == 0) {
+	if (upsert && GetAffectedRows(writer) == 0) {
 		lock.unlock();
 
 		DbQueryType to = DbQueryInsert;
-		InternalExecuteQuery(query, &to);
+		InternalExecuteQuery(writer, query, &to, deferred);
 
 		return;
 	}
@@ -706,41 +1228,165 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 			SetStatusUpdate(query.Object, true);
 
 		if (type == DbQueryInsert && query.ConfigUpdate)
-			SetInsertID(query.Object, GetLastInsertID());
+			SetInsertID(query.Object, GetLastInsertID(writer));
 	}
 
 	if (type == DbQueryInsert && query.Table == "notifications" && query.NotificationObject) { // FIXME remove hardcoded table name
-		SetNotificationInsertID(query.NotificationObject, GetLastInsertID());
+		SetNotificationInsertID(query.NotificationObject, GetLastInsertID(writer));
 		Log(LogDebug, "IdoMysqlConnection")
-		    << "saving contactnotification notification_id=" << static_cast<long>(GetLastInsertID());
+		    << "saving contactnotification notification_id=" << static_cast<long>(GetLastInsertID(writer));
+	}
+}
+
+/**
+ * Collects rows for insert-only history tables and status upserts into
+ * multi-row INSERT statements which are written when the current transaction
+ * is committed. Status upserts become INSERT ... ON DUPLICATE KEY UPDATE.
+ *
+ * Caller must hold writer->Mutex.
+ *
+ * @returns true if the query was handled, false if it has to be executed on its own.
+ */
+bool IdoMysqlConnection::BatchQuery(const IdoMysqlWriter::Ptr& writer, const DbQuery& query, int type)
+{
+	bool upsert = (type == (DbQueryInsert | DbQueryUpdate) && IsStatusTable(query.Table));
+
+	if (!upsert && (type != DbQueryInsert || !IsHistoryTable(query.Table) ||
+	    query.ConfigUpdate || query.NotificationObject))
+		return false;
+
+	std::ostringstream colbuf, valbuf, updbuf;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		bool first = true;
+		BOOST_FOREACH(const Dictionary::Pair& kv, query.Fields) {
+			Value value;
+
+			if (kv.second.IsEmpty())
+				continue;
+
+			if (!FieldToEscapedString(writer, kv.first, kv.second, &value))
+				return true;
+
+			if (!first) {
+				colbuf << ", ";
+				valbuf << ", ";
+				updbuf << ", ";
+			}
+
+			colbuf << kv.first;
+			valbuf << value;
+			updbuf << kv.first << " = VALUES(" << kv.first << ")";
+
+			if (first)
+				first = false;
+		}
+	}
+
+	String header = "INSERT INTO " + GetTablePrefix() + query.Table + " (" + colbuf.str() + ") VALUES ";
+	String suffix;
+
+	if (upsert)
+		suffix = " ON DUPLICATE KEY UPDATE " + updbuf.str();
+
+	/* There's only one pending batch per table. Rows with a different
+	 * column list (e.g. because of empty fields) start a new batch after
+	 * the current one has been written, which keeps the rows in order. */
+	std::map<String, IdoMysqlInsertBatch>::iterator it = writer->InsertBatches.find(query.Table);
+
+	if (it != writer->InsertBatches.end() && (it->second.Header != header || it->second.Suffix != suffix))
+		FlushInsertBatches(writer, query.Table);
+
+	IdoMysqlInsertBatch& batch = writer->InsertBatches[query.Table];
+
+	if (batch.Rows.empty()) {
+		batch.Table = query.Table;
+		batch.Header = header;
+		batch.Suffix = suffix;
+	}
+
+	String row = "(" + valbuf.str() + ")";
+	batch.Rows.push_back(row);
+	batch.Size += row.GetLength() + 2;
+
+	if (upsert && query.Object && query.StatusUpdate)
+		SetStatusUpdate(query.Object, true);
+
+	if (batch.Rows.size() >= l_MaxBatchRows || batch.Size >= l_MaxBatchSize)
+		FlushInsertBatches(writer, query.Table);
+
+	return true;
+}
+
+/* caller must hold writer->Mutex */
+void IdoMysqlConnection::FlushInsertBatches(const IdoMysqlWriter::Ptr& writer, const String& table)
+{
+	std::map<String, IdoMysqlInsertBatch>::iterator it = writer->InsertBatches.begin();
+
+	while (it != writer->InsertBatches.end()) {
+		if (!table.IsEmpty() && it->second.Table != table) {
+			it++;
+			continue;
+		}
+
+		std::ostringstream qbuf;
+		qbuf << it->second.Header;
+
+		bool first = true;
+		BOOST_FOREACH(const String& row, it->second.Rows) {
+			if (!first)
+				qbuf << ", ";
+
+			qbuf << row;
+
+			if (first)
+				first = false;
+		}
+
+		qbuf << it->second.Suffix;
+
+		/* Remove the batch first so that a failing query doesn't leave it behind. */
+		writer->InsertBatches.erase(it++);
+
+		Query(writer, qbuf.str());
 	}
 }
 
 void IdoMysqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
 {
-	m_QueryQueue.Enqueue(boost::bind(&IdoMysqlConnection::InternalCleanUpExecuteQuery, this, table, time_column, max_age), true);
+	m_Writers[0]->Queue.Enqueue(boost::bind(&IdoMysqlConnection::InternalCleanUpExecuteQuery, this, table, time_column, max_age), true);
 }
 
 void IdoMysqlConnection::InternalCleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
 {
-	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
+
+	boost::mutex::scoped_lock lock(primary->Mutex);
 
-	if (!m_Connected)
+	if (!primary->Connected)
 		return;
 
-	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
+	FlushInsertBatches(primary, table);
+
+	Query(primary, "DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
 	    Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
 	    " < FROM_UNIXTIME(" + Convert::ToString(static_cast<long>(max_age)) + ")");
 }
 
 void IdoMysqlConnection::FillIDCache(const DbType::Ptr& type)
 {
-	String query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id FROM " + GetTablePrefix() + type->GetTable() + "s";
-	IdoMysqlResult result = Query(query);
+	IdoMysqlWriter::Ptr primary = m_Writers[0];
+
+	String query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id, config_hash FROM " + GetTablePrefix() + type->GetTable() + "s";
+	IdoMysqlResult result = Query(primary, query);
 
 	Dictionary::Ptr row;
 
 	while ((row = FetchRow(result))) {
-		SetInsertID(type, DbReference(row->Get("object_id")), DbReference(row->Get(type->GetTable() + "_id")));
+		DbReference objid(row->Get("object_id"));
+		SetInsertID(type, objid, DbReference(row->Get(type->GetTable() + "_id")));
+		SetConfigHash(type, objid, row->Get("config_hash"));
 	}
 }
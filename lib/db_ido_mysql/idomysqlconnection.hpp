@@ -17,6 +17,7 @@
  * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
  ******************************************************************************/
 
+
 #ifndef IDOMYSQLCONNECTION_H
 #define IDOMYSQLCONNECTION_H
 
@@ -25,12 +26,62 @@
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
 #include <mysql.h>
+#include <deque>
+#include <set>
 
 namespace icinga
 {
 
 typedef shared_ptr<MYSQL_RES> IdoMysqlResult;
 
+/**
+ * Rows for a multi-row INSERT statement.
+ *
+ * @ingroup ido
+ */
+struct IdoMysqlInsertBatch
+{
+	String Table;
+	String Header;
+	String Suffix;
+	std::vector<String> Rows;
+	size_t Size;
+
+	IdoMysqlInsertBatch(void)
+		: Size(0)
+	{ }
+};
+
+/**
+ * A single MySQL connection of an IdoMysqlConnection together with the
+ * work queue which is the only thread using it.
+ *
+ * @ingroup ido
+ */
+class IdoMysqlWriter : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(IdoMysqlWriter);
+
+	IdoMysqlWriter(void)
+		: Connected(false), AffectedRows(0)
+	{ }
+
+	WorkQueue Queue;
+
+	boost::mutex Mutex;
+	bool Connected;
+	MYSQL Connection;
+	int AffectedRows;
+
+	std::map<String, IdoMysqlInsertBatch> InsertBatches; /* keyed by table */
+	std::map<String, MYSQL_STMT *> Statements;
+
+	/* queries which wait for the primary connection to activate an object
+	 * or for this writer to reconnect; they're executed in order */
+	std::deque<DbQuery> DeferredQueries;
+};
+
 /**
  * An IDO MySQL database connection.
  *
@@ -45,53 +96,75 @@ public:
 	static Value StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
 protected:
+	virtual void OnConfigLoaded(void);
 	virtual void Resume(void);
 	virtual void Pause(void);
 
 	virtual void ActivateObject(const DbObject::Ptr& dbobj);
 	virtual void DeactivateObject(const DbObject::Ptr& dbobj);
 	virtual void ExecuteQuery(const DbQuery& query);
+	virtual size_t GetPendingQueryCount(void);
 	virtual void CleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
 	virtual void FillIDCache(const DbType::Ptr& type);
 
 private:
 	DbReference m_InstanceID;
 
-	WorkQueue m_QueryQueue;
+	/* m_Writers[0] is the primary connection; it handles config, object activation and reconnects. */
+	std::vector<IdoMysqlWriter::Ptr> m_Writers;
 
-	boost::mutex m_ConnectionMutex;
-	bool m_Connected;
-	MYSQL m_Connection;
-	int m_AffectedRows;
+	/* objects which are waiting to be activated by the primary connection */
+	boost::mutex m_ActivationMutex;
+	std::set<DbObject::Ptr> m_PendingActivations;
+	bool m_WritersSuspended; /* protected by m_ActivationMutex */
 
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
 
-	IdoMysqlResult Query(const String& query);
-	DbReference GetLastInsertID(void);
-	int GetAffectedRows(void);
-	String Escape(const String& s);
+	IdoMysqlResult Query(const IdoMysqlWriter::Ptr& writer, const String& query);
+	DbReference GetLastInsertID(const IdoMysqlWriter::Ptr& writer);
+	int GetAffectedRows(const IdoMysqlWriter::Ptr& writer);
+	String Escape(const IdoMysqlWriter::Ptr& writer, const String& s);
 	Dictionary::Ptr FetchRow(const IdoMysqlResult& result);
 	void DiscardRows(const IdoMysqlResult& result);
 
-	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
+	bool FieldToEscapedString(const IdoMysqlWriter::Ptr& writer, const String& key, const Value& value, Value *result);
+	bool FieldToParameter(const IdoMysqlWriter::Ptr& writer, const String& key, const Value& value,
+	    String *expr, std::vector<String>& params);
+	void ExecutePrepared(const IdoMysqlWriter::Ptr& writer, const String& query, const std::vector<String>& params);
+	void ClearStatements(const IdoMysqlWriter::Ptr& writer);
 	void InternalActivateObject(const DbObject::Ptr& dbobj);
-
-	void Disconnect(void);
-	void NewTransaction(void);
+	std::vector<DbObject::Ptr> GetUnresolvedObjects(const DbQuery& query) const;
+	bool HasPendingActivation(const DbQuery& query);
+	void ActivateObjectForWriters(const DbObject::Ptr& dbobj);
+	void ResumeDeferredQueries(const IdoMysqlWriter::Ptr& writer);
+
+	void Connect(const IdoMysqlWriter::Ptr& writer);
+	void Disconnect(const IdoMysqlWriter::Ptr& writer);
+	void NewTransaction(const IdoMysqlWriter::Ptr& writer);
 	void Reconnect(void);
+	bool ConnectPrimary(bool reconnect, std::vector<DbObject::Ptr>& active_dbobjs);
+	void SuspendWriters(void);
+	void ResumeWriters(void);
+	bool AreWritersSuspended(void);
+	void ReconnectWriter(const IdoMysqlWriter::Ptr& writer);
 
-	void AssertOnWorkQueue(void);
+	void AssertOnWorkQueue(const IdoMysqlWriter::Ptr& writer);
 
 	void TxTimerHandler(void);
 	void ReconnectTimerHandler(void);
 
-	void InternalExecuteQuery(const DbQuery& query, DbQueryType *typeOverride = NULL);
+	IdoMysqlWriter::Ptr GetWriter(const DbQuery& query) const;
+
+	void InternalExecuteQuery(const IdoMysqlWriter::Ptr& writer, const DbQuery& query,
+	    DbQueryType *typeOverride = NULL, bool deferred = false);
+	bool BatchQuery(const IdoMysqlWriter::Ptr& writer, const DbQuery& query, int type);
+	void FlushInsertBatches(const IdoMysqlWriter::Ptr& writer, const String& table = String());
 	void InternalCleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
 
 	virtual void ClearConfigTable(const String& table);
 
-	void ExceptionHandler(boost::exception_ptr exp);
+	void ExceptionHandler(const IdoMysqlWriter::Ptr& writer, boost::exception_ptr exp);
 };
 
 }
@@ -54,6 +54,7 @@ CREATE TABLE IF NOT EXISTS icinga_commands (
   config_type smallint default 0,
   object_id bigint unsigned default 0,
   command_line TEXT character set latin1  default '',
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (command_id),
   UNIQUE KEY instance_id (instance_id,object_id,config_type)
 ) ENGINE=InnoDB  COMMENT='Command definitions';
@@ -179,6 +180,7 @@ CREATE TABLE IF NOT EXISTS icinga_contactgroups (
   config_type smallint default 0,
   contactgroup_object_id bigint unsigned default 0,
   alias TEXT character set latin1  default '',
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (contactgroup_id),
   UNIQUE KEY instance_id (instance_id,config_type,contactgroup_object_id)
 ) ENGINE=InnoDB  COMMENT='Contactgroup definitions';
@@ -266,6 +268,7 @@ CREATE TABLE IF NOT EXISTS icinga_contacts (
   notify_host_unreachable smallint default 0,
   notify_host_flapping smallint default 0,
   notify_host_downtime smallint default 0,
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (contact_id),
   UNIQUE KEY instance_id (instance_id,config_type,contact_object_id)
 ) ENGINE=InnoDB  COMMENT='Contact definitions';
@@ -603,6 +606,7 @@ CREATE TABLE IF NOT EXISTS icinga_hostgroups (
   notes TEXT character set latin1  default NULL,
   notes_url TEXT character set latin1  default NULL,
   action_url TEXT character set latin1  default NULL,
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (hostgroup_id),
   UNIQUE KEY instance_id (instance_id,hostgroup_object_id)
 ) ENGINE=InnoDB  COMMENT='Hostgroup definitions';
@@ -687,6 +691,7 @@ CREATE TABLE IF NOT EXISTS icinga_hosts (
   x_3d double  default '0',
   y_3d double  default '0',
   z_3d double  default '0',
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (host_id),
   UNIQUE KEY instance_id (instance_id,config_type,host_object_id),
   KEY host_object_id (host_object_id)
@@ -1095,6 +1100,7 @@ CREATE TABLE IF NOT EXISTS icinga_servicegroups (
   notes TEXT character set latin1  default NULL,
   notes_url TEXT character set latin1  default NULL,
   action_url TEXT character set latin1  default NULL,
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (servicegroup_id),
   UNIQUE KEY instance_id (instance_id,config_type,servicegroup_object_id)
 ) ENGINE=InnoDB  COMMENT='Servicegroup definitions';
@@ -1172,6 +1178,7 @@ CREATE TABLE IF NOT EXISTS icinga_services (
   action_url TEXT character set latin1  default '',
   icon_image TEXT character set latin1  default '',
   icon_image_alt TEXT character set latin1  default '',
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (service_id),
   UNIQUE KEY instance_id (instance_id,config_type,service_object_id),
   KEY service_object_id (service_object_id)
@@ -1327,6 +1334,7 @@ CREATE TABLE IF NOT EXISTS icinga_timeperiods (
   config_type smallint default 0,
   timeperiod_object_id bigint unsigned default 0,
   alias TEXT character set latin1  default '',
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (timeperiod_id),
   UNIQUE KEY instance_id (instance_id,config_type,timeperiod_object_id)
 ) ENGINE=InnoDB  COMMENT='Timeperiod definitions';
@@ -1363,6 +1371,7 @@ CREATE TABLE IF NOT EXISTS icinga_endpoints (
   config_type smallint(6) DEFAULT '0',
   identity varchar(255) DEFAULT NULL,
   node varchar(255) DEFAULT NULL,
+  config_hash varchar(64) character set latin1 default NULL,
   PRIMARY KEY  (endpoint_id)
 ) ENGINE=InnoDB COMMENT='Endpoint configuration';
 
@@ -1480,6 +1489,19 @@ CREATE INDEX serviceesc_cgroups_i_id_idx on icinga_serviceescalation_contactgrou
 -- more index stuff (WHERE clauses)
 -- -----------------------------------------
 
+-- config dump (per object)
+CREATE INDEX tp_timeranges_tp_id_idx on icinga_timeperiod_timeranges(timeperiod_id);
+CREATE INDEX cgroup_members_cgroup_id_idx on icinga_contactgroup_members(contactgroup_id);
+CREATE INDEX hgroup_members_hgroup_id_idx on icinga_hostgroup_members(hostgroup_id);
+CREATE INDEX sgroup_members_sgroup_id_idx on icinga_servicegroup_members(servicegroup_id);
+CREATE INDEX host_parenthosts_host_id_idx on icinga_host_parenthosts(host_id);
+CREATE INDEX host_contacts_host_id_idx on icinga_host_contacts(host_id);
+CREATE INDEX host_cgroups_host_id_idx on icinga_host_contactgroups(host_id);
+CREATE INDEX hostdep_dep_host_obj_id_idx on icinga_hostdependencies(dependent_host_object_id);
+CREATE INDEX service_contacts_service_id_idx on icinga_service_contacts(service_id);
+CREATE INDEX service_cgroups_service_id_idx on icinga_service_contactgroups(service_id);
+CREATE INDEX servicedep_dep_svc_obj_id_idx on icinga_servicedependencies(dependent_service_object_id);
+
 -- hosts
 CREATE INDEX hosts_host_object_id_idx on icinga_hosts(host_object_id);
 
@@ -1601,6 +1623,6 @@ CREATE INDEX commenthistory_delete_idx ON icinga_commenthistory (instance_id, co
 -- -----------------------------------------
 -- set dbversion
 -- -----------------------------------------
-INSERT INTO icinga_dbversion (name, version, create_time, modify_time) VALUES ('idoutils', '1.12.0', NOW(), NOW()) ON DUPLICATE KEY UPDATE version='1.12.0', modify_time=NOW();
+INSERT INTO icinga_dbversion (name, version, create_time, modify_time) VALUES ('idoutils', '1.13.0', NOW(), NOW()) ON DUPLICATE KEY UPDATE version='1.13.0', modify_time=NOW();
 
 
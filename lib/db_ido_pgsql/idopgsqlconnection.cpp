@@ -35,12 +35,27 @@
 
 using namespace icinga;
 
-#define SCHEMA_VERSION "1.12.0"
+#define SCHEMA_VERSION "1.13.0"
 
 REGISTER_TYPE(IdoPgsqlConnection);
 
 REGISTER_STATSFUNCTION(IdoPgsqlConnectionStats, &IdoPgsqlConnection::StatsFunc);
 
+/* Limits for a single multi-row INSERT. */
+static const size_t l_MaxBatchRows = 500;
+static const size_t l_MaxBatchSize = 512 * 1024;
+
+/* Upper bound for the number of distinct prepared statements kept per connection. */
+static const size_t l_MaxStatements = 256;
+
+/* Insert-only history tables whose rows can be collected into multi-row INSERTs. */
+static bool IsHistoryTable(const String& table)
+{
+	return (table == "statehistory" || table == "logentries" || table == "servicechecks" ||
+	    table == "hostchecks" || table == "eventhandlers" || table == "flappinghistory" ||
+	    table == "externalcommands" || table == "processevents" || table == "systemcommands");
+}
+
 Value IdoPgsqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
@@ -68,6 +83,7 @@ void IdoPgsqlConnection::Resume(void)
 	DbConnection::Resume();
 
 	m_Connection = NULL;
+	m_StatementCounter = 0;
 
 	m_QueryQueue.SetExceptionCallback(boost::bind(&IdoPgsqlConnection::ExceptionHandler, this, _1));
 
@@ -108,6 +124,9 @@ void IdoPgsqlConnection::ExceptionHandler(boost::exception_ptr exp)
 		PQfinish(m_Connection);
 		m_Connection = NULL;
 	}
+
+	m_InsertBatches.clear();
+	m_Statements.clear();
 }
 
 void IdoPgsqlConnection::AssertOnWorkQueue(void)
@@ -124,8 +143,10 @@ void IdoPgsqlConnection::Disconnect(void)
 	if (!m_Connection)
 		return;
 
+	FlushInsertBatches();
 	Query("COMMIT");
 	PQfinish(m_Connection);
+	m_Statements.clear();
 
 	m_Connection = NULL;
 }
@@ -142,6 +163,7 @@ void IdoPgsqlConnection::NewTransaction(void)
 	if (!m_Connection)
 		return;
 
+	FlushInsertBatches();
 	Query("COMMIT");
 	Query("BEGIN");
 }
@@ -177,6 +199,8 @@ void IdoPgsqlConnection::Reconnect(void)
 		}
 
 		ClearIDCache();
+		m_InsertBatches.clear();
+		m_Statements.clear();
 
 		String ihost, iport, iuser, ipasswd, idb;
 		const char *host, *port, *user , *passwd, *db;
@@ -506,6 +530,13 @@ void IdoPgsqlConnection::DeactivateObject(const DbObject::Ptr& dbobj)
 	qbuf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 0 WHERE object_id = " << static_cast<long>(dbref);
 	Query(qbuf.str());
 
+	/* the relation and custom variable rows aren't cleared by PrepareDatabase() */
+	BOOST_FOREACH(const String& query, GetDeletedObjectQueries(dbobj)) {
+		Query(query);
+	}
+
+	SetConfigHash(dbobj, String());
+
 	/* Note that we're _NOT_ clearing the db refs via SetReference/SetConfigUpdate/SetStatusUpdate
 	 * because the object is still in the database. */
 }
@@ -566,6 +597,114 @@ bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& va
 	return true;
 }
 
+/**
+ * Like FieldToEscapedString() but for prepared statements: *expr receives the
+ * SQL expression for the field and the value to bind (if any) is appended to params.
+ *
+ * Caller must hold m_ConnectionMutex.
+ */
+bool IdoPgsqlConnection::FieldToParameter(const String& key, const Value& value, String *expr, std::vector<String>& params)
+{
+	Value rawvalue = DbValue::ExtractValue(value);
+
+	if (DbValue::IsTimestamp(value)) {
+		params.push_back(Convert::ToString(static_cast<long>(rawvalue)));
+		*expr = "TO_TIMESTAMP($" + Convert::ToString(params.size()) + ")";
+	} else if (DbValue::IsTimestampNow(value)) {
+		*expr = "NOW()";
+	} else if (key == "instance_id" || key == "notification_id" || rawvalue.IsObjectType<DynamicObject>()) {
+		Value id;
+
+		if (!FieldToEscapedString(key, value, &id))
+			return false;
+
+		params.push_back(id);
+		*expr = "$" + Convert::ToString(params.size());
+	} else {
+		params.push_back(rawvalue);
+		*expr = "$" + Convert::ToString(params.size());
+	}
+
+	return true;
+}
+
+/**
+ * Executes a statement with $n placeholders. Statements are prepared once
+ * per distinct query text and connection and reused afterwards.
+ */
+void IdoPgsqlConnection::ExecutePrepared(const String& query, const std::vector<String>& params)
+{
+	AssertOnWorkQueue();
+
+	Log(LogDebug, "IdoPgsqlConnection")
+	    << "Prepared query: " << query;
+
+	String name;
+	std::map<String, String>::const_iterator it = m_Statements.find(query);
+
+	if (it != m_Statements.end()) {
+		name = it->second;
+	} else {
+		if (m_Statements.size() >= l_MaxStatements) {
+			Query("DEALLOCATE ALL");
+			m_Statements.clear();
+		}
+
+		name = "icinga_stmt_" + Convert::ToString(m_StatementCounter++);
+
+		PGresult *result = PQprepare(m_Connection, name.CStr(), query.CStr(), params.size(), NULL);
+
+		if (!result || PQresultStatus(result) != PGRES_COMMAND_OK) {
+			String message = result ? PQresultErrorMessage(result) : PQerrorMessage(m_Connection);
+
+			if (result)
+				PQclear(result);
+
+			Log(LogCritical, "IdoPgsqlConnection")
+			    << "Error \"" << message << "\" when preparing query \"" << query << "\"";
+
+			BOOST_THROW_EXCEPTION(
+			    database_error()
+				<< errinfo_message(message)
+				<< errinfo_database_query(query)
+			);
+		}
+
+		PQclear(result);
+
+		m_Statements[query] = name;
+	}
+
+	std::vector<const char *> values;
+	values.reserve(params.size());
+
+	BOOST_FOREACH(const String& param, params) {
+		values.push_back(param.CStr());
+	}
+
+	PGresult *result = PQexecPrepared(m_Connection, name.CStr(), values.size(),
+	    values.empty() ? NULL : &values[0], NULL, NULL, 0);
+
+	if (!result || PQresultStatus(result) != PGRES_COMMAND_OK) {
+		String message = result ? PQresultErrorMessage(result) : PQerrorMessage(m_Connection);
+
+		if (result)
+			PQclear(result);
+
+		Log(LogCritical, "IdoPgsqlConnection")
+		    << "Error \"" << message << "\" when executing query \"" << query << "\"";
+
+		BOOST_THROW_EXCEPTION(
+		    database_error()
+			<< errinfo_message(message)
+			<< errinfo_database_query(query)
+		);
+	}
+
+	m_AffectedRows = atoi(PQcmdTuples(result));
+	PQclear(result);
+}
+
 void IdoPgsqlConnection::ExecuteQuery(const DbQuery& query)
 {
 	ASSERT(query.Category != DbCatInvalid);
@@ -573,6 +712,11 @@ void IdoPgsqlConnection::ExecuteQuery(const DbQuery& query)
 	m_QueryQueue.Enqueue(boost::bind(&IdoPgsqlConnection::InternalExecuteQuery, this, query, (DbQueryType *)NULL), true);
 }
 
+size_t IdoPgsqlConnection::GetPendingQueryCount(void)
+{
+	return m_QueryQueue.GetLength();
+}
+
 void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType *typeOverride)
 {
 	boost::mutex::scoped_lock lock(m_ConnectionMutex);
@@ -584,30 +728,14 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 		return;
 
 	std::ostringstream qbuf, where;
-	int type;
-
-	if (query.WhereCriteria) {
-		where << " WHERE ";
-
-		ObjectLock olock(query.WhereCriteria);
-		Value value;
-		bool first = true;
-
-		BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
-			if (!FieldToEscapedString(kv.first, kv.second, &value))
-				return;
-
-			if (!first)
-				where << " AND ";
+	std::vector<String> params;
+	int type = typeOverride ? *typeOverride : query.Type;
 
-			where << kv.first << " = " << value;
-
-			if (first)
-				first = false;
-		}
-	}
+	if (BatchQuery(query, type))
+		return;
 
-	type = typeOverride ? *typeOverride : query.Type;
+	/* Pending rows for this table have to be written before it is modified otherwise. */
+	FlushInsertBatches(query.Table);
 
 	bool upsert = false;
 
@@ -648,13 +776,13 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 
 		ObjectLock olock(query.Fields);
 
-		Value value;
+		String value;
 		bool first = true;
 		BOOST_FOREACH(const Dictionary::Pair& kv, query.Fields) {
 			if (kv.second.IsEmpty())
 				continue;
 
-			if (!FieldToEscapedString(kv.first, kv.second, &value))
+			if (!FieldToParameter(kv.first, kv.second, &value, params))
 				return;
 
 			if (type == DbQueryInsert) {
@@ -680,10 +808,32 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 			qbuf << " (" << colbuf.str() << ") VALUES (" << valbuf.str() << ")";
 	}
 
-	if (type != DbQueryInsert)
+	if (type != DbQueryInsert) {
+		if (query.WhereCriteria) {
+			where << " WHERE ";
+
+			ObjectLock olock(query.WhereCriteria);
+			String expr;
+			bool first = true;
+
+			BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
+				if (!FieldToParameter(kv.first, kv.second, &expr, params))
+					return;
+
+				if (!first)
+					where << " AND ";
+
+				where << kv.first << " = " << expr;
+
+				if (first)
+					first = false;
+			}
+		}
+
 		qbuf << where.str();
+	}
 
-	Query(qbuf.str());
+	ExecutePrepared(qbuf.str(), params);
 
 	if (upsert && GetAffectedRows() == 0) {
 		lock.unlock();
@@ -719,6 +869,102 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 	}
 }
 
+/**
+ * Collects rows for insert-only history tables into multi-row INSERT
+ * statements which are written when the current transaction is committed.
+ *
+ * Caller must hold m_ConnectionMutex.
+ *
+ * @returns true if the query was handled, false if it has to be executed on its own.
+ */
+bool IdoPgsqlConnection::BatchQuery(const DbQuery& query, int type)
+{
+	if (type != DbQueryInsert || !IsHistoryTable(query.Table) || query.ConfigUpdate || query.NotificationObject)
+		return false;
+
+	std::ostringstream colbuf, valbuf;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		Value value;
+		bool first = true;
+		BOOST_FOREACH(const Dictionary::Pair& kv, query.Fields) {
+			if (kv.second.IsEmpty())
+				continue;
+
+			if (!FieldToEscapedString(kv.first, kv.second, &value))
+				return true;
+
+			if (!first) {
+				colbuf << ", ";
+				valbuf << ", ";
+			}
+
+			colbuf << kv.first;
+			valbuf << value;
+
+			if (first)
+				first = false;
+		}
+	}
+
+	String header = "INSERT INTO " + GetTablePrefix() + query.Table + " (" + colbuf.str() + ") VALUES ";
+
+	/* There's only one pending batch per table. Rows with a different
+	 * column list (e.g. because of empty fields) start a new batch after
+	 * the current one has been written, which keeps the rows in order. */
+	std::map<String, InsertBatch>::iterator it = m_InsertBatches.find(query.Table);
+
+	if (it != m_InsertBatches.end() && it->second.Header != header)
+		FlushInsertBatches(query.Table);
+
+	InsertBatch& batch = m_InsertBatches[query.Table];
+	batch.Table = query.Table;
+	batch.Header = header;
+
+	String row = "(" + valbuf.str() + ")";
+	batch.Rows.push_back(row);
+	batch.Size += row.GetLength() + 2;
+
+	if (batch.Rows.size() >= l_MaxBatchRows || batch.Size >= l_MaxBatchSize)
+		FlushInsertBatches(query.Table);
+
+	return true;
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoPgsqlConnection::FlushInsertBatches(const String& table)
+{
+	std::map<String, InsertBatch>::iterator it = m_InsertBatches.begin();
+
+	while (it != m_InsertBatches.end()) {
+		if (!table.IsEmpty() && it->second.Table != table) {
+			it++;
+			continue;
+		}
+
+		std::ostringstream qbuf;
+		qbuf << it->second.Header;
+
+		bool first = true;
+		BOOST_FOREACH(const String& row, it->second.Rows) {
+			if (!first)
+				qbuf << ", ";
+
+			qbuf << row;
+
+			if (first)
+				first = false;
+		}
+
+		/* Remove the batch first so that a failing query doesn't leave it behind. */
+		m_InsertBatches.erase(it++);
+
+		Query(qbuf.str());
+	}
+}
+
 void IdoPgsqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
 {
 	m_QueryQueue.Enqueue(boost::bind(&IdoPgsqlConnection::InternalCleanUpExecuteQuery, this, table, time_column, max_age), true);
@@ -731,6 +977,8 @@ void IdoPgsqlConnection::InternalCleanUpExecuteQuery(const String& table, const
 	if (!m_Connection)
 		return;
 
+	FlushInsertBatches(table);
+
 	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
 	    Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
 	    " < TO_TIMESTAMP(" + Convert::ToString(static_cast<long>(max_age)) + ")");
@@ -738,7 +986,7 @@ void IdoPgsqlConnection::InternalCleanUpExecuteQuery(const String& table, const
 
 void IdoPgsqlConnection::FillIDCache(const DbType::Ptr& type)
 {
-	String query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id FROM " + GetTablePrefix() + type->GetTable() + "s";
+	String query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id, config_hash FROM " + GetTablePrefix() + type->GetTable() + "s";
 	IdoPgsqlResult result = Query(query);
 
 	Dictionary::Ptr row;
@@ -746,6 +994,8 @@ void IdoPgsqlConnection::FillIDCache(const DbType::Ptr& type)
 	int index = 0;
 	while ((row = FetchRow(result, index))) {
 		index++;
-		SetInsertID(type, DbReference(row->Get("object_id")), DbReference(row->Get(type->GetTable() + "_id")));
+		DbReference objid(row->Get("object_id"));
+		SetInsertID(type, objid, DbReference(row->Get(type->GetTable() + "_id")));
+		SetConfigHash(type, objid, row->Get("config_hash"));
 	}
 }
@@ -51,6 +51,7 @@ protected:
 	virtual void ActivateObject(const DbObject::Ptr& dbobj);
 	virtual void DeactivateObject(const DbObject::Ptr& dbobj);
 	virtual void ExecuteQuery(const DbQuery& query);
+	virtual size_t GetPendingQueryCount(void);
 	virtual void CleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
 	virtual void FillIDCache(const DbType::Ptr& type);
 
@@ -66,6 +67,23 @@ private:
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
 
+	struct InsertBatch
+	{
+		String Table;
+		String Header;
+		std::vector<String> Rows;
+		size_t Size;
+
+		InsertBatch(void)
+			: Size(0)
+		{ }
+	};
+
+	std::map<String, InsertBatch> m_InsertBatches; /* keyed by table */
+
+	std::map<String, String> m_Statements;
+	int m_StatementCounter;
+
 	IdoPgsqlResult Query(const String& query);
 	DbReference GetSequenceValue(const String& table, const String& column);
 	int GetAffectedRows(void);
@@ -73,6 +91,8 @@ private:
 	Dictionary::Ptr FetchRow(const IdoPgsqlResult& result, int row);
 
 	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
+	bool FieldToParameter(const String& key, const Value& value, String *expr, std::vector<String>& params);
+	void ExecutePrepared(const String& query, const std::vector<String>& params);
 	void InternalActivateObject(const DbObject::Ptr& dbobj);
 
 	void Disconnect(void);
@@ -85,6 +105,8 @@ private:
 	void ReconnectTimerHandler(void);
 
 	void InternalExecuteQuery(const DbQuery& query, DbQueryType *typeOverride = NULL);
+	bool BatchQuery(const DbQuery& query, int type);
+	void FlushInsertBatches(const String& table = String());
 	void InternalCleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
 
 	virtual void ClearConfigTable(const String& table);
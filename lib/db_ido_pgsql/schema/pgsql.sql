@@ -80,6 +80,7 @@ CREATE TABLE  icinga_commands (
   config_type INTEGER  default 0,
   object_id bigint default 0,
   command_line TEXT  default '',
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_command_id PRIMARY KEY (command_id) ,
   CONSTRAINT UQ_commands UNIQUE (instance_id,object_id,config_type)
 ) ;
@@ -205,6 +206,7 @@ CREATE TABLE  icinga_contactgroups (
   config_type INTEGER  default 0,
   contactgroup_object_id bigint default 0,
   alias TEXT  default '',
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_contactgroup_id PRIMARY KEY (contactgroup_id) ,
   CONSTRAINT UQ_contactgroups UNIQUE (instance_id,config_type,contactgroup_object_id)
 );
@@ -292,6 +294,7 @@ CREATE TABLE  icinga_contacts (
   notify_host_unreachable INTEGER  default 0,
   notify_host_flapping INTEGER  default 0,
   notify_host_downtime INTEGER  default 0,
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_contact_id PRIMARY KEY (contact_id) ,
   CONSTRAINT UQ_contacts UNIQUE (instance_id,config_type,contact_object_id)
 ) ;
@@ -630,6 +633,7 @@ CREATE TABLE  icinga_hostgroups (
   notes TEXT  default NULL,
   notes_url TEXT  default NULL,
   action_url TEXT  default NULL,
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_hostgroup_id PRIMARY KEY (hostgroup_id) ,
   CONSTRAINT UQ_hostgroups UNIQUE (instance_id,hostgroup_object_id)
 ) ;
@@ -714,6 +718,7 @@ CREATE TABLE  icinga_hosts (
   x_3d double precision  default 0,
   y_3d double precision  default 0,
   z_3d double precision  default 0,
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_host_id PRIMARY KEY (host_id) ,
   CONSTRAINT UQ_hosts UNIQUE (instance_id,config_type,host_object_id)
 ) ;
@@ -1122,6 +1127,7 @@ CREATE TABLE  icinga_servicegroups (
   notes TEXT  default NULL,
   notes_url TEXT  default NULL,
   action_url TEXT  default NULL,
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_servicegroup_id PRIMARY KEY (servicegroup_id) ,
   CONSTRAINT UQ_servicegroups UNIQUE (instance_id,config_type,servicegroup_object_id)
 ) ;
@@ -1199,6 +1205,7 @@ CREATE TABLE  icinga_services (
   action_url TEXT  default '',
   icon_image TEXT  default '',
   icon_image_alt TEXT  default '',
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_service_id PRIMARY KEY (service_id) ,
   CONSTRAINT UQ_services UNIQUE (instance_id,config_type,service_object_id)
 ) ;
@@ -1353,6 +1360,7 @@ CREATE TABLE  icinga_timeperiods (
   config_type INTEGER  default 0,
   timeperiod_object_id bigint default 0,
   alias TEXT  default '',
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_timeperiod_id PRIMARY KEY (timeperiod_id) ,
   CONSTRAINT UQ_timeperiods UNIQUE (instance_id,config_type,timeperiod_object_id)
 ) ;
@@ -1389,6 +1397,7 @@ CREATE TABLE  icinga_endpoints (
   config_type integer default 0,
   identity text DEFAULT NULL,
   node text DEFAULT NULL,
+  config_hash varchar(64) default NULL,
   CONSTRAINT PK_endpoint_id PRIMARY KEY (endpoint_id) ,
   CONSTRAINT UQ_endpoints UNIQUE (instance_id,config_type,endpoint_object_id)
 ) ;
@@ -1510,6 +1519,19 @@ CREATE INDEX serviceesc_cgroups_i_id_idx on icinga_serviceescalation_contactgrou
 -- more index stuff (WHERE clauses)
 -- -----------------------------------------
 
+-- config dump (per object)
+CREATE INDEX tp_timeranges_tp_id_idx on icinga_timeperiod_timeranges(timeperiod_id);
+CREATE INDEX cgroup_members_cgroup_id_idx on icinga_contactgroup_members(contactgroup_id);
+CREATE INDEX hgroup_members_hgroup_id_idx on icinga_hostgroup_members(hostgroup_id);
+CREATE INDEX sgroup_members_sgroup_id_idx on icinga_servicegroup_members(servicegroup_id);
+CREATE INDEX host_parenthosts_host_id_idx on icinga_host_parenthosts(host_id);
+CREATE INDEX host_contacts_host_id_idx on icinga_host_contacts(host_id);
+CREATE INDEX host_cgroups_host_id_idx on icinga_host_contactgroups(host_id);
+CREATE INDEX hostdep_dep_host_obj_id_idx on icinga_hostdependencies(dependent_host_object_id);
+CREATE INDEX service_contacts_service_id_idx on icinga_service_contacts(service_id);
+CREATE INDEX service_cgroups_service_id_idx on icinga_service_contactgroups(service_id);
+CREATE INDEX servicedep_dep_svc_obj_id_idx on icinga_servicedependencies(dependent_service_object_id);
+
 -- hosts
 CREATE INDEX hosts_host_object_id_idx on icinga_hosts(host_object_id);
 
@@ -1631,5 +1653,5 @@ CREATE INDEX commenthistory_delete_idx ON icinga_commenthistory (instance_id, co
 -- set dbversion
 -- -----------------------------------------
 
-SELECT updatedbversion('1.12.0');
+SELECT updatedbversion('1.13.0');
 
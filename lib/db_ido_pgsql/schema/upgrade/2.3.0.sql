@@ -0,0 +1,37 @@
+-- -----------------------------------------
+-- upgrade path for Icinga 2.3.0
+--
+-- -----------------------------------------
+-- Copyright (c) 2014 Icinga Development Team (http://www.icinga.org)
+--
+-- Please check http://docs.icinga.org for upgrading information!
+-- -----------------------------------------
+
+ALTER TABLE icinga_commands ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_contactgroups ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_contacts ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_hostgroups ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_hosts ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_servicegroups ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_services ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_timeperiods ADD COLUMN config_hash varchar(64) default NULL;
+ALTER TABLE icinga_endpoints ADD COLUMN config_hash varchar(64) default NULL;
+
+-- config dump (per object)
+CREATE INDEX tp_timeranges_tp_id_idx on icinga_timeperiod_timeranges(timeperiod_id);
+CREATE INDEX cgroup_members_cgroup_id_idx on icinga_contactgroup_members(contactgroup_id);
+CREATE INDEX hgroup_members_hgroup_id_idx on icinga_hostgroup_members(hostgroup_id);
+CREATE INDEX sgroup_members_sgroup_id_idx on icinga_servicegroup_members(servicegroup_id);
+CREATE INDEX host_parenthosts_host_id_idx on icinga_host_parenthosts(host_id);
+CREATE INDEX host_contacts_host_id_idx on icinga_host_contacts(host_id);
+CREATE INDEX host_cgroups_host_id_idx on icinga_host_contactgroups(host_id);
+CREATE INDEX hostdep_dep_host_obj_id_idx on icinga_hostdependencies(dependent_host_object_id);
+CREATE INDEX service_contacts_service_id_idx on icinga_service_contacts(service_id);
+CREATE INDEX service_cgroups_service_id_idx on icinga_service_contactgroups(service_id);
+CREATE INDEX servicedep_dep_svc_obj_id_idx on icinga_servicedependencies(dependent_service_object_id);
+
+-- -----------------------------------------
+-- update dbversion
+-- -----------------------------------------
+
+SELECT updatedbversion('1.13.0');
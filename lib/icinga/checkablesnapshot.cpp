@@ -0,0 +1,204 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "icinga/checkablesnapshot.hpp"
+#include "icinga/host.hpp"
+#include "icinga/service.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include "base/dynamictype.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/foreach.hpp>
+
+using namespace icinga;
+
+static boost::mutex l_SnapshotMutex;
+static CheckableSnapshot::Ptr l_HostSnapshot;
+static CheckableSnapshot::Ptr l_ServiceSnapshot;
+
+/* Serializes the creation of new snapshots. */
+static boost::mutex l_HostSnapshotBuildMutex;
+static boost::mutex l_ServiceSnapshotBuildMutex;
+
+CheckableSnapshot::CheckableSnapshot(void)
+	: m_Timestamp(Utility::GetTime())
+{ }
+
+static CheckableSnapshot::Ptr GetCurrentSnapshot(CheckableSnapshot::Ptr& snapshot, double max_age)
+{
+	boost::mutex::scoped_lock lock(l_SnapshotMutex);
+
+	if (snapshot && snapshot->GetTimestamp() >= Utility::GetTime() - max_age)
+		return snapshot;
+
+	return CheckableSnapshot::Ptr();
+}
+
+static CheckableSnapshot::Ptr GetSnapshot(CheckableSnapshot::Ptr& snapshot, boost::mutex& buildMutex,
+    CheckableSnapshot::Ptr (*createSnapshot)(void), double max_age)
+{
+	CheckableSnapshot::Ptr result = GetCurrentSnapshot(snapshot, max_age);
+
+	if (result)
+		return result;
+
+	boost::mutex::scoped_lock buildLock(buildMutex);
+
+	/* another thread might have created a new snapshot in the meantime */
+	result = GetCurrentSnapshot(snapshot, max_age);
+
+	if (result)
+		return result;
+
+	result = createSnapshot();
+
+	boost::mutex::scoped_lock lock(l_SnapshotMutex);
+	snapshot = result;
+
+	return result;
+}
+
+/**
+ * Returns a snapshot of the state of all hosts.
+ *
+ * @param max_age The maximum age of the snapshot in seconds.
+ */
+CheckableSnapshot::Ptr CheckableSnapshot::GetHostSnapshot(double max_age)
+{
+	return GetSnapshot(l_HostSnapshot, l_HostSnapshotBuildMutex, &CheckableSnapshot::CreateHostSnapshot, max_age);
+}
+
+/**
+ * Returns a snapshot of the state of all services.
+ *
+ * @param max_age The maximum age of the snapshot in seconds.
+ */
+CheckableSnapshot::Ptr CheckableSnapshot::GetServiceSnapshot(double max_age)
+{
+	return GetSnapshot(l_ServiceSnapshot, l_ServiceSnapshotBuildMutex, &CheckableSnapshot::CreateServiceSnapshot, max_age);
+}
+
+CheckableSnapshot::Ptr CheckableSnapshot::CreateHostSnapshot(void)
+{
+	CheckableSnapshot::Ptr snapshot = make_shared<CheckableSnapshot>();
+
+	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjectsByType<Host>()) {
+		ObjectLock olock(host);
+
+		snapshot->AddCheckable(host, host->GetState());
+	}
+
+	return snapshot;
+}
+
+CheckableSnapshot::Ptr CheckableSnapshot::CreateServiceSnapshot(void)
+{
+	CheckableSnapshot::Ptr snapshot = make_shared<CheckableSnapshot>();
+
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjectsByType<Service>()) {
+		ObjectLock olock(service);
+
+		snapshot->AddCheckable(service, service->GetState());
+	}
+
+	return snapshot;
+}
+
+void CheckableSnapshot::AddCheckable(const Checkable::Ptr& checkable, int state)
+{
+	CheckResult::Ptr cr = checkable->GetLastCheckResult();
+
+	m_States.push_back(state);
+	m_StateTypes.push_back(checkable->GetStateType());
+	m_LastChecks.push_back(checkable->GetLastCheck());
+	m_Latencies.push_back(Checkable::CalculateLatency(cr));
+	m_ExecutionTimes.push_back(Checkable::CalculateExecutionTime(cr));
+	m_DowntimeDepths.push_back(checkable->GetDowntimeDepth());
+	m_InDowntime.push_back(checkable->IsInDowntime());
+	m_Acknowledged.push_back(checkable->IsAcknowledged());
+	m_HasCheckResult.push_back(cr ? 1 : 0);
+	m_Reachable.push_back(checkable->IsReachable());
+	m_Flapping.push_back(checkable->IsFlapping());
+}
+
+double CheckableSnapshot::GetTimestamp(void) const
+{
+	return m_Timestamp;
+}
+
+size_t CheckableSnapshot::GetCount(void) const
+{
+	return m_States.size();
+}
+
+const std::vector<int>& CheckableSnapshot::GetStates(void) const
+{
+	return m_States;
+}
+
+const std::vector<int>& CheckableSnapshot::GetStateTypes(void) const
+{
+	return m_StateTypes;
+}
+
+const std::vector<double>& CheckableSnapshot::GetLastChecks(void) const
+{
+	return m_LastChecks;
+}
+
+const std::vector<double>& CheckableSnapshot::GetLatencies(void) const
+{
+	return m_Latencies;
+}
+
+const std::vector<double>& CheckableSnapshot::GetExecutionTimes(void) const
+{
+	return m_ExecutionTimes;
+}
+
+const std::vector<int>& CheckableSnapshot::GetDowntimeDepths(void) const
+{
+	return m_DowntimeDepths;
+}
+
+const std::vector<unsigned char>& CheckableSnapshot::GetInDowntime(void) const
+{
+	return m_InDowntime;
+}
+
+const std::vector<unsigned char>& CheckableSnapshot::GetAcknowledged(void) const
+{
+	return m_Acknowledged;
+}
+
+const std::vector<unsigned char>& CheckableSnapshot::GetHasCheckResult(void) const
+{
+	return m_HasCheckResult;
+}
+
+const std::vector<unsigned char>& CheckableSnapshot::GetReachable(void) const
+{
+	return m_Reachable;
+}
+
+const std::vector<unsigned char>& CheckableSnapshot::GetFlapping(void) const
+{
+	return m_Flapping;
+}
@@ -0,0 +1,88 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef CHECKABLESNAPSHOT_H
+#define CHECKABLESNAPSHOT_H
+
+#include "icinga/i2-icinga.hpp"
+#include "icinga/checkable.hpp"
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A columnar snapshot of the state of all hosts or all services.
+ *
+ * Snapshots are immutable once they have been created, so readers can scan
+ * the arrays without holding any locks. A new snapshot is created when the
+ * current one is older than the requested maximum age.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API CheckableSnapshot : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(CheckableSnapshot);
+
+	CheckableSnapshot(void);
+
+	static CheckableSnapshot::Ptr GetHostSnapshot(double max_age = 1);
+	static CheckableSnapshot::Ptr GetServiceSnapshot(double max_age = 1);
+
+	double GetTimestamp(void) const;
+	size_t GetCount(void) const;
+
+	const std::vector<int>& GetStates(void) const;
+	const std::vector<int>& GetStateTypes(void) const;
+	const std::vector<double>& GetLastChecks(void) const;
+	const std::vector<double>& GetLatencies(void) const;
+	const std::vector<double>& GetExecutionTimes(void) const;
+	const std::vector<int>& GetDowntimeDepths(void) const;
+	const std::vector<unsigned char>& GetInDowntime(void) const;
+	const std::vector<unsigned char>& GetAcknowledged(void) const;
+	const std::vector<unsigned char>& GetHasCheckResult(void) const;
+	const std::vector<unsigned char>& GetReachable(void) const;
+	const std::vector<unsigned char>& GetFlapping(void) const;
+
+private:
+	double m_Timestamp;
+
+	std::vector<int> m_States;
+	std::vector<int> m_StateTypes;
+	std::vector<double> m_LastChecks;
+	std::vector<double> m_Latencies;
+	std::vector<double> m_ExecutionTimes;
+	std::vector<int> m_DowntimeDepths;
+	std::vector<unsigned char> m_InDowntime;
+	std::vector<unsigned char> m_Acknowledged;
+	std::vector<unsigned char> m_HasCheckResult;
+	std::vector<unsigned char> m_Reachable;
+	std::vector<unsigned char> m_Flapping;
+
+	static CheckableSnapshot::Ptr CreateHostSnapshot(void);
+	static CheckableSnapshot::Ptr CreateServiceSnapshot(void);
+
+	void AddCheckable(const Checkable::Ptr& checkable, int state);
+};
+
+}
+
+#endif /* CHECKABLESNAPSHOT_H */
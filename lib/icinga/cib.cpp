@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "icinga/cib.hpp"
+#include "icinga/checkablesnapshot.hpp"
 #include "icinga/host.hpp"
 #include "icinga/service.hpp"
 #include "base/objectlock.hpp"
@@ -73,133 +74,84 @@ int CIB::GetPassiveServiceChecksStatistics(long timespan)
 	return m_PassiveServiceChecksStatistics.GetValues(timespan);
 }
 
-CheckableCheckStatistics CIB::CalculateHostCheckStats(void)
+static CheckableCheckStatistics CalculateCheckStats(const CheckableSnapshot::Ptr& snapshot)
 {
+	size_t count = snapshot->GetCount();
+	const std::vector<double>& latencies = snapshot->GetLatencies();
+	const std::vector<double>& execution_times = snapshot->GetExecutionTimes();
+
 	double min_latency = -1, max_latency = 0, sum_latency = 0;
-	int count_latency = 0;
 	double min_execution_time = -1, max_execution_time = 0, sum_execution_time = 0;
-	int count_execution_time = 0;
-
-	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjectsByType<Host>()) {
-		ObjectLock olock(host);
 
-		CheckResult::Ptr cr = host->GetLastCheckResult();
-
-		/* latency */
-		double latency = Host::CalculateLatency(cr);
-
-		if (min_latency == -1 || latency < min_latency)
-			min_latency = latency;
+	if (count > 0) {
+		min_latency = latencies[0];
+		min_execution_time = execution_times[0];
+	}
 
-		if (latency > max_latency)
-			max_latency = latency;
+	for (size_t i = 0; i < count; i++) {
+		double latency = latencies[i];
 
+		min_latency = std::min(min_latency, latency);
+		max_latency = std::max(max_latency, latency);
 		sum_latency += latency;
-		count_latency++;
-
-		/* execution_time */
-		double execution_time = Host::CalculateExecutionTime(cr);
-
-		if (min_execution_time == -1 || execution_time < min_execution_time)
-			min_execution_time = execution_time;
+	}
 
-		if (execution_time > max_execution_time)
-			max_execution_time = execution_time;
+	for (size_t i = 0; i < count; i++) {
+		double execution_time = execution_times[i];
 
+		min_execution_time = std::min(min_execution_time, execution_time);
+		max_execution_time = std::max(max_execution_time, execution_time);
 		sum_execution_time += execution_time;
-		count_execution_time++;
 	}
 
 	CheckableCheckStatistics ccs;
 
 	ccs.min_latency = min_latency;
 	ccs.max_latency = max_latency;
-	ccs.avg_latency = sum_latency / count_latency;
+	ccs.avg_latency = sum_latency / count;
 	ccs.min_execution_time = min_execution_time;
 	ccs.max_execution_time = max_execution_time;
-	ccs.avg_execution_time = sum_execution_time / count_execution_time;
+	ccs.avg_execution_time = sum_execution_time / count;
 
 	return ccs;
 }
 
-CheckableCheckStatistics CIB::CalculateServiceCheckStats(void)
+CheckableCheckStatistics CIB::CalculateHostCheckStats(void)
 {
-	double min_latency = -1, max_latency = 0, sum_latency = 0;
-	int count_latency = 0;
-	double min_execution_time = -1, max_execution_time = 0, sum_execution_time = 0;
-	int count_execution_time = 0;
-
-	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjectsByType<Service>()) {
-		ObjectLock olock(service);
-
-		CheckResult::Ptr cr = service->GetLastCheckResult();
-
-		/* latency */
-		double latency = Service::CalculateLatency(cr);
-
-		if (min_latency == -1 || latency < min_latency)
-			min_latency = latency;
-
-		if (latency > max_latency)
-			max_latency = latency;
-
-		sum_latency += latency;
-		count_latency++;
-
-		/* execution_time */
-		double execution_time = Service::CalculateExecutionTime(cr);
-
-		if (min_execution_time == -1 || execution_time < min_execution_time)
-			min_execution_time = execution_time;
-
-		if (execution_time > max_execution_time)
-			max_execution_time = execution_time;
-
-		sum_execution_time += execution_time;
-		count_execution_time++;
-	}
-
-	CheckableCheckStatistics ccs;
-
-	ccs.min_latency = min_latency;
-	ccs.max_latency = max_latency;
-	ccs.avg_latency = sum_latency / count_latency;
-	ccs.min_execution_time = min_execution_time;
-	ccs.max_execution_time = max_execution_time;
-	ccs.avg_execution_time = sum_execution_time / count_execution_time;
+	return CalculateCheckStats(CheckableSnapshot::GetHostSnapshot());
+}
 
-	return ccs;
+CheckableCheckStatistics CIB::CalculateServiceCheckStats(void)
+{
+	return CalculateCheckStats(CheckableSnapshot::GetServiceSnapshot());
 }
 
 ServiceStatistics CIB::CalculateServiceStats(void)
 {
 	ServiceStatistics ss = {0};
 
-	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjectsByType<Service>()) {
-		ObjectLock olock(service);
-
-		CheckResult::Ptr cr = service->GetLastCheckResult();
-
-		if (service->GetState() == ServiceOK)
-			ss.services_ok++;
-		if (service->GetState() == ServiceWarning)
-			ss.services_warning++;
-		if (service->GetState() == ServiceCritical)
-			ss.services_critical++;
-		if (service->GetState() == ServiceUnknown)
-			ss.services_unknown++;
-
-		if (!cr)
-			ss.services_pending++;
-		if (!service->IsReachable())
-			ss.services_unreachable++;
-
-		if (service->IsFlapping())
-			ss.services_flapping++;
-		if (service->IsInDowntime())
-			ss.services_in_downtime++;
-		if (service->IsAcknowledged())
-			ss.services_acknowledged++;
+	CheckableSnapshot::Ptr snapshot = CheckableSnapshot::GetServiceSnapshot();
+
+	size_t count = snapshot->GetCount();
+	const std::vector<int>& states = snapshot->GetStates();
+	const std::vector<unsigned char>& has_cr = snapshot->GetHasCheckResult();
+	const std::vector<unsigned char>& reachable = snapshot->GetReachable();
+	const std::vector<unsigned char>& flapping = snapshot->GetFlapping();
+	const std::vector<unsigned char>& in_downtime = snapshot->GetInDowntime();
+	const std::vector<unsigned char>& acknowledged = snapshot->GetAcknowledged();
+
+	for (size_t i = 0; i < count; i++) {
+		ss.services_ok += (states[i] == ServiceOK);
+		ss.services_warning += (states[i] == ServiceWarning);
+		ss.services_critical += (states[i] == ServiceCritical);
+		ss.services_unknown += (states[i] == ServiceUnknown);
+
+		ss.services_pending += !has_cr[i];
+		ss.services_unreachable += !reachable[i];
+
+		ss.services_flapping += flapping[i];
+		ss.services_in_downtime += in_downtime[i];
+		ss.services_acknowledged += acknowledged[i];
 	}
 
 	return ss;
@@ -209,26 +161,26 @@ HostStatistics CIB::CalculateHostStats(void)
 {
 	HostStatistics hs = {0};
 
-	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjectsByType<Host>()) {
-		ObjectLock olock(host);
-
-		if (host->IsReachable()) {
-			if (host->GetState() == HostUp)
-				hs.hosts_up++;
-			if (host->GetState() == HostDown)
-				hs.hosts_down++;
-		} else
-			hs.hosts_unreachable++;
-
-		if (!host->GetLastCheckResult())
-			hs.hosts_pending++;
-
-		if (host->IsFlapping())
-			hs.hosts_flapping++;
-		if (host->IsInDowntime())
-			hs.hosts_in_downtime++;
-		if (host->IsAcknowledged())
-			hs.hosts_acknowledged++;
+	CheckableSnapshot::Ptr snapshot = CheckableSnapshot::GetHostSnapshot();
+
+	size_t count = snapshot->GetCount();
+	const std::vector<int>& states = snapshot->GetStates();
+	const std::vector<unsigned char>& has_cr = snapshot->GetHasCheckResult();
+	const std::vector<unsigned char>& reachable = snapshot->GetReachable();
+	const std::vector<unsigned char>& flapping = snapshot->GetFlapping();
+	const std::vector<unsigned char>& in_downtime = snapshot->GetInDowntime();
+	const std::vector<unsigned char>& acknowledged = snapshot->GetAcknowledged();
+
+	for (size_t i = 0; i < count; i++) {
+		hs.hosts_up += (reachable[i] && states[i] == HostUp);
+		hs.hosts_down += (reachable[i] && states[i] == HostDown);
+		hs.hosts_unreachable += !reachable[i];
+
+		hs.hosts_pending += !has_cr[i];
+
+		hs.hosts_flapping += flapping[i];
+		hs.hosts_in_downtime += in_downtime[i];
+		hs.hosts_acknowledged += acknowledged[i];
 	}
 
 	return hs;
@@ -19,6 +19,7 @@
 
 #include "icinga/icingaapplication.hpp"
 #include "icinga/cib.hpp"
+#include "icinga/perfdatavalue.hpp"
 #include "base/dynamictype.hpp"
 #include "base/logger.hpp"
 #include "base/objectlock.hpp"
@@ -80,7 +81,13 @@ Value IcingaApplication::StatsFunc(Dictionary::Ptr& status, Array::Ptr& perfdata
 		stats->Set("program_start", Application::GetStartTime());
 		stats->Set("version", Application::GetVersion());
 
+		Dictionary::Ptr tp_stats = Application::GetTP().GetStats();
+		stats->Set("thread_pool", tp_stats);
+
 		nodes->Set(icingaapplication->GetName(), stats);
+
+		perfdata->Add(make_shared<PerfdataValue>("thread_pool_pending", Convert::ToDouble(tp_stats->Get("pending"))));
+		perfdata->Add(make_shared<PerfdataValue>("thread_pool_steals", Convert::ToDouble(tp_stats->Get("steals")), true));
 	}
 
 	status->Set("icingaapplication", nodes);
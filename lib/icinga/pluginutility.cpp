@@ -173,6 +173,7 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkab
 
 	Process::Ptr process = make_shared<Process>(Process::PrepareCommand(command), envMacros);
 	process->SetTimeout(commandObj->GetTimeout());
+	process->SetUseHelper(true);
 	process->Run(boost::bind(callback, command, _1));
 }
 
@@ -24,6 +24,31 @@ using namespace icinga;
 Aggregator::Aggregator(void)
 { }
 
+/**
+ * Prepares the aggregator (and its filter) for being applied to rows from
+ * the specified table.
+ *
+ * @param table The table.
+ */
+void Aggregator::Compile(const Table::Ptr& table)
+{
+	if (m_Filter)
+		m_Filter->Compile(table);
+}
+
+/**
+ * Returns the name of the column whose values are passed to ApplyBatch().
+ * Aggregators which return an empty string are applied to each row using
+ * Apply() instead.
+ */
+String Aggregator::GetBatchColumn(void) const
+{
+	return String();
+}
+
+void Aggregator::ApplyBatch(const std::vector<double>&)
+{ }
+
 void Aggregator::SetFilter(const Filter::Ptr& filter)
 {
 	m_Filter = filter;
@@ -22,6 +22,7 @@
 
 #include "livestatus/table.hpp"
 #include "livestatus/filter.hpp"
+#include <vector>
 
 namespace icinga
 {
@@ -34,8 +35,18 @@ class Aggregator : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(Aggregator);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual void Apply(const Table::Ptr& table, const Value& row) = 0;
 	virtual double GetResult(void) const = 0;
+
+	/* Batch aggregation for aggregators which only depend on a single column. */
+	virtual String GetBatchColumn(void) const;
+	virtual void ApplyBatch(const std::vector<double>& values);
+
+	/* Partial aggregates for parallel scans. */
+	virtual Aggregator::Ptr Clone(void) const = 0;
+	virtual void Merge(const Aggregator::Ptr& partial) = 0;
+
 	void SetFilter(const Filter::Ptr& filter);
 
 protected:
@@ -28,20 +28,83 @@
 using namespace icinga;
 
 AttributeFilter::AttributeFilter(const String& column, const String& op, const String& operand)
-	: m_Column(column), m_Operator(op), m_Operand(operand)
+	: m_Column(column), m_Operator(op), m_Operand(operand), m_Compiled(false),
+	  m_OperatorType(FilterOpUnknown), m_NumericOperandValid(false), m_NumericOperand(0),
+	  m_RegexValid(false)
 { }
 
+/**
+ * Resolves the filter's column, converts the operand to a number and compiles
+ * regular expressions so that this doesn't have to be done for every row.
+ */
+void AttributeFilter::Compile(const Table::Ptr& table)
+{
+	m_ColumnAccessor = table->GetColumn(m_Column);
+
+	if (m_Operator == "=")
+		m_OperatorType = FilterOpEqual;
+	else if (m_Operator == "~")
+		m_OperatorType = FilterOpRegex;
+	else if (m_Operator == "=~")
+		m_OperatorType = FilterOpEqualNoCase;
+	else if (m_Operator == "~~")
+		m_OperatorType = FilterOpRegexNoCase;
+	else if (m_Operator == "<")
+		m_OperatorType = FilterOpLess;
+	else if (m_Operator == ">")
+		m_OperatorType = FilterOpGreater;
+	else if (m_Operator == "<=")
+		m_OperatorType = FilterOpLessOrEqual;
+	else if (m_Operator == ">=")
+		m_OperatorType = FilterOpGreaterOrEqual;
+	else
+		m_OperatorType = FilterOpUnknown;
+
+	try {
+		m_NumericOperand = Convert::ToDouble(m_Operand);
+		m_NumericOperandValid = true;
+	} catch (const std::exception&) {
+		m_NumericOperandValid = false;
+	}
+
+	if (m_OperatorType == FilterOpRegex || m_OperatorType == FilterOpRegexNoCase) {
+		try {
+			if (m_OperatorType == FilterOpRegexNoCase)
+				m_Regex.assign(m_Operand.GetData(), boost::regex::icase);
+			else
+				m_Regex.assign(m_Operand.GetData());
+
+			m_RegexValid = true;
+		} catch (const std::exception&) {
+			Log(LogWarning, "AttributeFilter")
+			    << "Regex '" << m_Column << " " << m_Operator << " " << m_Operand << "' error.";
+			m_RegexValid = false;
+		}
+	}
+
+	m_Compiled = true;
+}
+
+double AttributeFilter::GetNumericOperand(void) const
+{
+	if (!m_NumericOperandValid)
+		return Convert::ToDouble(m_Operand); /* throws an exception */
+
+	return m_NumericOperand;
+}
+
 bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_Column);
+	if (!m_Compiled)
+		Compile(table);
 
-	Value value = column.ExtractValue(row);
+	Value value = m_ColumnAccessor.ExtractValue(row);
 
 	if (value.IsObjectType<Array>()) {
 		Array::Ptr array = value;
 
-		if (m_Operator == ">=" || m_Operator == "<") {
-			bool negate = (m_Operator == "<");
+		if (m_OperatorType == FilterOpGreaterOrEqual || m_OperatorType == FilterOpLess) {
+			bool negate = (m_OperatorType == FilterOpLess);
 
 			ObjectLock olock(array);
 			BOOST_FOREACH(const String& item, array) {
@@ -50,79 +113,59 @@ bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 			}
 
 			return negate; /* Item not found in list. */
-		} else if (m_Operator == "=") {
+		} else if (m_OperatorType == FilterOpEqual) {
 			return (array->GetLength() == 0);
 		} else {
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid operator for column '" + m_Column + "': " + m_Operator + " (expected '>=' or '=')."));
 		}
 	} else {
-		if (m_Operator == "=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) == Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) == m_Operand);
-		} else if (m_Operator == "~") {
-			bool ret;
-			try {
-				boost::regex expr(m_Operand.GetData());
-				String operand = value;
-				boost::smatch what;
-				ret = boost::regex_search(operand.GetData(), what, expr);
-			} catch (boost::exception&) {
-				Log(LogWarning, "AttributeFilter")
-				    << "Regex '" << m_Operand << " " << m_Operator << " " << value << "' error.";
-				ret = false;
-			}
-
-			//Log(LogDebug, "LivestatusListener/AttributeFilter")
-			//    << "Attribute filter '" << m_Operand + " " << m_Operator << " "
-			//    << value << "' " << (ret ? "matches" : "doesn't match") << ".";
-
-			return ret;
-		} else if (m_Operator == "=~") {
-			return string_iless()(value, m_Operand);
-		} else if (m_Operator == "~~") {
-			bool ret;
-			try {
-				boost::regex expr(m_Operand.GetData(), boost::regex::icase);
-				String operand = value;
-				boost::smatch what;
-				ret = boost::regex_search(operand.GetData(), what, expr);
-			} catch (boost::exception&) {
-				Log(LogWarning, "AttributeFilter")
-				    << "Regex '" << m_Operand << " " << m_Operator << " " << value << "' error.";
-				ret = false;
-			}
+		switch (m_OperatorType) {
+			case FilterOpEqual:
+				if (value.GetType() == ValueNumber)
+					return (static_cast<double>(value) == GetNumericOperand());
+				else
+					return (static_cast<String>(value) == m_Operand);
+			case FilterOpRegex:
+			case FilterOpRegexNoCase:
+				{
+					if (!m_RegexValid)
+						return false;
 
-			//Log(LogDebug, "LivestatusListener/AttributeFilter")
-			//    << "Attribute filter '" << m_Operand << " " << m_Operator << " "
-			//    << value << "' " << (ret ? "matches" : "doesn't match") << ".";
+					String operand = value;
+					boost::smatch what;
 
-			return ret;
-		} else if (m_Operator == "<") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) < Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) < m_Operand);
-		} else if (m_Operator == ">") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) > Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) > m_Operand);
-		} else if (m_Operator == "<=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) <= Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) <= m_Operand);
-		} else if (m_Operator == ">=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) >= Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) >= m_Operand);
-		} else {
-			BOOST_THROW_EXCEPTION(std::invalid_argument("Unknown operator for column '" + m_Column + "': " + m_Operator));
+					try {
+						return boost::regex_search(operand.GetData(), what, m_Regex);
+					} catch (const std::exception&) {
+						Log(LogWarning, "AttributeFilter")
+						    << "Regex '" << m_Operand << " " << m_Operator << " " << value << "' error.";
+						return false;
+					}
+				}
+			case FilterOpEqualNoCase:
+				return string_iless()(value, m_Operand);
+			case FilterOpLess:
+				if (value.GetType() == ValueNumber)
+					return (static_cast<double>(value) < GetNumericOperand());
+				else
+					return (static_cast<String>(value) < m_Operand);
+			case FilterOpGreater:
+				if (value.GetType() == ValueNumber)
+					return (static_cast<double>(value) > GetNumericOperand());
+				else
+					return (static_cast<String>(value) > m_Operand);
+			case FilterOpLessOrEqual:
+				if (value.GetType() == ValueNumber)
+					return (static_cast<double>(value) <= GetNumericOperand());
+				else
+					return (static_cast<String>(value) <= m_Operand);
+			case FilterOpGreaterOrEqual:
+				if (value.GetType() == ValueNumber)
+					return (static_cast<double>(value) >= GetNumericOperand());
+				else
+					return (static_cast<String>(value) >= m_Operand);
+			default:
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Unknown operator for column '" + m_Column + "': " + m_Operator));
 		}
 	}
-
-	return false;
 }
@@ -21,12 +21,26 @@
 #define ATTRIBUTEFILTER_H
 
 #include "livestatus/filter.hpp"
+#include <boost/regex.hpp>
 
 using namespace icinga;
 
 namespace icinga
 {
 
+enum AttributeFilterOperator
+{
+	FilterOpEqual,
+	FilterOpRegex,
+	FilterOpEqualNoCase,
+	FilterOpRegexNoCase,
+	FilterOpLess,
+	FilterOpGreater,
+	FilterOpLessOrEqual,
+	FilterOpGreaterOrEqual,
+	FilterOpUnknown
+};
+
 /**
  * @ingroup livestatus
  */
@@ -37,12 +51,25 @@ public:
 
 	AttributeFilter(const String& column, const String& op, const String& operand);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
 
 protected:
 	String m_Column;
 	String m_Operator;
 	String m_Operand;
+
+private:
+	/* Compiled filter; see Compile(). */
+	bool m_Compiled;
+	Column m_ColumnAccessor;
+	AttributeFilterOperator m_OperatorType;
+	bool m_NumericOperandValid;
+	double m_NumericOperand;
+	bool m_RegexValid;
+	boost::regex m_Regex;
+
+	double GetNumericOperand(void) const;
 };
 
 }
@@ -35,7 +35,38 @@ void AvgAggregator::Apply(const Table::Ptr& table, const Value& row)
 	m_AvgCount++;
 }
 
+String AvgAggregator::GetBatchColumn(void) const
+{
+	return m_AvgAttr;
+}
+
+void AvgAggregator::ApplyBatch(const std::vector<double>& values)
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < values.size(); i++)
+		sum += values[i];
+
+	m_Avg += sum;
+	m_AvgCount += values.size();
+}
+
 double AvgAggregator::GetResult(void) const
 {
 	return (m_Avg / m_AvgCount);
 }
+
+Aggregator::Ptr AvgAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<AvgAggregator>(m_AvgAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void AvgAggregator::Merge(const Aggregator::Ptr& partial)
+{
+	AvgAggregator::Ptr other = static_pointer_cast<AvgAggregator>(partial);
+
+	m_Avg += other->m_Avg;
+	m_AvgCount += other->m_AvgCount;
+}
@@ -21,6 +21,9 @@
 
 using namespace icinga;
 
+Column::Column(void)
+{ }
+
 Column::Column(const ValueAccessor& valueAccessor, const ObjectAccessor& objectAccessor)
 	: m_ValueAccessor(valueAccessor), m_ObjectAccessor(objectAccessor)
 { }
@@ -34,6 +34,7 @@ public:
 	typedef boost::function<Value (const Value&)> ValueAccessor;
 	typedef boost::function<Value (const Value&)> ObjectAccessor;
 
+	Column(void);
 	Column(const ValueAccessor& valueAccessor, const ObjectAccessor& objectAccessor);
 
 	Value ExtractValue(const Value& urow) const;
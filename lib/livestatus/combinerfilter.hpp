@@ -39,6 +39,8 @@ public:
 
 	void AddSubFilter(const Filter::Ptr& filter);
 
+	virtual void Compile(const Table::Ptr& table);
+
 protected:
 	std::vector<Filter::Ptr> m_Filters;
 };
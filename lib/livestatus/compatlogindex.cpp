@@ -0,0 +1,266 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "livestatus/compatlogindex.hpp"
+#include "base/utility.hpp"
+#include "base/logger.hpp"
+#include "base/exception.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <fstream>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+
+using namespace icinga;
+
+/* A checkpoint is recorded every l_CheckpointInterval log lines. */
+static const int l_CheckpointInterval = 1024;
+
+struct CompatLogCheckpoint
+{
+	time_t Time;
+	std::streamoff Offset;
+	int LineNo;
+};
+
+struct CompatLogFile
+{
+	/* protects the other members; held while the file is being indexed */
+	boost::mutex Mutex;
+	bool Known;
+	time_t Start;
+	off_t Size;
+	time_t ModTime;
+	std::streamoff IndexedSize;
+	int IndexedLines;
+	std::vector<CompatLogCheckpoint> Checkpoints;
+
+	CompatLogFile(void)
+		: Known(false), Start(0), Size(0), ModTime(0), IndexedSize(0), IndexedLines(0)
+	{ }
+};
+
+/* l_CompatLogMutex only protects the map itself. */
+static boost::mutex l_CompatLogMutex;
+static std::map<String, boost::shared_ptr<CompatLogFile> > l_CompatLogFiles;
+
+static boost::shared_ptr<CompatLogFile> GetCompatLogFile(const String& path, bool create)
+{
+	boost::mutex::scoped_lock lock(l_CompatLogMutex);
+
+	std::map<String, boost::shared_ptr<CompatLogFile> >::const_iterator it = l_CompatLogFiles.find(path);
+
+	if (it != l_CompatLogFiles.end())
+		return it->second;
+
+	if (!create)
+		return boost::shared_ptr<CompatLogFile>();
+
+	boost::shared_ptr<CompatLogFile> file = boost::make_shared<CompatLogFile>();
+	l_CompatLogFiles[path] = file;
+	return file;
+}
+
+/**
+ * Updates the index for a log file. Only the parts of the file which
+ * were appended since the last update are read.
+ *
+ * Caller must hold file.Mutex.
+ *
+ * @returns false if the file is not a compat log file.
+ */
+static bool UpdateCompatLogFile(const String& path, CompatLogFile& file)
+{
+	bool known = file.Known;
+
+#ifndef _WIN32
+	struct stat statbuf;
+	if (stat(path.CStr(), &statbuf) < 0)
+		return false;
+#else /* _WIN32 */
+	struct _stat statbuf;
+	if (_stat(path.CStr(), &statbuf) < 0)
+		return false;
+#endif /* _WIN32 */
+
+	if (known && statbuf.st_size == file.Size && statbuf.st_mtime == file.ModTime)
+		return true;
+
+	std::ifstream fp;
+	fp.open(path.CStr(), std::ifstream::in);
+
+	if (!fp)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open log file: " + path));
+
+	/* read the first bytes to get the timestamp: [123456789] */
+	char buffer[12];
+
+	fp.read(buffer, 12);
+
+	if (fp.gcount() != 12 || buffer[0] != '[' || buffer[11] != ']') {
+		/* this can happen for directories too, silently ignore them */
+		return false;
+	}
+
+	/* extract timestamp */
+	buffer[11] = 0;
+	time_t start = atoi(buffer + 1);
+
+	/* the file was truncated or replaced (e.g. by log rotation) */
+	if (!known || start != file.Start || statbuf.st_size < file.Size) {
+		file.Start = start;
+		file.IndexedSize = 0;
+		file.IndexedLines = 0;
+		file.Checkpoints.clear();
+	}
+
+	Log(LogDebug, "CompatLogIndex")
+	    << "Indexing log file: '" << path << "' with timestamp start: '" << start
+	    << "' from offset " << file.IndexedSize << ".";
+
+	fp.clear();
+	fp.seekg(file.IndexedSize);
+
+	for (;;) {
+		std::streamoff offset = fp.tellg();
+
+		std::string line;
+		std::getline(fp, line);
+
+		/* incomplete lines are indexed once the rest has been written */
+		if (fp.fail() || fp.eof())
+			break;
+
+		file.IndexedSize = fp.tellg();
+
+		if (line.empty())
+			continue;
+
+		if (file.IndexedLines % l_CheckpointInterval == 0) {
+			CompatLogCheckpoint checkpoint;
+			checkpoint.Time = CompatLogIndex::ParseTimestamp(line);
+			checkpoint.Offset = offset;
+			checkpoint.LineNo = file.IndexedLines;
+			file.Checkpoints.push_back(checkpoint);
+		}
+
+		file.IndexedLines++;
+	}
+
+	file.Known = true;
+	file.Size = statbuf.st_size;
+	file.ModTime = statbuf.st_mtime;
+
+	return true;
+}
+
+/**
+ * Finds the compat log files in the specified directory and updates their
+ * index.
+ *
+ * @param path The compat log directory.
+ * @param[out] index The log files, ordered by their start timestamp.
+ */
+void CompatLogIndex::GetLogFiles(const String& path, std::map<time_t, String>& index)
+{
+	std::set<String> seen;
+
+	Utility::Glob(path + "/icinga.log", boost::bind(&CompatLogIndex::GetLogFilesHandler, _1, boost::ref(index), boost::ref(seen)), GlobFile);
+	Utility::Glob(path + "/archives/*.log", boost::bind(&CompatLogIndex::GetLogFilesHandler, _1, boost::ref(index), boost::ref(seen)), GlobFile);
+
+	/* forget about log files which were removed */
+	String prefix = path + "/";
+
+	boost::mutex::scoped_lock lock(l_CompatLogMutex);
+
+	std::map<String, boost::shared_ptr<CompatLogFile> >::iterator it = l_CompatLogFiles.begin();
+
+	while (it != l_CompatLogFiles.end()) {
+		if (it->first.Find(prefix) == 0 && seen.find(it->first) == seen.end())
+			l_CompatLogFiles.erase(it++);
+		else
+			it++;
+	}
+}
+
+void CompatLogIndex::GetLogFilesHandler(const String& path, std::map<time_t, String>& index, std::set<String>& seen)
+{
+	boost::shared_ptr<CompatLogFile> file = GetCompatLogFile(path, true);
+
+	/* Only the file's own lock is held while it is read, so other
+	 * queries can use the index for the remaining files meanwhile. */
+	boost::mutex::scoped_lock lock(file->Mutex);
+
+	if (!UpdateCompatLogFile(path, *file)) {
+		boost::mutex::scoped_lock mlock(l_CompatLogMutex);
+
+		std::map<String, boost::shared_ptr<CompatLogFile> >::iterator it = l_CompatLogFiles.find(path);
+
+		if (it != l_CompatLogFiles.end() && it->second == file)
+			l_CompatLogFiles.erase(it);
+
+		return;
+	}
+
+	seen.insert(path);
+	index[file->Start] = path;
+}
+
+/**
+ * Determines where to start reading a log file in order to find all
+ * entries which were logged at or after the specified time.
+ *
+ * @param path The log file.
+ * @param from The timestamp.
+ * @param[out] offset The file offset.
+ * @param[out] lineno The line number at that offset.
+ */
+void CompatLogIndex::FindOffset(const String& path, time_t from, std::streamoff& offset, int& lineno)
+{
+	offset = 0;
+	lineno = 0;
+
+	boost::shared_ptr<CompatLogFile> file = GetCompatLogFile(path, false);
+
+	if (!file)
+		return;
+
+	boost::mutex::scoped_lock lock(file->Mutex);
+
+	BOOST_FOREACH(const CompatLogCheckpoint& checkpoint, file->Checkpoints) {
+		if (checkpoint.Time >= from)
+			break;
+
+		offset = checkpoint.Offset;
+		lineno = checkpoint.LineNo;
+	}
+}
+
+time_t CompatLogIndex::ParseTimestamp(const std::string& line)
+{
+	if (line.size() < 2 || line[0] != '[')
+		return 0;
+
+	return atoi(line.c_str() + 1);
+}
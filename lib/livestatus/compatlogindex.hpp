@@ -0,0 +1,56 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef COMPATLOGINDEX_H
+#define COMPATLOGINDEX_H
+
+#include "base/string.hpp"
+#include <map>
+#include <set>
+#include <iosfwd>
+
+namespace icinga
+{
+
+/**
+ * A process-wide index for the compat log files which are used by the
+ * log and statehist tables.
+ *
+ * Archived log files are only indexed once; the current log file is
+ * indexed incrementally as the CompatLogger appends to it.
+ *
+ * @ingroup livestatus
+ */
+class CompatLogIndex
+{
+public:
+	static void GetLogFiles(const String& path, std::map<time_t, String>& index);
+	static void FindOffset(const String& path, time_t from, std::streamoff& offset, int& lineno);
+
+	static time_t ParseTimestamp(const std::string& line);
+
+private:
+	CompatLogIndex(void);
+
+	static void GetLogFilesHandler(const String& path, std::map<time_t, String>& index, std::set<String>& seen);
+};
+
+}
+
+#endif /* COMPATLOGINDEX_H */
@@ -38,6 +38,8 @@ public:
 
 	virtual void Apply(const Table::Ptr& table, const Value& row);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
+	virtual void Merge(const Aggregator::Ptr& partial);
 	
 private:
 	int m_Count;
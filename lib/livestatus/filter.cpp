@@ -23,3 +23,13 @@ using namespace icinga;
 
 Filter::Filter(void)
 { }
+
+/**
+ * Prepares the filter for being applied to rows from the specified table,
+ * e.g. by resolving column names. Filters should be compiled once per
+ * query, before the table is scanned.
+ *
+ * @param table The table.
+ */
+void Filter::Compile(const Table::Ptr&)
+{ }
@@ -33,6 +33,7 @@ class Filter : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(Filter);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual bool Apply(const Table::Ptr& table, const Value& row) = 0;
 
 protected:
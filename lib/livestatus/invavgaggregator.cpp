@@ -35,7 +35,38 @@ void InvAvgAggregator::Apply(const Table::Ptr& table, const Value& row)
 	m_InvAvgCount++;
 }
 
+String InvAvgAggregator::GetBatchColumn(void) const
+{
+	return m_InvAvgAttr;
+}
+
+void InvAvgAggregator::ApplyBatch(const std::vector<double>& values)
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < values.size(); i++)
+		sum += 1.0 / values[i];
+
+	m_InvAvg += sum;
+	m_InvAvgCount += values.size();
+}
+
 double InvAvgAggregator::GetResult(void) const
 {
 	return (m_InvAvg / m_InvAvgCount);
 }
+
+Aggregator::Ptr InvAvgAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<InvAvgAggregator>(m_InvAvgAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void InvAvgAggregator::Merge(const Aggregator::Ptr& partial)
+{
+	InvAvgAggregator::Ptr other = static_pointer_cast<InvAvgAggregator>(partial);
+
+	m_InvAvg += other->m_InvAvg;
+	m_InvAvgCount += other->m_InvAvgCount;
+}
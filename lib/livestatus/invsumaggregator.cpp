@@ -34,7 +34,36 @@ void InvSumAggregator::Apply(const Table::Ptr& table, const Value& row)
 	m_InvSum += (1.0 / value);
 }
 
+String InvSumAggregator::GetBatchColumn(void) const
+{
+	return m_InvSumAttr;
+}
+
+void InvSumAggregator::ApplyBatch(const std::vector<double>& values)
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < values.size(); i++)
+		sum += 1.0 / values[i];
+
+	m_InvSum += sum;
+}
+
 double InvSumAggregator::GetResult(void) const
 {
 	return m_InvSum;
 }
+
+Aggregator::Ptr InvSumAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<InvSumAggregator>(m_InvSumAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void InvSumAggregator::Merge(const Aggregator::Ptr& partial)
+{
+	InvSumAggregator::Ptr other = static_pointer_cast<InvSumAggregator>(partial);
+
+	m_InvSum += other->m_InvSum;
+}
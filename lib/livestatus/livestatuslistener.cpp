@@ -32,6 +32,11 @@
 #include "base/scriptfunction.hpp"
 #include "base/statsfunction.hpp"
 #include "base/convert.hpp"
+#include <boost/algorithm/string/trim.hpp>
+
+#ifdef HAVE_EPOLL
+#	include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
 
 using namespace icinga;
 
@@ -42,19 +47,41 @@ static int l_ClientsConnected = 0;
 static int l_Connections = 0;
 static boost::mutex l_ComponentMutex;
 
+/* Connections are closed when a single query exceeds this size. */
+static const size_t l_MaxRequestSize = 1024 * 1024;
+
+/* Query threads wait for the client when more than this much of a response
+ * hasn't been sent yet. */
+static const size_t l_MaxSendBufferSize = 1024 * 1024;
+
+/* Further queries have to wait until the query threads have caught up. */
+static const size_t l_MaxQueuedQueries = 1024;
+
 REGISTER_STATSFUNCTION(LivestatusListenerStats, &LivestatusListener::StatsFunc);
 
+LivestatusListener::LivestatusListener(void)
+	: m_EpollFD(-1), m_ClientsConnected(0), m_TotalConnections(0)
+{ }
+
 Value LivestatusListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const LivestatusListener::Ptr& livestatuslistener, DynamicType::GetObjectsByType<LivestatusListener>()) {
+		int connections = livestatuslistener->GetListenerConnections();
+		int clients = livestatuslistener->GetListenerClientsConnected();
+		int queries = livestatuslistener->GetQueryQueueLength();
+
 		Dictionary::Ptr stats = make_shared<Dictionary>();
-		stats->Set("connections", l_Connections);
+		stats->Set("connections", connections);
+		stats->Set("clients_connected", clients);
+		stats->Set("query_queue_length", queries);
 
 		nodes->Set(livestatuslistener->GetName(), stats);
 
-		perfdata->Add(make_shared<PerfdataValue>("livestatuslistener_" + livestatuslistener->GetName() + "_connections", l_Connections));
+		perfdata->Add(make_shared<PerfdataValue>("livestatuslistener_" + livestatuslistener->GetName() + "_connections", connections));
+		perfdata->Add(make_shared<PerfdataValue>("livestatuslistener_" + livestatuslistener->GetName() + "_clients_connected", clients));
+		perfdata->Add(make_shared<PerfdataValue>("livestatuslistener_" + livestatuslistener->GetName() + "_query_queue_length", queries));
 	}
 
 	status->Set("livestatuslistener", nodes);
@@ -69,6 +96,9 @@ void LivestatusListener::Start(void)
 {
 	DynamicObject::Start();
 
+	if (GetQueryThreads() > 0 && !StartEventLoop())
+		return;
+
 	if (GetSocketType() == "tcp") {
 		TcpSocket::Ptr socket = make_shared<TcpSocket>();
 		try {
@@ -130,6 +160,53 @@ int LivestatusListener::GetConnections(void)
 	return l_Connections;
 }
 
+/**
+ * Returns the number of clients which are connected to this listener.
+ */
+int LivestatusListener::GetListenerClientsConnected(void)
+{
+	boost::mutex::scoped_lock lock(l_ComponentMutex);
+
+	return m_ClientsConnected;
+}
+
+/**
+ * Returns the number of connections this listener has accepted.
+ */
+int LivestatusListener::GetListenerConnections(void)
+{
+	boost::mutex::scoped_lock lock(l_ComponentMutex);
+
+	return m_TotalConnections;
+}
+
+void LivestatusListener::ClientConnected(void)
+{
+	boost::mutex::scoped_lock lock(l_ComponentMutex);
+	l_ClientsConnected++;
+	l_Connections++;
+	m_ClientsConnected++;
+	m_TotalConnections++;
+}
+
+void LivestatusListener::ClientDisconnected(void)
+{
+	boost::mutex::scoped_lock lock(l_ComponentMutex);
+	l_ClientsConnected--;
+	m_ClientsConnected--;
+}
+
+/**
+ * Returns the number of complete queries which are waiting for one of the
+ * query threads.
+ */
+int LivestatusListener::GetQueryQueueLength(void)
+{
+	boost::mutex::scoped_lock lock(m_QueryMutex);
+
+	return m_Queries.size();
+}
+
 void LivestatusListener::ServerThreadProc(const Socket::Ptr& server)
 {
 	server->Listen();
@@ -138,6 +215,12 @@ void LivestatusListener::ServerThreadProc(const Socket::Ptr& server)
 		try {
 			Socket::Ptr client = server->Accept();
 			Log(LogNotice, "LivestatusListener", "Client connected");
+
+			if (m_EpollFD != -1) {
+				RegisterConnection(client);
+				continue;
+			}
+
 			Utility::QueueAsyncCallback(boost::bind(&LivestatusListener::ClientHandler, this, client), LowLatencyScheduler);
 		} catch (std::exception&) {
 			Log(LogCritical, "ListenerListener", "Cannot accept new connection.");
@@ -147,11 +230,7 @@ void LivestatusListener::ServerThreadProc(const Socket::Ptr& server)
 
 void LivestatusListener::ClientHandler(const Socket::Ptr& client)
 {
-	{
-		boost::mutex::scoped_lock lock(l_ComponentMutex);
-		l_ClientsConnected++;
-		l_Connections++;
-	}
+	ClientConnected();
 
 	Stream::Ptr stream = make_shared<NetworkStream>(client);
 
@@ -171,17 +250,448 @@ void LivestatusListener::ClientHandler(const Socket::Ptr& client)
 		if (lines.empty())
 			break;
 
-		LivestatusQuery::Ptr query = make_shared<LivestatusQuery>(lines, GetCompatLogPath());
+		LivestatusQuery::Ptr query = make_shared<LivestatusQuery>(lines, GetCompatLogPath(), GetScanThreads(), GetCacheMaxStaleness());
 		if (!query->Execute(stream))
 			break;
 	}
 
+	ClientDisconnected();
+}
+
+/**
+ * Starts the event-based I/O loop: a single I/O thread reads requests from
+ * all client connections and hands complete queries to the query threads.
+ * Idle keep-alive connections don't occupy any thread this way.
+ *
+ * @returns false if the I/O loop could not be started.
+ */
+bool LivestatusListener::StartEventLoop(void)
+{
+#ifdef HAVE_EPOLL
+	m_EpollFD = epoll_create1(EPOLL_CLOEXEC);
+
+	if (m_EpollFD < 0) {
+		Log(LogCritical, "LivestatusListener")
+		    << "epoll_create1() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+		return false;
+	}
+
+	boost::thread thread(boost::bind(&LivestatusListener::IOThreadProc, this));
+	thread.detach();
+
+	for (int i = 0; i < GetQueryThreads(); i++) {
+		boost::thread queryThread(boost::bind(&LivestatusListener::QueryThreadProc, this));
+		queryThread.detach();
+	}
+#else /* HAVE_EPOLL */
+	Log(LogWarning, "LivestatusListener", "Event-based I/O is not supported on this platform.");
+#endif /* HAVE_EPOLL */
+
+	return true;
+}
+
+void LivestatusListener::RegisterConnection(const Socket::Ptr& client)
+{
+#ifdef HAVE_EPOLL
+	LivestatusConnection::Ptr connection = make_shared<LivestatusConnection>();
+	connection->Client = client;
+	connection->ClientStream = make_shared<NetworkStream>(client);
+	connection->Eof = false;
+	connection->ResponsePending = false;
+	connection->WaitingForWrite = false;
+	connection->CloseAfterSend = false;
+	connection->Closed = false;
+
+	ClientConnected();
+
+	{
+		boost::mutex::scoped_lock lock(m_ConnectionsMutex);
+		m_Connections[connection.get()] = connection;
+	}
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.ptr = connection.get();
+	event.events = EPOLLIN | EPOLLONESHOT;
+
+	if (epoll_ctl(m_EpollFD, EPOLL_CTL_ADD, client->GetFD(), &event) < 0) {
+		Log(LogCritical, "LivestatusListener")
+		    << "epoll_ctl() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+		CloseConnection(connection);
+	}
+#endif /* HAVE_EPOLL */
+}
+
+void LivestatusListener::IOThreadProc(void)
+{
+#ifdef HAVE_EPOLL
+	Utility::SetThreadName("Livestatus I/O");
+
+	epoll_event events[64];
+
+	for (;;) {
+		int ready = epoll_wait(m_EpollFD, events, sizeof(events) / sizeof(events[0]), -1);
+
+		if (ready < 0) {
+			if (errno != EINTR) {
+				Log(LogCritical, "LivestatusListener")
+				    << "epoll_wait() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+				Utility::Sleep(1);
+			}
+
+			continue;
+		}
+
+		for (int i = 0; i < ready; i++) {
+			LivestatusConnection::Ptr connection;
+
+			{
+				boost::mutex::scoped_lock lock(m_ConnectionsMutex);
+				std::map<LivestatusConnection *, LivestatusConnection::Ptr>::const_iterator it;
+				it = m_Connections.find(static_cast<LivestatusConnection *>(events[i].data.ptr));
+
+				if (it == m_Connections.end())
+					continue;
+
+				connection = it->second;
+			}
+
+			bool writing;
+
+			{
+				boost::mutex::scoped_lock lock(connection->SendMutex);
+				writing = connection->WaitingForWrite;
+			}
+
+			if (writing)
+				WriteConnection(connection);
+			else
+				ReadConnection(connection);
+		}
+	}
+#endif /* HAVE_EPOLL */
+}
+
+/**
+ * Reads whatever data is available for a connection without blocking.
+ */
+void LivestatusListener::ReadConnection(const LivestatusConnection::Ptr& connection)
+{
+#ifdef HAVE_EPOLL
+	char buffer[4096];
+
+	for (;;) {
+		/* leave the rest in the socket until the buffered queries have been processed */
+		if (connection->Buffer.GetLength() >= l_MaxRequestSize)
+			break;
+
+		ssize_t rc = recv(connection->Client->GetFD(), buffer, sizeof(buffer), MSG_DONTWAIT);
+
+		if (rc > 0) {
+			connection->Buffer.GetData().append(buffer, rc);
+			continue;
+		}
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			connection->Eof = true;
+
+		break;
+	}
+
+	ProcessConnection(connection);
+#endif /* HAVE_EPOLL */
+}
+
+/**
+ * Dispatches the next complete query of a connection to the query threads.
+ * If there is none the connection is re-armed for reading (or closed if the
+ * client has closed its end).
+ */
+void LivestatusListener::ProcessConnection(const LivestatusConnection::Ptr& connection)
+{
+#ifdef HAVE_EPOLL
+	{
+		boost::mutex::scoped_lock lock(m_QueryMutex);
+
+		/* QueryThreadProc() resumes the connection once the queue has room again. */
+		if (m_Queries.size() >= l_MaxQueuedQueries) {
+			m_WaitingConnections.push_back(connection);
+			return;
+		}
+	}
+
+	std::vector<String> lines;
+
+	if (ParseQuery(connection, lines)) {
+		if (lines.empty()) {
+			CloseConnection(connection);
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(m_QueryMutex);
+		m_Queries.push_back(std::make_pair(connection, lines));
+		m_QueryCV.notify_one();
+
+		return;
+	}
+
+	if (connection->Buffer.GetLength() >= l_MaxRequestSize) {
+		Log(LogWarning, "LivestatusListener")
+		    << "Closing connection: Query exceeds the maximum size of " << l_MaxRequestSize << " bytes.";
+		CloseConnection(connection);
+		return;
+	}
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.ptr = connection.get();
+	event.events = EPOLLIN | EPOLLONESHOT;
+
+	if (epoll_ctl(m_EpollFD, EPOLL_CTL_MOD, connection->Client->GetFD(), &event) < 0)
+		CloseConnection(connection);
+#endif /* HAVE_EPOLL */
+}
+
+/**
+ * Extracts the next query from a connection's read buffer. Queries are
+ * terminated by an empty line or by the end of the connection.
+ *
+ * @returns true if a complete query is available. An empty list of lines
+ *	    means the client wants to close the connection.
+ */
+bool LivestatusListener::ParseQuery(const LivestatusConnection::Ptr& connection, std::vector<String>& lines)
+{
+	std::string& buffer = connection->Buffer.GetData();
+	size_t offset = 0;
+
+	for (;;) {
+		size_t newline = buffer.find('\n', offset);
+
+		if (newline == std::string::npos)
+			break;
+
+		String line = buffer.substr(offset, newline - offset);
+		boost::algorithm::trim_right(line);
+
+		offset = newline + 1;
+
+		if (line.IsEmpty()) {
+			buffer.erase(0, offset);
+			return true;
+		}
+
+		lines.push_back(line);
+	}
+
+	if (connection->Eof) {
+		String line = buffer.substr(offset);
+		boost::algorithm::trim_right(line);
+
+		if (!line.IsEmpty())
+			lines.push_back(line);
+
+		buffer.clear();
+		return true;
+	}
+
+	lines.clear();
+	return false;
+}
+
+void LivestatusListener::QueryThreadProc(void)
+{
+	Utility::SetThreadName("Livestatus Query");
+
+	for (;;) {
+		LivestatusConnection::Ptr connection, waiting;
+		std::vector<String> lines;
+
+		{
+			boost::mutex::scoped_lock lock(m_QueryMutex);
+
+			while (m_Queries.empty())
+				m_QueryCV.wait(lock);
+
+			connection = m_Queries.front().first;
+			lines.swap(m_Queries.front().second);
+			m_Queries.pop_front();
+
+			if (!m_WaitingConnections.empty()) {
+				waiting = m_WaitingConnections.front();
+				m_WaitingConnections.pop_front();
+			}
+		}
+
+		if (waiting)
+			ProcessConnection(waiting);
+
+		{
+			boost::mutex::scoped_lock lock(connection->SendMutex);
+			connection->SendBuffer = make_shared<FIFO>();
+			connection->ResponsePending = true;
+		}
+
+		/* The response is written without blocking as long as the client keeps
+		 * up, so slow clients don't keep the query threads busy. */
+		bool keepAlive;
+
+		try {
+			LivestatusQuery::Ptr query = make_shared<LivestatusQuery>(lines, GetCompatLogPath(), GetScanThreads(), GetCacheMaxStaleness());
+			keepAlive = query->Execute(make_shared<LivestatusResponseStream>(this, connection));
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "LivestatusListener")
+			    << "Error while processing livestatus query: " << DiagnosticInformation(ex);
+			CloseConnection(connection);
+			continue;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(connection->SendMutex);
+			connection->ResponsePending = false;
+			connection->CloseAfterSend = !keepAlive;
+
+			/* the I/O thread finishes the response once the socket is writable */
+			if (connection->WaitingForWrite)
+				continue;
+		}
+
+		WriteConnection(connection);
+	}
+}
+
+/**
+ * Appends data to a connection's response. Waits for the client while too
+ * much of the response hasn't been sent yet.
+ */
+void LivestatusListener::WriteResponse(const LivestatusConnection::Ptr& connection, const void *buffer, size_t count)
+{
+	boost::mutex::scoped_lock lock(connection->SendMutex);
+
+	connection->SendBuffer->Write(buffer, count);
+
+	for (;;) {
+		if (connection->Closed)
+			BOOST_THROW_EXCEPTION(std::runtime_error("The client has closed the connection."));
+
+		if (connection->SendBuffer->GetAvailableBytes() < l_MaxSendBufferSize)
+			return;
+
+		if (connection->WaitingForWrite)
+			connection->SendCV.wait(lock);
+		else if (!SendResponse(connection))
+			connection->Closed = true;
+	}
+}
+
+/**
+ * Writes as much of a connection's pending response as possible without
+ * blocking and arms the socket for EPOLLOUT if the rest has to wait.
+ * Note: Caller must hold the connection's SendMutex.
+ *
+ * @returns false if the connection has to be closed.
+ */
+bool LivestatusListener::SendResponse(const LivestatusConnection::Ptr& connection)
+{
+#ifdef HAVE_EPOLL
+	char buffer[FIFO::BlockSize];
+
+	if (connection->Closed)
+		return false;
+
+	for (;;) {
+		size_t count = connection->SendBuffer->Peek(buffer, sizeof(buffer));
+
+		if (count == 0)
+			return true;
+
+		ssize_t rc = send(connection->Client->GetFD(), buffer, count, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (rc > 0) {
+			connection->SendBuffer->Read(NULL, rc);
+			continue;
+		}
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.data.ptr = connection.get();
+			event.events = EPOLLOUT | EPOLLONESHOT;
+
+			if (epoll_ctl(m_EpollFD, EPOLL_CTL_MOD, connection->Client->GetFD(), &event) < 0)
+				return false;
+
+			connection->WaitingForWrite = true;
+			return true;
+		}
+
+		/* the client has closed the connection */
+		return false;
+	}
+#else /* HAVE_EPOLL */
+	return false;
+#endif /* HAVE_EPOLL */
+}
+
+/**
+ * Writes as much of a connection's pending response as possible without
+ * blocking. The rest is written by the I/O thread once the socket becomes
+ * writable. When the response is complete the next query is processed.
+ */
+void LivestatusListener::WriteConnection(const LivestatusConnection::Ptr& connection)
+{
 	{
-		boost::mutex::scoped_lock lock(l_ComponentMutex);
-		l_ClientsConnected--;
+		boost::mutex::scoped_lock lock(connection->SendMutex);
+
+		connection->WaitingForWrite = false;
+
+		bool success = SendResponse(connection);
+
+		/* wake up the query thread if it is waiting for the client */
+		connection->SendCV.notify_all();
+
+		if (success) {
+			if (connection->WaitingForWrite || connection->ResponsePending)
+				return;
+
+			connection->SendBuffer.reset();
+		} else
+			connection->CloseAfterSend = true;
 	}
+
+	if (connection->CloseAfterSend)
+		CloseConnection(connection);
+	else
+		ProcessConnection(connection);
 }
 
+/**
+ * Closes a connection. Closing the socket also removes it from the epoll set.
+ */
+void LivestatusListener::CloseConnection(const LivestatusConnection::Ptr& connection)
+{
+	{
+		boost::mutex::scoped_lock lock(m_ConnectionsMutex);
+
+		if (m_Connections.erase(connection.get()) == 0)
+			return;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(connection->SendMutex);
+		connection->Closed = true;
+		connection->SendCV.notify_all();
+	}
+
+	connection->ClientStream->Close();
+
+	ClientDisconnected();
+}
 
 void LivestatusListener::ValidateSocketType(const String& location, const Dictionary::Ptr& attrs)
 {
@@ -192,3 +702,30 @@ void LivestatusListener::ValidateSocketType(const String& location, const Dictio
 		    location + ": Socket type '" + socket_type + "' is invalid.");
 	}
 }
+
+LivestatusResponseStream::LivestatusResponseStream(LivestatusListener *listener, const LivestatusConnection::Ptr& connection)
+	: m_Listener(listener), m_Connection(connection)
+{ }
+
+size_t LivestatusResponseStream::Read(void *, size_t)
+{
+	BOOST_THROW_EXCEPTION(std::runtime_error("Cannot read from a livestatus response."));
+}
+
+void LivestatusResponseStream::Write(const void *buffer, size_t count)
+{
+	m_Listener->WriteResponse(m_Connection, buffer, count);
+}
+
+/**
+ * Does nothing. The connection is closed once the response has been sent.
+ */
+void LivestatusResponseStream::Close(void)
+{ }
+
+bool LivestatusResponseStream::IsEof(void) const
+{
+	boost::mutex::scoped_lock lock(m_Connection->SendMutex);
+
+	return m_Connection->Closed;
+}
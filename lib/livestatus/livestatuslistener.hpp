@@ -23,13 +23,42 @@
 #include "livestatus/livestatuslistener.thpp"
 #include "livestatus/livestatusquery.hpp"
 #include "base/socket.hpp"
+#include "base/stream.hpp"
+#include "base/fifo.hpp"
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
 
 using namespace icinga;
 
 namespace icinga
 {
 
+/**
+ * A client connection which is handled by the event-based I/O loop.
+ *
+ * @ingroup livestatus
+ */
+struct LivestatusConnection : public Object
+{
+	DECLARE_PTR_TYPEDEFS(LivestatusConnection);
+
+	Socket::Ptr Client;
+	Stream::Ptr ClientStream;
+	String Buffer;
+	bool Eof;
+
+	/* response which is still being written to the client, protected by SendMutex */
+	boost::mutex SendMutex;
+	boost::condition_variable SendCV;
+	FIFO::Ptr SendBuffer;
+	bool ResponsePending; /**< The query is still producing output. */
+	bool WaitingForWrite; /**< The socket is armed for EPOLLOUT. */
+	bool CloseAfterSend;
+	bool Closed;
+};
+
 /**
  * @ingroup livestatus
  */
@@ -39,11 +68,17 @@ public:
 	DECLARE_PTR_TYPEDEFS(LivestatusListener);
 	DECLARE_TYPENAME(LivestatusListener);
 
+	LivestatusListener(void);
+
 	static Value StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
 	static int GetClientsConnected(void);
 	static int GetConnections(void);
 
+	int GetQueryQueueLength(void);
+	int GetListenerClientsConnected(void);
+	int GetListenerConnections(void);
+
 	static void ValidateSocketType(const String& location, const Dictionary::Ptr& attrs);
 
 protected:
@@ -52,6 +87,62 @@ protected:
 private:
 	void ServerThreadProc(const Socket::Ptr& server);
 	void ClientHandler(const Socket::Ptr& client);
+
+	friend class LivestatusResponseStream;
+
+	int m_EpollFD;
+
+	/* protected by l_ComponentMutex */
+	int m_ClientsConnected;
+	int m_TotalConnections;
+
+	boost::mutex m_ConnectionsMutex;
+	std::map<LivestatusConnection *, LivestatusConnection::Ptr> m_Connections;
+
+	boost::mutex m_QueryMutex;
+	boost::condition_variable m_QueryCV;
+	std::deque<std::pair<LivestatusConnection::Ptr, std::vector<String> > > m_Queries;
+	std::deque<LivestatusConnection::Ptr> m_WaitingConnections;
+
+	bool StartEventLoop(void);
+	void IOThreadProc(void);
+	void QueryThreadProc(void);
+
+	void RegisterConnection(const Socket::Ptr& client);
+	void ReadConnection(const LivestatusConnection::Ptr& connection);
+	void WriteConnection(const LivestatusConnection::Ptr& connection);
+	void WriteResponse(const LivestatusConnection::Ptr& connection, const void *buffer, size_t count);
+	bool SendResponse(const LivestatusConnection::Ptr& connection);
+	void ProcessConnection(const LivestatusConnection::Ptr& connection);
+	void CloseConnection(const LivestatusConnection::Ptr& connection);
+	static bool ParseQuery(const LivestatusConnection::Ptr& connection, std::vector<String>& lines);
+
+	void ClientConnected(void);
+	void ClientDisconnected(void);
+};
+
+/**
+ * The stream a query's response is written to when the event-based I/O loop
+ * is used. Writes block while too much of the response is still waiting to
+ * be sent to the client.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusResponseStream : public Stream
+{
+public:
+	DECLARE_PTR_TYPEDEFS(LivestatusResponseStream);
+
+	LivestatusResponseStream(LivestatusListener *listener, const LivestatusConnection::Ptr& connection);
+
+	virtual size_t Read(void *buffer, size_t count);
+	virtual void Write(const void *buffer, size_t count);
+	virtual void Close(void);
+	virtual bool IsEof(void) const;
+
+private:
+	LivestatusListener *m_Listener;
+	LivestatusConnection::Ptr m_Connection;
 };
 
 }
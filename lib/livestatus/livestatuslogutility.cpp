@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "livestatus/livestatuslogutility.hpp"
+#include "livestatus/compatlogindex.hpp"
 #include "icinga/service.hpp"
 #include "icinga/host.hpp"
 #include "icinga/user.hpp"
@@ -40,60 +41,54 @@ using namespace icinga;
 
 void LivestatusLogUtility::CreateLogIndex(const String& path, std::map<time_t, String>& index)
 {
-	Utility::Glob(path + "/icinga.log", boost::bind(&LivestatusLogUtility::CreateLogIndexFileHandler, _1, boost::ref(index)), GlobFile);
-	Utility::Glob(path + "/archives/*.log", boost::bind(&LivestatusLogUtility::CreateLogIndexFileHandler, _1, boost::ref(index)), GlobFile);
-}
-
-void LivestatusLogUtility::CreateLogIndexFileHandler(const String& path, std::map<time_t, String>& index)
-{
-	std::ifstream stream;
-	stream.open(path.CStr(), std::ifstream::in);
-
-	if (!stream)
-		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open log file: " + path));
-
-	/* read the first bytes to get the timestamp: [123456789] */
-	char buffer[12];
-
-	stream.read(buffer, 12);
-
-	if (buffer[0] != '[' || buffer[11] != ']') {
-		/* this can happen for directories too, silently ignore them */
-		return;
-	}
-
-	/* extract timestamp */
-	buffer[11] = 0;
-	time_t ts_start = atoi(buffer+1);
-
-	stream.close();
-
-	Log(LogDebug, "LivestatusLogUtility")
-	    << "Indexing log file: '" << path << "' with timestamp start: '" << ts_start << "'.";
-
-	index[ts_start] = path;
+	CompatLogIndex::GetLogFiles(path, index);
 }
 
+/**
+ * Parses the log files' entries and passes them to the table.
+ *
+ * If seek is false all entries of the log files which were started between
+ * from and until are passed to the table (the statehist table needs the
+ * preceding entries to calculate state durations). Otherwise all log files
+ * overlapping that time range are used and the log file index is used to
+ * skip the entries before from.
+ */
 void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, HistoryTable *table,
-    time_t from, time_t until, const AddRowFunction& addRowFn)
+    time_t from, time_t until, const AddRowFunction& addRowFn, bool seek)
 {
 	ASSERT(table);
 
 	/* m_LogFileIndex map tells which log files are involved ordered by their start timestamp */
-	unsigned int ts;
 	unsigned long line_count = 0;
-	BOOST_FOREACH(boost::tie(ts, boost::tuples::ignore), index) {
-		/* skip log files not in range (performance optimization) */
-		if (ts < from || ts > until)
-			continue;
+	for (std::map<time_t, String>::const_iterator it = index.begin(); it != index.end(); it++) {
+		time_t ts = it->first;
 
-		String log_file = index[ts];
+		if (seek) {
+			std::map<time_t, String>::const_iterator next = it;
+			next++;
+
+			/* skip log files which don't overlap with the time range */
+			if (ts > until || (next != index.end() && next->first < from))
+				continue;
+		} else {
+			/* skip log files not in range (performance optimization) */
+			if (ts < from || ts > until)
+				continue;
+		}
+
+		const String& log_file = it->second;
 		int lineno = 0;
 
 		std::ifstream fp;
 		fp.exceptions(std::ifstream::badbit);
 		fp.open(log_file.CStr(), std::ifstream::in);
 
+		if (seek) {
+			std::streamoff offset;
+			CompatLogIndex::FindOffset(log_file, from, offset, lineno);
+			fp.seekg(offset);
+		}
+
 		while (fp.good()) {
 			std::string line;
 			std::getline(fp, line);
@@ -101,12 +96,29 @@ void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, Histor
 			if (line.empty())
 				continue; /* Ignore empty lines */
 
+			if (seek) {
+				time_t time = CompatLogIndex::ParseTimestamp(line);
+
+				if (time > until)
+					break;
+
+				if (time < from) {
+					line_count++;
+					lineno++;
+					continue;
+				}
+			}
+
 			Dictionary::Ptr log_entry_attrs = LivestatusLogUtility::GetAttributes(line);
 
 			/* no attributes available - invalid log line */
 			if (!log_entry_attrs) {
 				Log(LogDebug, "LivestatusLogUtility")
 				    << "Skipping invalid log line: '" << line << "'.";
+
+				/* every non-empty line is counted, just like in the CompatLogIndex checkpoints */
+				line_count++;
+				lineno++;
 				continue;
 			}
 
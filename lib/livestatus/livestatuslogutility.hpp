@@ -65,8 +65,8 @@ class LivestatusLogUtility
 
 public:
 	static void CreateLogIndex(const String& path, std::map<time_t, String>& index);
-	static void CreateLogIndexFileHandler(const String& path, std::map<time_t, String>& index);
-	static void CreateLogCache(std::map<time_t, String> index, HistoryTable *table, time_t from, time_t until, const AddRowFunction& addRowFn);
+	static void CreateLogCache(std::map<time_t, String> index, HistoryTable *table, time_t from, time_t until,
+	    const AddRowFunction& addRowFn, bool seek = false);
 	static Dictionary::Ptr GetAttributes(const String& text);
 
 private:
@@ -31,6 +31,7 @@
 #include "livestatus/orfilter.hpp"
 #include "livestatus/andfilter.hpp"
 #include "icinga/externalcommandprocessor.hpp"
+#include "icinga/checkable.hpp"
 #include "base/debug.hpp"
 #include "base/convert.hpp"
 #include "base/objectlock.hpp"
@@ -38,19 +39,72 @@
 #include "base/exception.hpp"
 #include "base/utility.hpp"
 #include "base/json.hpp"
+#include "base/initialize.hpp"
+#include "base/dynamicobject.hpp"
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace icinga;
 
 static int l_ExternalCommands = 0;
 static boost::mutex l_QueryMutex;
 
-LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path)
-	: m_KeepAlive(false), m_OutputFormat("csv"), m_ColumnHeaders(true),
-	  m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime()))
+/* Tables with fewer rows per worker thread than this are scanned sequentially. */
+static const size_t l_MinRowsPerScanThread = 1024;
+
+/* Streamed GET responses are flushed once the output buffer exceeds this size. */
+static const size_t l_OutputBufferSize = 64 * 1024;
+
+struct LivestatusCacheEntry
+{
+	String Table;
+	String Output;
+	double Timestamp;
+	unsigned long Generation;
+};
+
+/* The result cache is cleaned up when it contains more than this many entries. */
+static const size_t l_MaxCacheEntries = 1024;
+
+static boost::mutex l_CacheMutex;
+static std::map<String, LivestatusCacheEntry> l_Cache;
+/* bumped when all cached results have to be invalidated */
+static unsigned long l_CacheGeneration = 0;
+/* bumped when the rows of a single table change */
+static std::map<String, unsigned long> l_TableGenerations;
+
+/* Tables which contain host or service state, either in their own rows or
+ * in joined columns (e.g. service_state for comments). */
+static const char * const l_CheckableTables[] = {
+	"hosts", "services", "hostgroups", "servicegroups", "comments", "downtimes", "status"
+};
+
+INITIALIZE_ONCE(&LivestatusQuery::StaticInitialize);
+
+void LivestatusQuery::StaticInitialize(void)
+{
+	DynamicObject::OnStarted.connect(boost::bind(&LivestatusQuery::InvalidateCache));
+	DynamicObject::OnStopped.connect(boost::bind(&LivestatusQuery::InvalidateCache));
+	/* triggered in ProcessCheckResult() */
+	DynamicObject::OnStateChanged.connect(boost::bind(&LivestatusQuery::ObjectStateChangedHandler, _1));
+	Checkable::OnAcknowledgementSet.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+	Checkable::OnAcknowledgementCleared.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+	Checkable::OnCommentAdded.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+	Checkable::OnCommentRemoved.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+	Checkable::OnDowntimeAdded.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+	Checkable::OnDowntimeRemoved.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+	Checkable::OnDowntimeTriggered.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+	Checkable::OnFlappingChanged.connect(boost::bind(&LivestatusQuery::InvalidateCheckableTables));
+}
+
+LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path,
+    int scan_threads, double cache_max_staleness)
+	: m_KeepAlive(false), m_OutputFlushed(false), m_OutputFormat("csv"), m_ColumnHeaders(true),
+	  m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime())),
+	  m_ScanThreads(scan_threads), m_CacheMaxStaleness(cache_max_staleness)
 {
 	if (lines.size() == 0) {
 		m_Verb = "ERROR";
@@ -100,6 +154,8 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 	std::deque<Filter::Ptr> filters, stats;
 	std::deque<Aggregator::Ptr> aggregators;
 
+	m_CacheKey = lines[0] + "\n";
+
 	for (unsigned int i = 1; i < lines.size(); i++) {
 		line = lines[i];
 
@@ -113,6 +169,10 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 
 		params.Trim();
 
+		/* these headers don't affect the result set */
+		if (header != "ResponseHeader" && header != "KeepAlive")
+			m_CacheKey += line + "\n";
+
 		if (header == "ResponseHeader")
 			m_ResponseHeader = params;
 		else if (header == "OutputFormat")
@@ -358,34 +418,66 @@ Filter::Ptr LivestatusQuery::ParseFilter(const String& params, unsigned long& fr
 	return filter;
 }
 
-void LivestatusQuery::PrintResultSet(std::ostream& fp, const Array::Ptr& rs) const
+void LivestatusQuery::BeginResultSet(String& output) const
 {
-	if (m_OutputFormat == "csv") {
-		ObjectLock olock(rs);
-
-		BOOST_FOREACH(const Array::Ptr& row, rs) {
-			bool first = true;
-
-			ObjectLock rlock(row);
-			BOOST_FOREACH(const Value& value, row) {
-				if (first)
-					first = false;
-				else
-					fp << m_Separators[1];
-
-				if (value.IsObjectType<Array>())
-					PrintCsvArray(fp, value, 0);
-				else
-					fp << value;
-			}
+	if (m_OutputFormat == "json")
+		output += "[";
+	else if (m_OutputFormat == "python")
+		output += "[ ";
+}
 
-			fp << m_Separators[0];
+/**
+ * Serializes a single row of the result set and appends it to the
+ * output buffer.
+ *
+ * @param output The output buffer.
+ * @param fp A scratch stream which is reused for all rows.
+ * @param row The row.
+ * @param first Whether this is the first row of the result set.
+ */
+void LivestatusQuery::PrintResultRow(String& output, std::ostringstream& fp, const Array::Ptr& row, bool first) const
+{
+	fp.str("");
+	fp.clear();
+
+	if (m_OutputFormat == "csv") {
+		bool firstValue = true;
+
+		ObjectLock rlock(row);
+		BOOST_FOREACH(const Value& value, row) {
+			if (firstValue)
+				firstValue = false;
+			else
+				fp << m_Separators[1];
+
+			if (value.IsObjectType<Array>())
+				PrintCsvArray(fp, value, 0);
+			else
+				fp << value;
 		}
+
+		fp << m_Separators[0];
 	} else if (m_OutputFormat == "json") {
-		fp << JsonEncode(rs);
+		if (!first)
+			fp << ",";
+
+		fp << JsonEncode(row);
 	} else if (m_OutputFormat == "python") {
-		PrintPythonArray(fp, rs);
+		if (!first)
+			fp << ", ";
+
+		PrintPythonArray(fp, row);
 	}
+
+	output += fp.str();
+}
+
+void LivestatusQuery::EndResultSet(String& output) const
+{
+	if (m_OutputFormat == "json")
+		output += "]";
+	else if (m_OutputFormat == "python")
+		output += " ]";
 }
 
 void LivestatusQuery::PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level) const
@@ -435,6 +527,176 @@ String LivestatusQuery::QuoteStringPython(const String& str) {
 	return "r\"" + result + "\"";
 }
 
+/**
+ * Resolves the query's columns and compiles its filters and aggregators, so
+ * that none of this has to be done for every row.
+ *
+ * @param table The table the query is executed on.
+ * @param columns The names of the columns which are returned.
+ * @param[out] accessors The columns which are returned.
+ */
+void LivestatusQuery::CompileQuery(const Table::Ptr& table, const std::vector<String>& columns, std::vector<Column>& accessors)
+{
+	if (m_Filter)
+		m_Filter->Compile(table);
+
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+		aggregator->Compile(table);
+	}
+
+	accessors.reserve(columns.size());
+
+	BOOST_FOREACH(const String& columnName, columns) {
+		accessors.push_back(table->GetColumn(columnName));
+	}
+}
+
+/**
+ * Filters the table's rows and applies all aggregators to the matching rows
+ * in a single pass. Large tables are split into partitions which are scanned
+ * by up to m_ScanThreads worker threads using per-thread partial aggregators.
+ *
+ * @param table The table.
+ * @returns The rows matching the query's filter.
+ */
+std::vector<Value> LivestatusQuery::ScanRows(const Table::Ptr& table) const
+{
+	if (m_ScanThreads <= 1) {
+		std::vector<Value> objects = table->FilterRows(m_Filter);
+
+		AggregateRows(table, objects, m_Aggregators);
+
+		return objects;
+	}
+
+	std::vector<Value> candidates = table->FilterRows(Filter::Ptr());
+
+	size_t partitions = std::min(static_cast<size_t>(m_ScanThreads),
+	    (candidates.size() + l_MinRowsPerScanThread - 1) / l_MinRowsPerScanThread);
+
+	if (partitions <= 1) {
+		std::vector<Value> objects;
+		boost::exception_ptr exception;
+
+		ScanPartition(table, candidates, 0, candidates.size(), objects, m_Aggregators, exception);
+
+		if (exception)
+			boost::rethrow_exception(exception);
+
+		return objects;
+	}
+
+	std::vector<std::vector<Value> > results(partitions);
+	std::vector<std::deque<Aggregator::Ptr> > partials(partitions);
+	std::vector<boost::exception_ptr> exceptions(partitions);
+
+	size_t chunk = (candidates.size() + partitions - 1) / partitions;
+
+	boost::thread_group threads;
+
+	for (size_t i = 0; i < partitions; i++) {
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+			partials[i].push_back(aggregator->Clone());
+		}
+
+		size_t begin = i * chunk;
+		size_t end = std::min(begin + chunk, candidates.size());
+
+		threads.create_thread(boost::bind(&LivestatusQuery::ScanPartition, this, table, boost::cref(candidates),
+		    begin, end, boost::ref(results[i]), boost::cref(partials[i]), boost::ref(exceptions[i])));
+	}
+
+	threads.join_all();
+
+	BOOST_FOREACH(const boost::exception_ptr& exception, exceptions) {
+		if (exception)
+			boost::rethrow_exception(exception);
+	}
+
+	size_t count = 0;
+
+	BOOST_FOREACH(const std::vector<Value>& result, results) {
+		count += result.size();
+	}
+
+	std::vector<Value> objects;
+	objects.reserve(count);
+
+	for (size_t i = 0; i < partitions; i++) {
+		objects.insert(objects.end(), results[i].begin(), results[i].end());
+
+		for (size_t k = 0; k < m_Aggregators.size(); k++)
+			m_Aggregators[k]->Merge(partials[i][k]);
+	}
+
+	return objects;
+}
+
+void LivestatusQuery::ScanPartition(const Table::Ptr& table, const std::vector<Value>& candidates, size_t begin, size_t end,
+    std::vector<Value>& objects, const std::deque<Aggregator::Ptr>& aggregators, boost::exception_ptr& exception) const
+{
+	try {
+		for (size_t i = begin; i < end; i++) {
+			const Value& row = candidates[i];
+
+			if (m_Filter && !m_Filter->Apply(table, row))
+				continue;
+
+			objects.push_back(row);
+		}
+
+		AggregateRows(table, objects, aggregators);
+	} catch (...) {
+		exception = boost::current_exception();
+	}
+}
+
+/**
+ * Applies the aggregators to the specified rows. The values of each column
+ * are extracted only once and then passed to all aggregators which use that
+ * column as a single batch.
+ */
+void LivestatusQuery::AggregateRows(const Table::Ptr& table, const std::vector<Value>& rows,
+    const std::deque<Aggregator::Ptr>& aggregators)
+{
+	if (rows.empty())
+		return;
+
+	std::map<String, std::vector<Aggregator::Ptr> > batches;
+
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, aggregators) {
+		String columnName = aggregator->GetBatchColumn();
+
+		if (!columnName.IsEmpty()) {
+			batches[columnName].push_back(aggregator);
+			continue;
+		}
+
+		BOOST_FOREACH(const Value& row, rows) {
+			aggregator->Apply(table, row);
+		}
+	}
+
+	std::vector<double> values;
+	values.reserve(rows.size());
+
+	typedef std::pair<String, std::vector<Aggregator::Ptr> > BatchPair;
+
+	BOOST_FOREACH(const BatchPair& batch, batches) {
+		Column column = table->GetColumn(batch.first);
+
+		values.clear();
+
+		BOOST_FOREACH(const Value& row, rows) {
+			values.push_back(column.ExtractValue(row));
+		}
+
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, batch.second) {
+			aggregator->ApplyBatch(values);
+		}
+	}
+}
+
 void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 {
 	Log(LogInformation, "LivestatusQuery")
@@ -448,7 +710,19 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		return;
 	}
 
-	std::vector<Value> objects = table->FilterRows(m_Filter);
+	/* results for the history tables depend on the compat log files and the current time */
+	bool cacheable = (m_CacheMaxStaleness > 0 && m_Table != "log" && m_Table != "statehist");
+	unsigned long generation = 0;
+
+	if (cacheable) {
+		String output;
+
+		if (GetCachedResult(output, generation)) {
+			SendResponse(stream, LivestatusErrorOK, output);
+			return;
+		}
+	}
+
 	std::vector<String> columns;
 
 	if (m_Columns.size() > 0)
@@ -456,40 +730,65 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 	else
 		columns = table->GetColumnNames();
 
-	Array::Ptr rs = make_shared<Array>();
+	std::vector<Column> columnAccessors;
+	CompileQuery(table, columns, columnAccessors);
 
-	if (m_Aggregators.empty()) {
-		Array::Ptr header = make_shared<Array>();
+	std::vector<Value> objects = ScanRows(table);
 
-		BOOST_FOREACH(const Value& object, objects) {
-			Array::Ptr row = make_shared<Array>();
+	/*
+	 * Rows are serialized one at a time. Unless the client asked for a
+	 * fixed16 header (which has to contain the length of the entire
+	 * response) the output buffer is flushed to the socket whenever it
+	 * exceeds l_OutputBufferSize bytes.
+	 */
+	bool deferred = (m_ResponseHeader == "fixed16");
 
-			BOOST_FOREACH(const String& columnName, columns) {
-				Column column = table->GetColumn(columnName);
+	String output;
+	std::ostringstream fp;
+	bool first = true;
+
+	BeginResultSet(output);
+
+	if (m_Aggregators.empty()) {
+		BOOST_FOREACH(const Value& object, objects) {
+			if (m_ColumnHeaders) {
+				Array::Ptr header = make_shared<Array>();
 
-				if (m_ColumnHeaders)
+				BOOST_FOREACH(const String& columnName, columns) {
 					header->Add(columnName);
+				}
 
-				row->Add(column.ExtractValue(object));
-			}
+				PrintResultRow(output, fp, header, first);
+				first = false;
 
-			if (m_ColumnHeaders) {
-				rs->Add(header);
 				m_ColumnHeaders = false;
 			}
 
-			rs->Add(row);
+			Array::Ptr row = make_shared<Array>();
+
+			BOOST_FOREACH(const Column& column, columnAccessors) {
+				row->Add(column.ExtractValue(object));
+			}
+
+			PrintResultRow(output, fp, row, first);
+			first = false;
+
+			if (!deferred && output.GetLength() >= l_OutputBufferSize) {
+				stream->Write(output.CStr(), output.GetLength());
+				output.Clear();
+
+				m_OutputFlushed = true;
+
+				/* only complete results can be cached */
+				cacheable = false;
+			}
 		}
 	} else {
 		std::vector<double> stats(m_Aggregators.size(), 0);
 		int index = 0;
 
-		/* add aggregated stats */
+		/* add aggregated stats (the rows were already aggregated by ScanRows) */
 		BOOST_FOREACH(const Aggregator::Ptr aggregator, m_Aggregators) {
-			BOOST_FOREACH(const Value& object, objects) {
-				aggregator->Apply(table, object);
-			}
-
 			stats[index] = aggregator->GetResult();
 			index++;
 		}
@@ -506,7 +805,8 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 				header->Add("stats_" + Convert::ToString(i));
 			}
 
-			rs->Add(header);
+			PrintResultRow(output, fp, header, first);
+			first = false;
 		}
 
 		Array::Ptr row = make_shared<Array>();
@@ -516,9 +816,7 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		 * may not be accurate for grouping!
 		 */
 		if (objects.size() > 0 && m_Columns.size() > 0) {
-			BOOST_FOREACH(const String& columnName, m_Columns) {
-				Column column = table->GetColumn(columnName);
-
+			BOOST_FOREACH(const Column& column, columnAccessors) {
 				row->Add(column.ExtractValue(objects[0])); // first object wins
 			}
 		}
@@ -526,13 +824,118 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		for (size_t i = 0; i < m_Aggregators.size(); i++)
 			row->Add(stats[i]);
 
-		rs->Add(row);
+		PrintResultRow(output, fp, row, first);
 	}
 
-	std::ostringstream result;
-	PrintResultSet(result, rs);
+	EndResultSet(output);
 
-	SendResponse(stream, LivestatusErrorOK, result.str());
+	if (cacheable)
+		AddCachedResult(output, generation);
+
+	SendResponse(stream, LivestatusErrorOK, output);
+}
+
+/**
+ * Looks up the result of an identical query in the result cache. Results
+ * are reused as long as the query's table hasn't changed since they were generated
+ * and they're not older than the configured maximum staleness.
+ *
+ * @param[out] output The cached result.
+ * @param[out] generation The current generation of the query's table.
+ * @returns true if a cached result was found.
+ */
+bool LivestatusQuery::GetCachedResult(String& output, unsigned long& generation) const
+{
+	boost::mutex::scoped_lock lock(l_CacheMutex);
+
+	generation = GetCacheGeneration();
+
+	std::map<String, LivestatusCacheEntry>::const_iterator it = l_Cache.find(m_CacheKey);
+
+	if (it == l_Cache.end())
+		return false;
+
+	const LivestatusCacheEntry& entry = it->second;
+
+	if (entry.Generation != generation || entry.Timestamp < Utility::GetTime() - m_CacheMaxStaleness)
+		return false;
+
+	output = entry.Output;
+
+	return true;
+}
+
+void LivestatusQuery::AddCachedResult(const String& output, unsigned long generation) const
+{
+	double now = Utility::GetTime();
+
+	boost::mutex::scoped_lock lock(l_CacheMutex);
+
+	/* objects were changed while the query was executed */
+	if (generation != GetCacheGeneration())
+		return;
+
+	if (l_Cache.size() >= l_MaxCacheEntries) {
+		std::map<String, LivestatusCacheEntry>::iterator it = l_Cache.begin();
+
+		while (it != l_Cache.end()) {
+			if (it->second.Generation != l_CacheGeneration + l_TableGenerations[it->second.Table] ||
+			    it->second.Timestamp < now - m_CacheMaxStaleness)
+				l_Cache.erase(it++);
+			else
+				it++;
+		}
+
+		if (l_Cache.size() >= l_MaxCacheEntries)
+			l_Cache.clear();
+	}
+
+	LivestatusCacheEntry& entry = l_Cache[m_CacheKey];
+	entry.Table = m_Table;
+	entry.Output = output;
+	entry.Timestamp = now;
+	entry.Generation = generation;
+}
+
+/**
+ * Returns the generation of the query's table. Both counters only ever
+ * increase, so their sum changes whenever either of them does.
+ *
+ * Caller must hold l_CacheMutex.
+ */
+unsigned long LivestatusQuery::GetCacheGeneration(void) const
+{
+	return l_CacheGeneration + l_TableGenerations[m_Table];
+}
+
+/**
+ * Invalidates all cached query results.
+ */
+void LivestatusQuery::InvalidateCache(void)
+{
+	boost::mutex::scoped_lock lock(l_CacheMutex);
+
+	l_CacheGeneration++;
+}
+
+/**
+ * Invalidates cached results for tables which show host or service state.
+ * Results for e.g. contacts or commands are kept.
+ */
+void LivestatusQuery::InvalidateCheckableTables(void)
+{
+	boost::mutex::scoped_lock lock(l_CacheMutex);
+
+	for (size_t i = 0; i < sizeof(l_CheckableTables) / sizeof(l_CheckableTables[0]); i++)
+		l_TableGenerations[l_CheckableTables[i]]++;
+}
+
+void LivestatusQuery::ObjectStateChangedHandler(const DynamicObject::Ptr& object)
+{
+	if (dynamic_pointer_cast<Checkable>(object))
+		InvalidateCheckableTables();
+	else
+		InvalidateCache();
 }
 
 void LivestatusQuery::ExecuteCommandHelper(const Stream::Ptr& stream)
@@ -546,6 +949,8 @@ void LivestatusQuery::ExecuteCommandHelper(const Stream::Ptr& stream)
 	Log(LogInformation, "LivestatusQuery")
 	    << "Executing command: " << m_Command;
 	ExternalCommandProcessor::Execute(m_Command);
+
+	InvalidateCache();
 	SendResponse(stream, LivestatusErrorOK, "");
 }
 
@@ -601,6 +1006,14 @@ bool LivestatusQuery::Execute(const Stream::Ptr& stream)
 		else
 			BOOST_THROW_EXCEPTION(std::runtime_error("Invalid livestatus query verb."));
 	} catch (const std::exception& ex) {
+		/* An error response can't be appended to a partially written result. */
+		if (m_OutputFlushed) {
+			Log(LogWarning, "LivestatusQuery")
+			    << "Closing connection: Error while writing livestatus response: " << DiagnosticInformation(ex);
+			stream->Close();
+			return false;
+		}
+
 		SendResponse(stream, LivestatusErrorQuery, DiagnosticInformation(ex));
 	}
 
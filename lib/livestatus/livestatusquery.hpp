@@ -25,6 +25,8 @@
 #include "base/object.hpp"
 #include "base/array.hpp"
 #include "base/stream.hpp"
+#include "base/dynamicobject.hpp"
+#include <boost/exception_ptr.hpp>
 #include <deque>
 
 using namespace icinga;
@@ -47,16 +49,22 @@ class LivestatusQuery : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(LivestatusQuery);
 
-	LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path);
+	LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path,
+	    int scan_threads = 1, double cache_max_staleness = 0);
+
+	static void StaticInitialize(void);
 
 	bool Execute(const Stream::Ptr& stream);
 
 	static int GetExternalCommands(void);
 
+	static void InvalidateCache(void);
+
 private:
 	String m_Verb;
 
 	bool m_KeepAlive;
+	bool m_OutputFlushed; /**< Part of the response has already been written. */
 
 	/* Parameters for GET queries. */
 	String m_Table;
@@ -81,12 +89,31 @@ private:
 	unsigned long m_LogTimeFrom;
 	unsigned long m_LogTimeUntil;
 	String m_CompatLogPath;
+	int m_ScanThreads;
+	double m_CacheMaxStaleness;
+	String m_CacheKey;
 
-	void PrintResultSet(std::ostream& fp, const Array::Ptr& rs) const;
+	void BeginResultSet(String& output) const;
+	void PrintResultRow(String& output, std::ostringstream& fp, const Array::Ptr& row, bool first) const;
+	void EndResultSet(String& output) const;
 	void PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level) const;
 	void PrintPythonArray(std::ostream& fp, const Array::Ptr& array) const;
 	static String QuoteStringPython(const String& str);
 
+	void CompileQuery(const Table::Ptr& table, const std::vector<String>& columns, std::vector<Column>& accessors);
+	std::vector<Value> ScanRows(const Table::Ptr& table) const;
+	static void AggregateRows(const Table::Ptr& table, const std::vector<Value>& rows,
+	    const std::deque<Aggregator::Ptr>& aggregators);
+	void ScanPartition(const Table::Ptr& table, const std::vector<Value>& candidates, size_t begin, size_t end,
+	    std::vector<Value>& objects, const std::deque<Aggregator::Ptr>& aggregators, boost::exception_ptr& exception) const;
+
+	bool GetCachedResult(String& output, unsigned long& generation) const;
+	void AddCachedResult(const String& output, unsigned long generation) const;
+	unsigned long GetCacheGeneration(void) const;
+
+	static void InvalidateCheckableTables(void);
+	static void ObjectStateChangedHandler(const DynamicObject::Ptr& object);
+
 	void ExecuteGetHelper(const Stream::Ptr& stream);
 	void ExecuteCommandHelper(const Stream::Ptr& stream);
 	void ExecuteErrorHelper(const Stream::Ptr& stream);
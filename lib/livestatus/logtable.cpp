@@ -102,8 +102,8 @@ void LogTable::FetchRows(const AddRowFunction& addRowFn)
 	/* create log file index */
 	LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
 
-	/* generate log cache */
-	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+	/* generate log cache, skipping the entries outside of the time range */
+	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn, true);
 }
 
 /* gets called in LivestatusLogUtility::CreateLogCache */
@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "livestatus/maxaggregator.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
@@ -35,7 +36,37 @@ void MaxAggregator::Apply(const Table::Ptr& table, const Value& row)
 		m_Max = value;
 }
 
+String MaxAggregator::GetBatchColumn(void) const
+{
+	return m_MaxAttr;
+}
+
+void MaxAggregator::ApplyBatch(const std::vector<double>& values)
+{
+	double max = m_Max;
+
+	for (size_t i = 0; i < values.size(); i++)
+		max = std::max(max, values[i]);
+
+	m_Max = max;
+}
+
 double MaxAggregator::GetResult(void) const
 {
 	return m_Max;
 }
+
+Aggregator::Ptr MaxAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<MaxAggregator>(m_MaxAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void MaxAggregator::Merge(const Aggregator::Ptr& partial)
+{
+	MaxAggregator::Ptr other = static_pointer_cast<MaxAggregator>(partial);
+
+	if (other->m_Max > m_Max)
+		m_Max = other->m_Max;
+}
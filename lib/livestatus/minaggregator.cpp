@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "livestatus/minaggregator.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
@@ -35,7 +36,37 @@ void MinAggregator::Apply(const Table::Ptr& table, const Value& row)
 		m_Min = value;
 }
 
+String MinAggregator::GetBatchColumn(void) const
+{
+	return m_MinAttr;
+}
+
+void MinAggregator::ApplyBatch(const std::vector<double>& values)
+{
+	double min = m_Min;
+
+	for (size_t i = 0; i < values.size(); i++)
+		min = std::min(min, values[i]);
+
+	m_Min = min;
+}
+
 double MinAggregator::GetResult(void) const
 {
 	return m_Min;
 }
+
+Aggregator::Ptr MinAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<MinAggregator>(m_MinAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void MinAggregator::Merge(const Aggregator::Ptr& partial)
+{
+	MinAggregator::Ptr other = static_pointer_cast<MinAggregator>(partial);
+
+	if (other->m_Min < m_Min)
+		m_Min = other->m_Min;
+}
@@ -37,7 +37,11 @@ public:
 	MinAggregator(const String& attr);
 
 	virtual void Apply(const Table::Ptr& table, const Value& row);
+	virtual String GetBatchColumn(void) const;
+	virtual void ApplyBatch(const std::vector<double>& values);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
+	virtual void Merge(const Aggregator::Ptr& partial);
 
 private:
 	double m_Min;
@@ -37,7 +37,42 @@ void StdAggregator::Apply(const Table::Ptr& table, const Value& row)
 	m_StdCount++;
 }
 
+String StdAggregator::GetBatchColumn(void) const
+{
+	return m_StdAttr;
+}
+
+void StdAggregator::ApplyBatch(const std::vector<double>& values)
+{
+	double sum = 0, qsum = 0;
+
+	for (size_t i = 0; i < values.size(); i++) {
+		sum += values[i];
+		qsum += values[i] * values[i];
+	}
+
+	m_StdSum += sum;
+	m_StdQSum += qsum;
+	m_StdCount += values.size();
+}
+
 double StdAggregator::GetResult(void) const
 {
 	return sqrt((m_StdQSum - (1 / m_StdCount) * pow(m_StdSum, 2)) / (m_StdCount - 1));
 }
+
+Aggregator::Ptr StdAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<StdAggregator>(m_StdAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void StdAggregator::Merge(const Aggregator::Ptr& partial)
+{
+	StdAggregator::Ptr other = static_pointer_cast<StdAggregator>(partial);
+
+	m_StdSum += other->m_StdSum;
+	m_StdQSum += other->m_StdQSum;
+	m_StdCount += other->m_StdCount;
+}
@@ -34,7 +34,36 @@ void SumAggregator::Apply(const Table::Ptr& table, const Value& row)
 	m_Sum += value;
 }
 
+String SumAggregator::GetBatchColumn(void) const
+{
+	return m_SumAttr;
+}
+
+void SumAggregator::ApplyBatch(const std::vector<double>& values)
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < values.size(); i++)
+		sum += values[i];
+
+	m_Sum += sum;
+}
+
 double SumAggregator::GetResult(void) const
 {
 	return m_Sum;
 }
+
+Aggregator::Ptr SumAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<SumAggregator>(m_SumAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void SumAggregator::Merge(const Aggregator::Ptr& partial)
+{
+	SumAggregator::Ptr other = static_pointer_cast<SumAggregator>(partial);
+
+	m_Sum += other->m_Sum;
+}
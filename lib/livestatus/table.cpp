@@ -39,13 +39,44 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/foreach.hpp>
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 
 using namespace icinga;
 
 Table::Table(void)
 { }
 
+static boost::mutex l_TablesMutex;
+static std::map<String, Table::Ptr> l_Tables;
+
+/**
+ * Returns the table with the specified name. Tables which have no
+ * per-query state only build their column schema once; the same
+ * instance is then shared by all queries.
+ */
 Table::Ptr Table::GetByName(const String& name, const String& compat_log_path, const unsigned long& from, const unsigned long& until)
+{
+	if (name == "log")
+		return make_shared<LogTable>(compat_log_path, from, until);
+	else if (name == "statehist")
+		return make_shared<StateHistTable>(compat_log_path, from, until);
+
+	boost::mutex::scoped_lock lock(l_TablesMutex);
+
+	std::map<String, Table::Ptr>::const_iterator it = l_Tables.find(name);
+
+	if (it != l_Tables.end())
+		return it->second;
+
+	Table::Ptr table = CreateSharedTable(name);
+
+	if (table)
+		l_Tables[name] = table;
+
+	return table;
+}
+
+Table::Ptr Table::CreateSharedTable(const String& name)
 {
 	if (name == "status")
 		return make_shared<StatusTable>();
@@ -69,10 +100,6 @@ Table::Ptr Table::GetByName(const String& name, const String& compat_log_path, c
 		return make_shared<DowntimesTable>();
 	else if (name == "timeperiods")
 		return make_shared<TimePeriodsTable>();
-	else if (name == "log")
-		return make_shared<LogTable>(compat_log_path, from, until);
-	else if (name == "statehist")
-		return make_shared<StateHistTable>(compat_log_path, from, until);
 	else if (name == "endpoints")
 		return make_shared<EndpointsTable>();
 
@@ -65,6 +65,8 @@ protected:
 private:
 	std::map<String, Column> m_Columns;
 
+	static Table::Ptr CreateSharedTable(const String& name);
+
 	void FilteredAddRow(std::vector<Value>& rs, const shared_ptr<Filter>& filter, const Value& row);
 };
 
@@ -26,16 +26,47 @@
 #include "base/utility.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include "base/netstring.hpp"
+#include "base/json.hpp"
+#include <boost/thread/once.hpp>
+#include <boost/foreach.hpp>
+
+#ifdef HAVE_EPOLL
+#	include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
 
 using namespace icinga;
 
+#define MAX_IOTHREADS 16
+
+/* Limit for data which is queued for a client in event mode. */
+#define MAX_SEND_BUFFER_SIZE (64 * 1024 * 1024)
+
+/* Limit for received messages which haven't been processed yet. We stop
+ * reading from the client's socket until the queue has been drained to
+ * half of this size. */
+#define MAX_PENDING_MESSAGES 1024
+
+#ifdef HAVE_EPOLL
+static int l_IOThreadCount = 0;
+static int l_NextIOThread = 0;
+static boost::mutex l_IOThreadMutex;
+static boost::once_flag l_IOThreadOnceFlag = BOOST_ONCE_INIT;
+static int l_EpollFDs[MAX_IOTHREADS];
+static boost::mutex l_ClientMutex[MAX_IOTHREADS];
+static std::map<ApiClient *, ApiClient::Ptr> l_Clients[MAX_IOTHREADS];
+#endif /* HAVE_EPOLL */
+
 static Value SetLogPositionHandler(const MessageOrigin& origin, const Dictionary::Ptr& params);
 REGISTER_APIFUNCTION(SetLogPosition, log, &SetLogPositionHandler);
 static Value RequestCertificateHandler(const MessageOrigin& origin, const Dictionary::Ptr& params);
 REGISTER_APIFUNCTION(RequestCertificate, pki, &RequestCertificateHandler);
 
 ApiClient::ApiClient(const String& identity, bool authenticated, const TlsStream::Ptr& stream, ConnectionRole role)
-	: m_Identity(identity), m_Authenticated(authenticated), m_Stream(stream), m_Role(role), m_Seen(Utility::GetTime())
+	: m_Identity(identity), m_Authenticated(authenticated), m_Stream(stream),
+	  m_ReadStream(make_shared<BufferedStream>(stream)), m_Role(role), m_Seen(Utility::GetTime()),
+	  m_FlushPending(false), m_IOThread(-1), m_ReadWantsWrite(false), m_MessageHandlerQueued(false),
+	  m_ReadPaused(false)
 {
 	if (authenticated)
 		m_Endpoint = Endpoint::GetByName(identity);
@@ -43,10 +74,60 @@ ApiClient::ApiClient(const String& identity, bool authenticated, const TlsStream
 
 void ApiClient::Start(void)
 {
+#ifdef HAVE_EPOLL
+	if (l_IOThreadCount > 0) {
+		RegisterEvents();
+		return;
+	}
+#endif /* HAVE_EPOLL */
+
 	boost::thread thread(boost::bind(&ApiClient::MessageThreadProc, static_cast<ApiClient::Ptr>(GetSelf())));
 	thread.detach();
 }
 
+#ifdef HAVE_EPOLL
+static void StartIOThreadsHelper(int count, void (*threadProc)(int))
+{
+	if (count > MAX_IOTHREADS)
+		count = MAX_IOTHREADS;
+
+	for (int tid = 0; tid < count; tid++) {
+		l_EpollFDs[tid] = epoll_create1(EPOLL_CLOEXEC);
+
+		if (l_EpollFDs[tid] < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("epoll_create1")
+			    << boost::errinfo_errno(errno));
+		}
+
+		boost::thread t(boost::bind(threadProc, tid));
+		t.detach();
+	}
+
+	l_IOThreadCount = count;
+}
+#endif /* HAVE_EPOLL */
+
+/**
+ * Starts the I/O threads which multiplex the connections of all API clients
+ * that are started afterwards. If the I/O threads are not started (or epoll
+ * isn't available) each client uses its own thread for reading messages.
+ *
+ * @param count The number of I/O threads.
+ */
+void ApiClient::StartIOThreads(int count)
+{
+#ifdef HAVE_EPOLL
+	if (count <= 0)
+		return;
+
+	boost::call_once(l_IOThreadOnceFlag, boost::bind(&StartIOThreadsHelper, count, &ApiClient::IOThreadProc));
+#else /* HAVE_EPOLL */
+	if (count > 0)
+		Log(LogWarning, "ApiClient", "Event-based I/O is not supported on this platform.");
+#endif /* HAVE_EPOLL */
+}
+
 String ApiClient::GetIdentity(void) const
 {
 	return m_Identity;
@@ -74,34 +155,217 @@ ConnectionRole ApiClient::GetRole(void) const
 
 void ApiClient::SendMessage(const Dictionary::Ptr& message)
 {
-	if (m_WriteQueue.GetLength() > 20000) {
-		Log(LogWarning, "remote")
-		    << "Closing connection for API identity '" << m_Identity << "': Too many queued messages.";
-		Disconnect();
+#ifdef HAVE_EPOLL
+	if (m_IOThread != -1) {
+		SendEncodedMessage(make_shared<EncodedMessage>(message));
 		return;
 	}
+#endif /* HAVE_EPOLL */
 
-	m_WriteQueue.Enqueue(boost::bind(&ApiClient::SendMessageSync, static_cast<ApiClient::Ptr>(GetSelf()), message));
+	EnqueueMessage(message);
 }
 
-void ApiClient::SendMessageSync(const Dictionary::Ptr& message)
+/**
+ * Sends a message which has already been encoded. The same message can be
+ * sent to several clients without encoding it again.
+ *
+ * @param message The message.
+ */
+void ApiClient::SendEncodedMessage(const EncodedMessage::Ptr& message)
 {
-	try {
-		ObjectLock olock(m_Stream);
+#ifdef HAVE_EPOLL
+	if (m_IOThread != -1) {
 		if (m_Stream->IsEof())
 			return;
-		JsonRpc::SendMessage(m_Stream, message);
-		if (message->Get("method") != "log::SetLogPosition")
+
+		if (message->GetMethod() != "log::SetLogPosition")
 			m_Seen = Utility::GetTime();
-	} catch (const std::exception& ex) {
-		std::ostringstream info;
-		info << "Error while sending JSON-RPC message for identity '" << m_Identity << "'";
-		Log(LogWarning, "ApiClient")
-		    << info.str();
-		Log(LogDebug, "ApiClient")
-		    << info.str() << "\n" << DiagnosticInformation(ex);
 
-		Disconnect();
+		boost::mutex::scoped_lock lock(m_SendMutex);
+
+		if (m_SendBuffer->GetAvailableBytes() > MAX_SEND_BUFFER_SIZE) {
+			lock.unlock();
+
+			Log(LogWarning, "remote")
+			    << "Closing connection for API identity '" << m_Identity << "': Too many queued messages.";
+			Disconnect();
+			return;
+		}
+
+		NetString::WriteStringToStream(m_SendBuffer, message->GetJson());
+		RearmEvents();
+
+		return;
+	}
+#endif /* HAVE_EPOLL */
+
+	EnqueueMessage(message);
+}
+
+/**
+ * Adds a message to the list of messages which are sent by FlushWrites().
+ *
+ * @param message The message. This can either be a dictionary, an
+ *		  EncodedMessage or a JSON string.
+ */
+void ApiClient::EnqueueMessage(const Value& message)
+{
+	{
+		boost::mutex::scoped_lock lock(m_SendMutex);
+
+		if (m_PendingWrites.size() > 20000) {
+			lock.unlock();
+
+			Log(LogWarning, "remote")
+			    << "Closing connection for API identity '" << m_Identity << "': Too many queued messages.";
+			Disconnect();
+			return;
+		}
+
+		m_PendingWrites.push_back(message);
+		m_SendCV.notify_all();
+
+		if (m_FlushPending)
+			return;
+
+		m_FlushPending = true;
+	}
+
+	m_WriteQueue.Enqueue(boost::bind(&ApiClient::FlushWrites, static_cast<ApiClient::Ptr>(GetSelf())));
+}
+
+/**
+ * Sends a message which has already been JSON-encoded. Unlike SendMessage()
+ * this waits for queued messages to be sent when the queue is full instead of
+ * closing the connection, so it must not be called from an I/O thread.
+ *
+ * @param json The JSON-encoded message.
+ */
+void ApiClient::SendRawMessage(const String& json)
+{
+#ifdef HAVE_EPOLL
+	if (m_IOThread != -1) {
+		boost::mutex::scoped_lock lock(m_SendMutex);
+
+		while (m_SendBuffer->GetAvailableBytes() > MAX_SEND_BUFFER_SIZE / 2 && !m_Stream->IsEof())
+			m_SendCV.wait(lock);
+
+		NetString::WriteStringToStream(m_SendBuffer, json);
+		RearmEvents();
+
+		return;
+	}
+#endif /* HAVE_EPOLL */
+
+	{
+		boost::mutex::scoped_lock lock(m_SendMutex);
+
+		while (m_PendingWrites.size() > 10000 && !m_Stream->IsEof())
+			m_SendCV.wait(lock);
+
+		m_PendingWrites.push_back(json);
+		m_SendCV.notify_all();
+
+		if (m_FlushPending)
+			return;
+
+		m_FlushPending = true;
+	}
+
+	m_WriteQueue.Enqueue(boost::bind(&ApiClient::FlushWrites, static_cast<ApiClient::Ptr>(GetSelf())));
+}
+
+/**
+ * Sends the queued messages. Messages are encoded into a single buffer in
+ * batches of up to write_batch_size messages, which is then written to the
+ * stream with one call. If write_flush_latency is set we wait for up to that
+ * long for a batch to fill up.
+ */
+void ApiClient::FlushWrites(void)
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+	size_t batchSize = 100;
+	double latency = 0;
+
+	if (listener) {
+		batchSize = std::max(listener->GetWriteBatchSize(), 1);
+		latency = listener->GetWriteFlushLatency();
+	}
+
+	for (;;) {
+		std::vector<Value> messages;
+
+		{
+			boost::mutex::scoped_lock lock(m_SendMutex);
+
+			if (latency > 0 && m_PendingWrites.size() < batchSize) {
+				boost::system_time deadline = boost::get_system_time() +
+				    boost::posix_time::milliseconds(static_cast<long>(latency * 1000));
+
+				while (m_PendingWrites.size() < batchSize && m_SendCV.timed_wait(lock, deadline))
+					; /* empty loop body */
+			}
+
+			while (!m_PendingWrites.empty() && messages.size() < batchSize) {
+				messages.push_back(m_PendingWrites.front());
+				m_PendingWrites.pop_front();
+			}
+
+			if (messages.empty()) {
+				m_FlushPending = false;
+				return;
+			}
+
+			m_SendCV.notify_all();
+		}
+
+		std::ostringstream msgbuf;
+		bool seen = false;
+
+		BOOST_FOREACH(const Value& message, messages) {
+			String json;
+
+			if (message.IsObjectType<Dictionary>()) {
+				Dictionary::Ptr dmessage = message;
+
+				if (dmessage->Get("method") != "log::SetLogPosition")
+					seen = true;
+
+				json = JsonEncode(dmessage);
+			} else if (message.IsObjectType<EncodedMessage>()) {
+				EncodedMessage::Ptr emessage = message;
+
+				if (emessage->GetMethod() != "log::SetLogPosition")
+					seen = true;
+
+				const String& ejson = emessage->GetJson();
+				msgbuf << ejson.GetLength() << ":" << ejson << ",";
+				continue;
+			} else
+				json = message;
+
+			msgbuf << json.GetLength() << ":" << json << ",";
+		}
+
+		String data = msgbuf.str();
+
+		try {
+			ObjectLock olock(m_Stream);
+			if (m_Stream->IsEof())
+				continue;
+			m_Stream->Write(data.CStr(), data.GetLength());
+			if (seen)
+				m_Seen = Utility::GetTime();
+		} catch (const std::exception& ex) {
+			std::ostringstream info;
+			info << "Error while sending JSON-RPC message for identity '" << m_Identity << "'";
+			Log(LogWarning, "ApiClient")
+			    << info.str();
+			Log(LogDebug, "ApiClient")
+			    << info.str() << "\n" << DiagnosticInformation(ex);
+
+			Disconnect();
+		}
 	}
 }
 
@@ -112,6 +376,11 @@ void ApiClient::Disconnect(void)
 
 void ApiClient::DisconnectSync(void)
 {
+#ifdef HAVE_EPOLL
+	if (m_IOThread != -1 && !UnregisterEvents())
+		return; /* already disconnected */
+#endif /* HAVE_EPOLL */
+
 	Log(LogWarning, "ApiClient")
 	    << "API client disconnected for identity '" << m_Identity << "'";
 
@@ -123,17 +392,20 @@ void ApiClient::DisconnectSync(void)
 	}
 
 	m_Stream->Close();
+
+	boost::mutex::scoped_lock lock(m_SendMutex);
+	m_SendCV.notify_all();
 }
 
 bool ApiClient::ProcessMessage(void)
 {
 	Dictionary::Ptr message;
 
-	if (m_Stream->IsEof())
+	if (m_ReadStream->IsEof())
 		return false;
 
 	try {
-		message = JsonRpc::ReadMessage(m_Stream);
+		message = JsonRpc::ReadMessage(m_ReadStream);
 	} catch (const openssl_error& ex) {
 		const unsigned long *pe = boost::get_error_info<errinfo_openssl_error>(ex);
 
@@ -146,6 +418,13 @@ bool ApiClient::ProcessMessage(void)
 	if (!message)
 		return false;
 
+	HandleMessage(message);
+
+	return true;
+}
+
+void ApiClient::HandleMessage(const Dictionary::Ptr& message)
+{
 	if (message->Get("method") != "log::SetLogPosition")
 		m_Seen = Utility::GetTime();
 
@@ -154,7 +433,7 @@ bool ApiClient::ProcessMessage(void)
 
 		/* ignore old messages */
 		if (ts < m_Endpoint->GetRemoteLogPosition())
-			return true;
+			return;
 
 		m_Endpoint->SetRemoteLogPosition(ts);
 	}
@@ -190,10 +469,12 @@ bool ApiClient::ProcessMessage(void)
 	if (message->Contains("id")) {
 		resultMessage->Set("jsonrpc", "2.0");
 		resultMessage->Set("id", message->Get("id"));
-		JsonRpc::SendMessage(m_Stream, resultMessage);
-	}
 
-	return true;
+		if (m_IOThread != -1)
+			SendMessage(resultMessage);
+		else
+			JsonRpc::SendMessage(m_Stream, resultMessage);
+	}
 }
 
 void ApiClient::MessageThreadProc(void)
@@ -211,6 +492,280 @@ void ApiClient::MessageThreadProc(void)
 	Disconnect();
 }
 
+#ifdef HAVE_EPOLL
+void ApiClient::RegisterEvents(void)
+{
+	{
+		boost::mutex::scoped_lock lock(l_IOThreadMutex);
+		m_IOThread = l_NextIOThread;
+		l_NextIOThread = (l_NextIOThread + 1) % l_IOThreadCount;
+	}
+
+	m_RecvBuffer = make_shared<FIFO>();
+	m_SendBuffer = make_shared<FIFO>();
+
+	boost::mutex::scoped_lock lock(l_ClientMutex[m_IOThread]);
+
+	l_Clients[m_IOThread][this] = GetSelf();
+
+	/* The socket is writable right away which makes sure that we also process
+	 * data that was received and buffered during the TLS handshake. */
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.ptr = this;
+	event.events = EPOLLIN | EPOLLOUT | EPOLLONESHOT;
+
+	if (epoll_ctl(l_EpollFDs[m_IOThread], EPOLL_CTL_ADD, m_Stream->GetSocket()->GetFD(), &event) < 0) {
+		l_Clients[m_IOThread].erase(this);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("epoll_ctl")
+		    << boost::errinfo_errno(errno));
+	}
+}
+
+/**
+ * Removes the client from its I/O thread.
+ *
+ * @returns false if the client had already been removed.
+ */
+bool ApiClient::UnregisterEvents(void)
+{
+	boost::mutex::scoped_lock lock(l_ClientMutex[m_IOThread]);
+
+	if (l_Clients[m_IOThread].erase(this) == 0)
+		return false;
+
+	(void)epoll_ctl(l_EpollFDs[m_IOThread], EPOLL_CTL_DEL, m_Stream->GetSocket()->GetFD(), NULL);
+
+	return true;
+}
+
+/**
+ * Re-enables events for the client's socket after they've been handled.
+ * Note: Caller must hold m_SendMutex.
+ */
+void ApiClient::RearmEvents(void)
+{
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.ptr = this;
+	event.events = EPOLLONESHOT;
+
+	bool readPaused = IsReadPaused();
+
+	if (!readPaused)
+		event.events |= EPOLLIN;
+
+	/* The TLS session may also need to write data in order to finish a read. */
+	if (m_SendBuffer->GetAvailableBytes() > 0 || (m_ReadWantsWrite && !readPaused))
+		event.events |= EPOLLOUT;
+
+	(void)epoll_ctl(l_EpollFDs[m_IOThread], EPOLL_CTL_MOD, m_Stream->GetSocket()->GetFD(), &event);
+}
+
+/**
+ * Reads and processes all messages that are available and sends as much of
+ * the queued data as possible without blocking. Events for a client are
+ * always handled by the same I/O thread.
+ */
+void ApiClient::HandleEvents(void)
+{
+	if (m_Stream->IsEof())
+		return;
+
+	try {
+		if (!ReadEvents() || !WriteEvents()) {
+			Disconnect();
+			return;
+		}
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ApiClient")
+		    << "Error while processing JSON-RPC messages for identity '" << m_Identity << "': " << DiagnosticInformation(ex);
+
+		Disconnect();
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(m_SendMutex);
+	RearmEvents();
+}
+
+bool ApiClient::ReadEvents(void)
+{
+	char buffer[16 * 1024];
+
+	try {
+		/* Reading is resumed by HandlePendingMessages() once the queue has been drained. */
+		while (!IsReadPaused()) {
+			bool wantWrite;
+			size_t rc = m_Stream->TryRead(buffer, sizeof(buffer), &wantWrite);
+
+			if (rc == 0) {
+				boost::mutex::scoped_lock lock(m_SendMutex);
+				m_ReadWantsWrite = wantWrite;
+				break;
+			}
+
+			m_RecvBuffer->Write(buffer, rc);
+
+			String json;
+			while (NetString::ReadStringFromBuffer(m_RecvBuffer, &json))
+				QueueMessage(JsonRpc::DecodeMessage(json));
+		}
+	} catch (const openssl_error& ex) {
+		const unsigned long *pe = boost::get_error_info<errinfo_openssl_error>(ex);
+
+		if (pe && *pe == 0)
+			return false; /* Connection was closed cleanly */
+
+		throw;
+	}
+
+	return !m_Stream->IsEof();
+}
+
+/**
+ * Hands a message over to the thread pool so that slow API functions don't
+ * block the I/O thread. Messages for a client are still processed one
+ * after another in the order they were received.
+ */
+void ApiClient::QueueMessage(const Dictionary::Ptr& message)
+{
+	boost::mutex::scoped_lock lock(m_MessageMutex);
+
+	m_PendingMessages.push_back(message);
+
+	if (m_PendingMessages.size() >= MAX_PENDING_MESSAGES)
+		m_ReadPaused = true;
+
+	if (!m_MessageHandlerQueued) {
+		m_MessageHandlerQueued = true;
+		Utility::QueueAsyncCallback(boost::bind(&ApiClient::HandlePendingMessages, static_cast<ApiClient::Ptr>(GetSelf())));
+	}
+}
+
+bool ApiClient::IsReadPaused(void)
+{
+	boost::mutex::scoped_lock lock(m_MessageMutex);
+
+	return m_ReadPaused;
+}
+
+void ApiClient::HandlePendingMessages(void)
+{
+	for (;;) {
+		Dictionary::Ptr message;
+		bool resume = false;
+
+		{
+			boost::mutex::scoped_lock lock(m_MessageMutex);
+
+			if (m_PendingMessages.empty()) {
+				m_MessageHandlerQueued = false;
+				return;
+			}
+
+			message = m_PendingMessages.front();
+			m_PendingMessages.pop_front();
+
+			if (m_ReadPaused && m_PendingMessages.size() <= MAX_PENDING_MESSAGES / 2) {
+				m_ReadPaused = false;
+				resume = true;
+			}
+		}
+
+		if (resume && m_IOThread != -1 && !m_Stream->IsEof()) {
+			boost::mutex::scoped_lock lock(m_SendMutex);
+
+			/* Makes sure that the I/O thread also reads data which the
+			 * TLS session has already buffered. */
+			m_ReadWantsWrite = true;
+			RearmEvents();
+		}
+
+		try {
+			HandleMessage(message);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiClient")
+			    << "Error while processing JSON-RPC message for identity '" << m_Identity << "': " << DiagnosticInformation(ex);
+
+			{
+				boost::mutex::scoped_lock lock(m_MessageMutex);
+				m_PendingMessages.clear();
+				m_MessageHandlerQueued = false;
+			}
+
+			Disconnect();
+			return;
+		}
+	}
+}
+
+bool ApiClient::WriteEvents(void)
+{
+	char buffer[16 * 1024];
+
+	for (;;) {
+		size_t count;
+
+		{
+			boost::mutex::scoped_lock lock(m_SendMutex);
+			count = m_SendBuffer->Peek(buffer, sizeof(buffer));
+		}
+
+		if (count == 0)
+			break;
+
+		/* If this write would block the next attempt will start with
+		 * the same data because other threads only append to the buffer. */
+		size_t rc = m_Stream->TryWrite(buffer, count);
+
+		if (rc == 0)
+			break;
+
+		boost::mutex::scoped_lock lock(m_SendMutex);
+		m_SendBuffer->Read(NULL, rc);
+		m_SendCV.notify_all();
+	}
+
+	return !m_Stream->IsEof();
+}
+
+void ApiClient::IOThreadProc(int tid)
+{
+	epoll_event events[128];
+
+	Utility::SetThreadName("API I/O");
+
+	for (;;) {
+		int rc = epoll_wait(l_EpollFDs[tid], events, sizeof(events) / sizeof(events[0]), -1);
+
+		if (rc < 0 && errno != EINTR)
+			Log(LogCritical, "ApiClient", "epoll_wait() failed.");
+
+		for (int i = 0; i < rc; i++) {
+			ApiClient::Ptr client;
+
+			{
+				boost::mutex::scoped_lock lock(l_ClientMutex[tid]);
+
+				std::map<ApiClient *, ApiClient::Ptr>::iterator it;
+				it = l_Clients[tid].find(static_cast<ApiClient *>(events[i].data.ptr));
+
+				/* The client was disconnected in the meantime. */
+				if (it == l_Clients[tid].end())
+					continue;
+
+				client = it->second;
+			}
+
+			client->HandleEvents();
+		}
+	}
+}
+#endif /* HAVE_EPOLL */
+
 Value SetLogPositionHandler(const MessageOrigin& origin, const Dictionary::Ptr& params)
 {
 	if (!params)
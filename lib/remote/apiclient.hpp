@@ -21,9 +21,13 @@
 #define APICLIENT_H
 
 #include "remote/endpoint.hpp"
+#include "remote/encodedmessage.hpp"
 #include "base/tlsstream.hpp"
+#include "base/bufferedstream.hpp"
+#include "base/fifo.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <deque>
 #include "remote/i2-remote.hpp"
 
 namespace icinga
@@ -59,20 +63,55 @@ public:
 	void DisconnectSync(void);
 
 	void SendMessage(const Dictionary::Ptr& request);
+	void SendEncodedMessage(const EncodedMessage::Ptr& message);
+	void SendRawMessage(const String& json);
+
+	static void StartIOThreads(int count);
 
 private:
 	String m_Identity;
 	bool m_Authenticated;
 	Endpoint::Ptr m_Endpoint;
 	TlsStream::Ptr m_Stream;
+	BufferedStream::Ptr m_ReadStream;
 	ConnectionRole m_Role;
 	double m_Seen;
 
 	WorkQueue m_WriteQueue;
+	std::deque<Value> m_PendingWrites;
+	bool m_FlushPending;
+
+	int m_IOThread; /**< The I/O thread handling this client; -1 if it has its own thread. */
+	boost::mutex m_SendMutex;
+	boost::condition_variable m_SendCV;
+	FIFO::Ptr m_RecvBuffer;
+	FIFO::Ptr m_SendBuffer;
+	bool m_ReadWantsWrite;
+
+	boost::mutex m_MessageMutex;
+	std::deque<Dictionary::Ptr> m_PendingMessages;
+	bool m_MessageHandlerQueued;
+	bool m_ReadPaused;
 
 	bool ProcessMessage(void);
+	void HandleMessage(const Dictionary::Ptr& message);
+	void QueueMessage(const Dictionary::Ptr& message);
+	void HandlePendingMessages(void);
+	bool IsReadPaused(void);
 	void MessageThreadProc(void);
-	void SendMessageSync(const Dictionary::Ptr& request);
+	void EnqueueMessage(const Value& message);
+	void FlushWrites(void);
+
+#ifdef HAVE_EPOLL
+	void RegisterEvents(void);
+	bool UnregisterEvents(void);
+	void RearmEvents(void);
+	void HandleEvents(void);
+	bool ReadEvents(void);
+	bool WriteEvents(void);
+
+	static void IOThreadProc(int tid);
+#endif /* HAVE_EPOLL */
 };
 
 }
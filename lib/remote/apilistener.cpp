@@ -27,6 +27,7 @@
 #include "base/logger.hpp"
 #include "base/objectlock.hpp"
 #include "base/stdiostream.hpp"
+#include "base/bufferedstream.hpp"
 #include "base/application.hpp"
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
@@ -108,6 +109,8 @@ void ApiListener::Start(void)
 		OpenLogFile();
 	}
 
+	ApiClient::StartIOThreads(GetIoThreads());
+
 	/* create the primary JSON-RPC listener */
 	if (!AddListener(GetBindHost(), GetBindPort())) {
 		Log(LogCritical, "ApiListener")
@@ -453,16 +456,21 @@ void ApiListener::RelayMessage(const MessageOrigin& origin, const DynamicObject:
 	m_RelayQueue.Enqueue(boost::bind(&ApiListener::SyncRelayMessage, this, origin, secobj, message, log));
 }
 
-void ApiListener::PersistMessage(const Dictionary::Ptr& message, const DynamicObject::Ptr& secobj)
+/**
+ * Writes a message to the replay log.
+ *
+ * @param json The JSON-encoded message.
+ * @param ts The message's timestamp.
+ * @param secobj The object the message belongs to.
+ */
+void ApiListener::PersistMessage(const String& json, double ts, const DynamicObject::Ptr& secobj)
 {
-	double ts = message->Get("ts");
-
 	ASSERT(ts != 0);
 
 	Dictionary::Ptr pmessage = make_shared<Dictionary>();
 	pmessage->Set("timestamp", ts);
 
-	pmessage->Set("message", JsonEncode(message));
+	pmessage->Set("message", json);
 	
 	Dictionary::Ptr secname = make_shared<Dictionary>();
 	secname->Set("type", secobj->GetType()->GetName());
@@ -491,8 +499,19 @@ void ApiListener::SyncRelayMessage(const MessageOrigin& origin, const DynamicObj
 	Log(LogNotice, "ApiListener")
 	    << "Relaying '" << message->Get("method") << "' message";
 
-	if (log)
-		PersistMessage(message, secobj);
+	/* The message is encoded only once for all clients. Messages from other
+	 * zones get an originZone attribute which isn't written to the replay
+	 * log, so these need to be encoded again. */
+	EncodedMessage::Ptr emessage;
+
+	if (log) {
+		String json = JsonEncode(message);
+
+		PersistMessage(json, ts, secobj);
+
+		if (!origin.FromZone)
+			emessage = make_shared<EncodedMessage>(json, message->Get("method"));
+	}
 
 	if (origin.FromZone)
 		message->Set("originZone", origin.FromZone->GetName());
@@ -555,8 +574,11 @@ void ApiListener::SyncRelayMessage(const MessageOrigin& origin, const DynamicObj
 				Log(LogNotice, "ApiListener")
 				    << "Sending message to '" << endpoint->GetName() << "'";
 
+				if (!emessage)
+					emessage = make_shared<EncodedMessage>(message);
+
 				BOOST_FOREACH(const ApiClient::Ptr& client, endpoint->GetClients())
-					client->SendMessage(message);
+					client->SendEncodedMessage(emessage);
 			}
 		}
 	}
@@ -674,7 +696,8 @@ void ApiListener::ReplayLog(const ApiClient::Ptr& client)
 			    << "Replaying log: " << path;
 
 			std::fstream *fp = new std::fstream(path.CStr(), std::fstream::in);
-			StdioStream::Ptr logStream = make_shared<StdioStream>(fp, true);
+			StdioStream::Ptr sfp = make_shared<StdioStream>(fp, true);
+			BufferedStream::Ptr logStream = make_shared<BufferedStream>(sfp);
 
 			String message;
 			while (true) {
@@ -713,7 +736,7 @@ void ApiListener::ReplayLog(const ApiClient::Ptr& client)
 						continue;
 				}
 
-				NetString::WriteStringToStream(client->GetStream(), pmessage->Get("message"));
+				client->SendRawMessage(pmessage->Get("message"));
 				count++;
 
 				peer_ts = pmessage->Get("timestamp");
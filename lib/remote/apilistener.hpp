@@ -92,7 +92,7 @@ private:
 	size_t m_LogMessageCount;
 
 	void SyncRelayMessage(const MessageOrigin& origin, const DynamicObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
-	void PersistMessage(const Dictionary::Ptr& message, const DynamicObject::Ptr& secobj);
+	void PersistMessage(const String& json, double ts, const DynamicObject::Ptr& secobj);
 
 	void OpenLogFile(void);
 	void RotateLogFile(void);
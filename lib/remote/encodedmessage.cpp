@@ -0,0 +1,48 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "remote/encodedmessage.hpp"
+#include "base/json.hpp"
+
+using namespace icinga;
+
+EncodedMessage::EncodedMessage(const Dictionary::Ptr& message)
+	: m_Json(JsonEncode(message)), m_Method(message->Get("method"))
+{ }
+
+/**
+ * Constructor for the EncodedMessage class.
+ *
+ * @param json The JSON-encoded message.
+ * @param method The message's JSON-RPC method.
+ */
+EncodedMessage::EncodedMessage(const String& json, const String& method)
+	: m_Json(json), m_Method(method)
+{ }
+
+const String& EncodedMessage::GetJson(void) const
+{
+	return m_Json;
+}
+
+String EncodedMessage::GetMethod(void) const
+{
+	return m_Method;
+}
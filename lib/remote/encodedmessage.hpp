@@ -0,0 +1,54 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef ENCODEDMESSAGE_H
+#define ENCODEDMESSAGE_H
+
+#include "remote/i2-remote.hpp"
+#include "base/dictionary.hpp"
+
+namespace icinga
+{
+
+/**
+ * A JSON-RPC message which has already been JSON-encoded. The encoded
+ * message is immutable and can be shared between any number of clients.
+ *
+ * @ingroup remote
+ */
+class I2_REMOTE_API EncodedMessage : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(EncodedMessage);
+
+	EncodedMessage(const Dictionary::Ptr& message);
+	EncodedMessage(const String& json, const String& method);
+
+	const String& GetJson(void) const;
+	String GetMethod(void) const;
+
+private:
+	String m_Json;
+	String m_Method;
+};
+
+}
+
+#endif /* ENCODEDMESSAGE_H */
@@ -43,6 +43,11 @@ Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream)
 		return Dictionary::Ptr();
 
 	//std::cerr << "<< " << jsonString << std::endl;
+	return DecodeMessage(jsonString);
+}
+
+Dictionary::Ptr JsonRpc::DecodeMessage(const String& jsonString)
+{
 	Value value = JsonDecode(jsonString);
 
 	if (!value.IsObjectType<Dictionary>()) {
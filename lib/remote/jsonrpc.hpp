@@ -37,6 +37,7 @@ class I2_REMOTE_API JsonRpc
 public:
 	static void SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message);
 	static Dictionary::Ptr ReadMessage(const Stream::Ptr& stream);
+	static Dictionary::Ptr DecodeMessage(const String& jsonString);
 
 private:
 	JsonRpc(void);
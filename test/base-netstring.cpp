@@ -19,6 +19,7 @@
 
 #include "base/netstring.hpp"
 #include "base/fifo.hpp"
+#include "base/bufferedstream.hpp"
 #include <boost/test/unit_test.hpp>
 
 using namespace icinga;
@@ -38,4 +39,47 @@ BOOST_AUTO_TEST_CASE(netstring)
 	fifo->Close();
 }
 
+BOOST_AUTO_TEST_CASE(buffered)
+{
+	FIFO::Ptr fifo = make_shared<FIFO>();
+	BufferedStream::Ptr stream = make_shared<BufferedStream>(fifo, 8);
+
+	String large(100, 'x');
+
+	NetString::WriteStringToStream(fifo, "hello");
+	NetString::WriteStringToStream(fifo, "");
+	NetString::WriteStringToStream(fifo, large);
+	NetString::WriteStringToStream(fifo, "world");
+
+	String s;
+	BOOST_CHECK(NetString::ReadStringFromStream(stream, &s));
+	BOOST_CHECK(s == "hello");
+	BOOST_CHECK(NetString::ReadStringFromStream(stream, &s));
+	BOOST_CHECK(s == "");
+	BOOST_CHECK(NetString::ReadStringFromStream(stream, &s));
+	BOOST_CHECK(s == large);
+	BOOST_CHECK(NetString::ReadStringFromStream(stream, &s));
+	BOOST_CHECK(s == "world");
+	BOOST_CHECK(!NetString::ReadStringFromStream(stream, &s));
+
+	stream->Close();
+}
+
+BOOST_AUTO_TEST_CASE(partial)
+{
+	FIFO::Ptr fifo = make_shared<FIFO>();
+
+	String s;
+	fifo->Write("5:hel", 5);
+	BOOST_CHECK(!NetString::ReadStringFromBuffer(fifo, &s));
+	BOOST_CHECK(fifo->GetAvailableBytes() == 5);
+
+	fifo->Write("lo,", 3);
+	BOOST_CHECK(NetString::ReadStringFromBuffer(fifo, &s));
+	BOOST_CHECK(s == "hello");
+	BOOST_CHECK(fifo->GetAvailableBytes() == 0);
+
+	fifo->Close();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "base/timer.hpp"
+#include "base/timingwheel.hpp"
 #include "base/utility.hpp"
 #include "base/application.hpp"
 #include <boost/test/unit_test.hpp>
@@ -89,4 +90,57 @@ BOOST_AUTO_TEST_CASE(scope)
 	BOOST_CHECK(counter >= 4 && counter <= 6);
 }
 
+BOOST_AUTO_TEST_CASE(wheel)
+{
+	TimingWheel wheel;
+	Timer::Ptr t1 = make_shared<Timer>();
+	Timer::Ptr t2 = make_shared<Timer>();
+	Timer::Ptr t3 = make_shared<Timer>();
+
+	double now = Utility::GetTime();
+
+	wheel.Insert(t1.get(), now + 0.5);
+	wheel.Insert(t2.get(), now + 5);
+	wheel.Insert(t3.get(), now + 500);
+	BOOST_CHECK(wheel.GetLength() == 3);
+	BOOST_CHECK(wheel.GetNextExpiry() <= now + 0.5);
+
+	std::vector<Timer *> expired;
+	wheel.Advance(now, expired);
+	BOOST_CHECK(expired.empty());
+
+	wheel.Advance(now + 1, expired);
+	BOOST_CHECK(expired.size() == 1 && expired[0] == t1.get());
+
+	BOOST_CHECK(wheel.Remove(t2.get()));
+	BOOST_CHECK(!wheel.Remove(t2.get()));
+
+	expired.clear();
+	wheel.Advance(now + 499, expired);
+	BOOST_CHECK(expired.empty());
+
+	wheel.Advance(now + 501, expired);
+	BOOST_CHECK(expired.size() == 1 && expired[0] == t3.get());
+	BOOST_CHECK(wheel.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(wheel_clock_backwards)
+{
+	TimingWheel wheel;
+	Timer::Ptr t1 = make_shared<Timer>();
+
+	double now = Utility::GetTime();
+
+	std::vector<Timer *> expired;
+	wheel.Advance(now + 3600, expired);
+
+	/* the clock was set back by an hour */
+	wheel.Insert(t1.get(), now + 1);
+	wheel.Advance(now, expired);
+	BOOST_CHECK(expired.empty());
+
+	wheel.Advance(now + 2, expired);
+	BOOST_CHECK(expired.size() == 1 && expired[0] == t1.get());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
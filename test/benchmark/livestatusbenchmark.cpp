@@ -0,0 +1,512 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "livestatus/livestatusquery.hpp"
+#include "icinga/service.hpp"
+#include "icinga/checkresult.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configitem.hpp"
+#include "config/configitembuilder.hpp"
+#include "config/configcompilercontext.hpp"
+#include "base/application.hpp"
+#include "base/dynamictype.hpp"
+#include "base/fifo.hpp"
+#include "base/unixsocket.hpp"
+#include "base/networkstream.hpp"
+#include "base/logger.hpp"
+#include "base/convert.hpp"
+#include "base/utility.hpp"
+#include "base/exception.hpp"
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+using namespace icinga;
+
+namespace po = boost::program_options;
+
+/**
+ * Measures Livestatus query throughput and latency against a synthetic
+ * object population. Queries are run both in-process (LivestatusQuery
+ * writing into a FIFO) and over the UNIX socket of a LivestatusListener.
+ *
+ * Usage: livestatus_benchmark [--hosts N] [--services-per-host N] ... (see --help)
+ */
+
+struct BenchmarkQuery
+{
+	const char *Name;
+	int Weight;
+	String Text;
+};
+
+struct BenchmarkResult
+{
+	std::vector<double> Latencies;
+	size_t Bytes;
+	int Failed;
+
+	BenchmarkResult(void)
+		: Bytes(0), Failed(0)
+	{ }
+};
+
+static boost::mutex l_Mutex;
+static size_t l_NextQuery;
+
+static String GetHostName(int host)
+{
+	return "bench-host-" + Convert::ToString(host);
+}
+
+static String GetServiceName(int service)
+{
+	return "bench-service-" + Convert::ToString(service);
+}
+
+static bool CreateObjects(int hosts, int servicesPerHost, const String& workDir, int scanThreads,
+    int queryThreads, double cacheMaxStaleness)
+{
+	std::ostringstream config;
+
+	config << "object CheckCommand \"benchmark\" {\n"
+	       << "  methods.execute = \"PluginCheck\"\n"
+	       << "  command = [ \"/bin/true\" ]\n"
+	       << "}\n";
+
+	for (int i = 0; i < hosts; i++) {
+		config << "object Host \"" << GetHostName(i) << "\" {\n"
+		       << "  check_command = \"benchmark\"\n"
+		       << "}\n";
+
+		for (int k = 0; k < servicesPerHost; k++) {
+			config << "object Service \"" << GetServiceName(k) << "\" {\n"
+			       << "  host_name = \"" << GetHostName(i) << "\"\n"
+			       << "  check_command = \"benchmark\"\n"
+			       << "}\n";
+		}
+	}
+
+	config << "object LivestatusListener \"benchmark\" {\n"
+	       << "  socket_type = \"unix\"\n"
+	       << "  socket_path = \"" << workDir << "/livestatus\"\n"
+	       << "  compat_log_path = \"" << workDir << "\"\n"
+	       << "  scan_threads = " << scanThreads << "\n"
+	       << "  query_threads = " << queryThreads << "\n"
+	       << "  cache_max_staleness = " << cacheMaxStaleness << "\n"
+	       << "}\n";
+
+	ConfigCompiler::CompileText("<benchmark>", config.str());
+
+	String name, fragment;
+	BOOST_FOREACH(boost::tie(name, fragment), ConfigFragmentRegistry::GetInstance()->GetItems()) {
+		ConfigCompiler::CompileText(name, fragment);
+	}
+
+	ConfigItemBuilder::Ptr builder = make_shared<ConfigItemBuilder>();
+	builder->SetType("IcingaApplication");
+	builder->SetName("application");
+	ConfigItem::Ptr item = builder->Compile();
+	item->Register();
+
+	bool result = ConfigItem::ValidateItems();
+
+	BOOST_FOREACH(const ConfigCompilerMessage& message, ConfigCompilerContext::GetInstance()->GetMessages()) {
+		if (message.Error)
+			std::cerr << "Config error: " << message.Text << std::endl;
+	}
+
+	if (!result)
+		return false;
+
+	return ConfigItem::ActivateItems();
+}
+
+static void CreateState(int comments, int downtimes)
+{
+	double now = Utility::GetTime();
+	int i = 0;
+
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjectsByType<Service>()) {
+		/* Roughly 85% OK, 8% warning, 5% critical and 2% unknown. */
+		int roll = rand() % 100;
+		ServiceState state = (roll < 85) ? ServiceOK : (roll < 93) ? ServiceWarning : (roll < 98) ? ServiceCritical : ServiceUnknown;
+
+		CheckResult::Ptr cr = make_shared<CheckResult>();
+		cr->SetScheduleStart(now - 1);
+		cr->SetScheduleEnd(now);
+		cr->SetExecutionStart(now - 0.1 - (rand() % 1000) / 1000.0);
+		cr->SetExecutionEnd(now);
+		cr->SetExitStatus(state);
+		cr->SetState(state);
+		cr->SetOutput("Synthetic check result");
+		service->ProcessCheckResult(cr);
+
+		if (i < comments)
+			service->AddComment(CommentUser, "benchmark", "Synthetic comment", 0);
+
+		if (i < downtimes)
+			service->AddDowntime("benchmark", "Synthetic downtime", now - 60, now + 3600, true, String(), 0);
+
+		i++;
+	}
+}
+
+static void WriteLogLines(std::ofstream& fp, double start, int lines, int hosts, int servicesPerHost)
+{
+	static const char *states[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+
+	for (int i = 0; i < lines; i++) {
+		long ts = static_cast<long>(start + i * 86400.0 / lines);
+		String host = GetHostName(rand() % hosts);
+
+		if (servicesPerHost > 0 && i % 10 != 0) {
+			int state = rand() % 4;
+			fp << "[" << ts << "] SERVICE ALERT: " << host << ";" << GetServiceName(rand() % servicesPerHost)
+			   << ";" << states[state] << ";HARD;3;Synthetic output\n";
+		} else {
+			fp << "[" << ts << "] HOST ALERT: " << host << ";" << (i % 20 == 0 ? "DOWN" : "UP")
+			   << ";HARD;3;Synthetic output\n";
+		}
+	}
+}
+
+static void CreateCompatLogs(const String& workDir, int days, int linesPerDay, int hosts, int servicesPerHost)
+{
+	Utility::MkDirP(workDir + "/archives", 0750);
+
+	double today = static_cast<long>(Utility::GetTime() / 86400) * 86400.0;
+
+	for (int day = days; day > 0; day--) {
+		double start = today - day * 86400.0;
+		String path = workDir + "/archives/icinga-" + Utility::FormatDateTime("%m-%d-%Y-%H", start) + ".log";
+
+		std::ofstream fp(path.CStr(), std::ofstream::out | std::ofstream::trunc);
+		WriteLogLines(fp, start, linesPerDay, hosts, servicesPerHost);
+	}
+
+	String path = workDir + "/icinga.log";
+	std::ofstream fp(path.CStr(), std::ofstream::out | std::ofstream::trunc);
+	WriteLogLines(fp, today, linesPerDay, hosts, servicesPerHost);
+}
+
+static std::vector<BenchmarkQuery> GetQueryMix(void)
+{
+	String since = Convert::ToString(static_cast<long>(Utility::GetTime() - 86400));
+
+	BenchmarkQuery queries[] = {
+		{ "hosts", 15, "GET hosts\nColumns: name state plugin_output last_check\n" },
+		{ "problems", 25, "GET services\nColumns: host_name description state plugin_output\nFilter: state != 0\n" },
+		{ "service_stats", 20, "GET services\nStats: state = 0\nStats: state = 1\nStats: state = 2\nStats: state = 3\n" },
+		{ "service_perf", 10, "GET services\nStats: avg latency\nStats: max execution_time\nStats: sum execution_time\n" },
+		{ "host_detail", 10, "GET services\nColumns: description state last_check\nFilter: host_name = " + GetHostName(0) + "\n" },
+		{ "comments", 5, "GET comments\nColumns: host_name service_description author comment\n" },
+		{ "downtimes", 5, "GET downtimes\nColumns: host_name service_description start_time end_time\n" },
+		{ "status", 5, "GET status\n" },
+		{ "log", 5, "GET log\nColumns: time host_name service_description state plugin_output\nFilter: time >= " + since + "\nFilter: class = 1\n" }
+	};
+
+	return std::vector<BenchmarkQuery>(queries, queries + sizeof(queries) / sizeof(queries[0]));
+}
+
+static std::vector<const BenchmarkQuery *> GetQuerySequence(const std::vector<BenchmarkQuery>& mix, int count)
+{
+	int total = 0;
+
+	BOOST_FOREACH(const BenchmarkQuery& query, mix) {
+		total += query.Weight;
+	}
+
+	std::vector<const BenchmarkQuery *> sequence;
+	sequence.reserve(count);
+
+	for (int i = 0; i < count; i++) {
+		int roll = rand() % total;
+
+		BOOST_FOREACH(const BenchmarkQuery& query, mix) {
+			roll -= query.Weight;
+
+			if (roll < 0) {
+				sequence.push_back(&query);
+				break;
+			}
+		}
+	}
+
+	return sequence;
+}
+
+static bool GetNextQuery(size_t count, size_t& index)
+{
+	boost::mutex::scoped_lock lock(l_Mutex);
+
+	if (l_NextQuery >= count)
+		return false;
+
+	index = l_NextQuery++;
+	return true;
+}
+
+static size_t RunLocalQuery(const String& text, const String& compatLogPath, int scanThreads, double cacheMaxStaleness)
+{
+	std::vector<String> lines;
+	boost::algorithm::split(lines, text, boost::is_any_of("\n"));
+
+	while (!lines.empty() && lines.back().IsEmpty())
+		lines.pop_back();
+
+	lines.push_back("OutputFormat: json");
+	lines.push_back("ResponseHeader: fixed16");
+	/* Without KeepAlive Execute() closes the FIFO and returns false. */
+	lines.push_back("KeepAlive: on");
+
+	FIFO::Ptr fifo = make_shared<FIFO>();
+	LivestatusQuery::Ptr query = make_shared<LivestatusQuery>(lines, compatLogPath, scanThreads, cacheMaxStaleness);
+
+	if (!query->Execute(fifo))
+		return 0;
+
+	size_t size = fifo->GetAvailableBytes();
+
+	if (size < 16)
+		return 0;
+
+	char header[16];
+	fifo->Read(header, sizeof(header));
+
+	if (String(header, header + 3) != "200")
+		return 0;
+
+	return size - sizeof(header);
+}
+
+static void ReadExactly(const Stream::Ptr& stream, char *buffer, size_t count)
+{
+	while (count > 0) {
+		size_t rc = stream->Read(buffer, count);
+
+		if (rc == 0)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Livestatus connection closed unexpectedly."));
+
+		buffer += rc;
+		count -= rc;
+	}
+}
+
+static size_t RunSocketQuery(const Stream::Ptr& stream, const String& text)
+{
+	String request = text + "OutputFormat: json\nResponseHeader: fixed16\nKeepAlive: on\n\n";
+	stream->Write(request.CStr(), request.GetLength());
+
+	char header[16];
+	ReadExactly(stream, header, sizeof(header));
+
+	String code(header, header + 3);
+	String length(header + 4, header + 15);
+	boost::algorithm::trim(length);
+
+	size_t size = Convert::ToLong(length);
+	std::vector<char> body(size);
+
+	if (size > 0)
+		ReadExactly(stream, &body[0], size);
+
+	if (code != "200")
+		return 0;
+
+	return size;
+}
+
+static void WorkerThreadProc(const std::vector<const BenchmarkQuery *>& sequence, const String& socketPath,
+    const String& compatLogPath, int scanThreads, double cacheMaxStaleness, BenchmarkResult& result)
+{
+	Stream::Ptr stream;
+
+	try {
+		if (!socketPath.IsEmpty()) {
+			UnixSocket::Ptr socket = make_shared<UnixSocket>();
+			socket->Connect(socketPath);
+			stream = make_shared<NetworkStream>(socket);
+		}
+
+		size_t index;
+		while (GetNextQuery(sequence.size(), index)) {
+			double start = Utility::GetTime();
+			size_t bytes;
+
+			if (stream)
+				bytes = RunSocketQuery(stream, sequence[index]->Text);
+			else
+				bytes = RunLocalQuery(sequence[index]->Text, compatLogPath, scanThreads, cacheMaxStaleness);
+
+			result.Latencies.push_back(Utility::GetTime() - start);
+
+			if (bytes == 0)
+				result.Failed++;
+			else
+				result.Bytes += bytes;
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << "Worker failed: " << DiagnosticInformation(ex) << std::endl;
+		result.Failed++;
+	}
+
+	if (stream)
+		stream->Close();
+}
+
+static double GetPercentile(const std::vector<double>& sorted, double percentile)
+{
+	if (sorted.empty())
+		return 0;
+
+	size_t index = std::min(sorted.size() - 1, static_cast<size_t>(percentile * sorted.size()));
+	return sorted[index];
+}
+
+static void RunBenchmark(const char *mode, const std::vector<const BenchmarkQuery *>& sequence, int concurrency,
+    const String& socketPath, const String& compatLogPath, int scanThreads, double cacheMaxStaleness)
+{
+	std::vector<BenchmarkResult> results(concurrency);
+	boost::thread_group threads;
+
+	l_NextQuery = 0;
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < concurrency; i++) {
+		threads.create_thread(boost::bind(&WorkerThreadProc, boost::cref(sequence), socketPath,
+		    compatLogPath, scanThreads, cacheMaxStaleness, boost::ref(results[i])));
+	}
+
+	threads.join_all();
+
+	double duration = Utility::GetTime() - start;
+
+	std::vector<double> latencies;
+	size_t bytes = 0;
+	int failed = 0;
+
+	BOOST_FOREACH(const BenchmarkResult& result, results) {
+		latencies.insert(latencies.end(), result.Latencies.begin(), result.Latencies.end());
+		bytes += result.Bytes;
+		failed += result.Failed;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << std::setw(12) << std::left << mode
+	    << std::fixed << std::setprecision(1) << latencies.size() / duration << " queries/s"
+	    << ", p50 " << std::setprecision(2) << GetPercentile(latencies, 0.50) * 1000 << " ms"
+	    << ", p99 " << GetPercentile(latencies, 0.99) * 1000 << " ms"
+	    << ", " << bytes / 1024 << " KiB"
+	    << " (" << failed << " failed)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	Application::InitializeBase();
+
+	po::options_description desc("Options");
+	desc.add_options()
+		("help", "show this help message")
+		("hosts", po::value<int>()->default_value(1000), "number of hosts")
+		("services-per-host", po::value<int>()->default_value(10), "number of services per host")
+		("comments", po::value<int>()->default_value(500), "number of service comments")
+		("downtimes", po::value<int>()->default_value(500), "number of service downtimes")
+		("log-days", po::value<int>()->default_value(7), "number of days of compat log archives")
+		("log-lines", po::value<int>()->default_value(10000), "number of compat log lines per day")
+		("queries", po::value<int>()->default_value(10000), "number of queries per run")
+		("concurrency", po::value<int>()->default_value(8), "number of concurrent clients")
+		("mode", po::value<std::string>()->default_value("both"), "inprocess, socket or both")
+		("scan-threads", po::value<int>()->default_value(1), "scan_threads for each query")
+		("query-threads", po::value<int>()->default_value(0), "query_threads for the listener")
+		("cache-max-staleness", po::value<double>()->default_value(0), "cache_max_staleness for each query")
+		("work-dir", po::value<std::string>()->default_value("/tmp/icinga2-livestatus-benchmark"), "directory for the compat logs and the socket");
+
+	po::variables_map vm;
+
+	try {
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	} catch (const std::exception& ex) {
+		std::cerr << "Error while parsing command-line options: " << ex.what() << std::endl;
+		return 1;
+	}
+
+	if (vm.count("help")) {
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	int hosts = vm["hosts"].as<int>();
+	int servicesPerHost = vm["services-per-host"].as<int>();
+	int concurrency = vm["concurrency"].as<int>();
+	int scanThreads = vm["scan-threads"].as<int>();
+	double cacheMaxStaleness = vm["cache-max-staleness"].as<double>();
+	String mode = vm["mode"].as<std::string>();
+	String workDir = vm["work-dir"].as<std::string>();
+
+	Logger::SetConsoleLogSeverity(LogWarning);
+
+	srand(1);
+
+	std::cout << "Generating " << hosts << " hosts with " << servicesPerHost << " services each" << std::endl;
+
+	Utility::MkDirP(workDir, 0750);
+	(void) unlink((workDir + "/livestatus").CStr());
+
+	if (!CreateObjects(hosts, servicesPerHost, workDir, scanThreads, vm["query-threads"].as<int>(), cacheMaxStaleness))
+		return 1;
+
+	CreateState(vm["comments"].as<int>(), vm["downtimes"].as<int>());
+	CreateCompatLogs(workDir, vm["log-days"].as<int>(), vm["log-lines"].as<int>(), hosts, servicesPerHost);
+
+	std::vector<BenchmarkQuery> mix = GetQueryMix();
+	std::vector<const BenchmarkQuery *> sequence = GetQuerySequence(mix, vm["queries"].as<int>());
+
+	std::cout << "Running " << sequence.size() << " queries with " << concurrency << " concurrent clients" << std::endl;
+
+	if (mode == "inprocess" || mode == "both")
+		RunBenchmark("inprocess", sequence, concurrency, String(), workDir, scanThreads, cacheMaxStaleness);
+
+	if (mode == "socket" || mode == "both") {
+		String socketPath = workDir + "/livestatus";
+
+		/* The listener binds its socket asynchronously. */
+		for (int i = 0; i < 50 && !Utility::PathExists(socketPath); i++)
+			Utility::Sleep(0.1);
+
+		RunBenchmark("socket", sequence, concurrency, socketPath, workDir, scanThreads, cacheMaxStaleness);
+	}
+
+	Application::Exit(0);
+}
@@ -0,0 +1,128 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "base/application.hpp"
+#include "base/process.hpp"
+#include "base/scriptvariable.hpp"
+#include "base/convert.hpp"
+#include "base/utility.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/foreach.hpp>
+#include <iostream>
+#include <iomanip>
+
+using namespace icinga;
+
+/**
+ * Measures how many child processes per second can be spawned with each
+ * of the process creation methods supported by the Process class.
+ *
+ * Usage: process_benchmark [count] [concurrency] [command]
+ */
+
+static boost::mutex l_Mutex;
+static boost::condition_variable l_CV;
+static int l_Running;
+static int l_Failed;
+
+static void ProcessFinishedHandler(const ProcessResult& pr)
+{
+	boost::mutex::scoped_lock lock(l_Mutex);
+
+	if (pr.ExitStatus != 0)
+		l_Failed++;
+
+	l_Running--;
+	l_CV.notify_all();
+}
+
+static double RunBenchmark(const String& command, int count, int concurrency)
+{
+	l_Running = 0;
+	l_Failed = 0;
+
+	Dictionary::Ptr env = make_shared<Dictionary>();
+	env->Set("ICINGA_BENCHMARK", "1");
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < count; i++) {
+		{
+			boost::mutex::scoped_lock lock(l_Mutex);
+
+			while (l_Running >= concurrency)
+				l_CV.wait(lock);
+
+			l_Running++;
+		}
+
+		Process::Ptr process = make_shared<Process>(Process::PrepareCommand(command), env);
+		process->Run(&ProcessFinishedHandler);
+	}
+
+	{
+		boost::mutex::scoped_lock lock(l_Mutex);
+
+		while (l_Running > 0)
+			l_CV.wait(lock);
+	}
+
+	return Utility::GetTime() - start;
+}
+
+int main(int argc, char **argv)
+{
+	Application::InitializeBase();
+
+	int count = (argc > 1) ? Convert::ToLong(argv[1]) : 2000;
+	int concurrency = (argc > 2) ? Convert::ToLong(argv[2]) : 32;
+	String command = (argc > 3) ? argv[3] : "/bin/true";
+
+	/* Grow the heap to resemble a long-running daemon; fork() has to copy the page tables. */
+	std::vector<char> ballast(256 * 1024 * 1024, 1);
+
+	struct {
+		const char *Name;
+		bool UseVfork;
+		bool UsePosixSpawn;
+	} methods[] = {
+		{ "fork", false, false },
+		{ "vfork", true, false },
+#ifdef HAVE_POSIX_SPAWN
+		{ "posix_spawn", false, true },
+#endif /* HAVE_POSIX_SPAWN */
+	};
+
+	std::cout << "Spawning " << count << " x '" << command << "' with " << concurrency << " concurrent processes" << std::endl;
+
+	for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		ScriptVariable::Set("UseVfork", methods[i].UseVfork);
+		ScriptVariable::Set("UsePosixSpawn", methods[i].UsePosixSpawn);
+
+		double duration = RunBenchmark(command, count, concurrency);
+
+		std::cout << std::setw(12) << std::left << methods[i].Name
+		    << std::fixed << std::setprecision(1) << count / duration << " spawns/s"
+		    << " (" << l_Failed << " failed)" << std::endl;
+	}
+
+	return 0;
+}